@@ -2,139 +2,688 @@
 #include<stdlib.h>
 #include<stdint.h>
 #include<string.h>
+#include<time.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<stdatomic.h>
 
 #include "aes.h"
 #include "sha1.h"
 #include "hmac.h"
+#include "firmware_image.h"
+#include "lzss.h"
+#include "fwdelta.h"
+#include "keystore.h"
 
 #define HMAC_KEY_MAXLEN 0x100
 #define FILE_RENAME_SECURED 0x08
 #define FILE_RENAME_SECURED_STR "secured_"
 #define MAX_PATH_LEN 200
 
+/* J1939 TP.DT carries 7 bytes in one 29 bit identifier frame of 131 bits (bit stuffing and TP.CM frames not counted) */
+#define J1939_BITRATE 250000
+#define J1939_TP_DT_PAYLOAD 7
+#define CAN_EXT_FRAME_BITS 131
+
 
 uint8_t AES256CBC_KEY[AES256]={0};
+uint8_t AES256CBC_EXPKEY[AES_EXPKEY_MAXSIZE]={0};	// expanded once, reused for every image of the run.
 uint8_t IV[AES_BLOCKSIZE]={0};
-uint8_t HMAC_KEY[HMAC_KEY_MAXLEN]={0};	// nullifying bytes will help using this array with string.h routines since this will behave like C string (null-terminated string)
-uint8_t HMAC_CODE[20]={0};
+int RANDOM_IV=0;					// no IV file given, every image gets its own IV from the OS CSPRNG.
+uint8_t HMAC_KEY[HMAC_KEY_MAXLEN]={0};
+uint32_t HMAC_KEY_LEN=0;
+struct hmac_sha1 HMAC_CTX;				// keyed once, copied for every image of the run.
+uint64_t TARGET_NAME=0;					// J1939 NAME recorded in the container header, 0 for any ECU.
+uint32_t CHUNK_SIZE=FWIMG_DEFAULT_CHUNK_SIZE;
+int COMPRESS=0;						// LZSS compression before encryption.
+uint8_t* BASE=NULL;					// installed firmware the images are diffed against, NULL for full images.
+uint32_t BASE_SIZE=0;
+struct keystore KEYSTORE;				// per ECU key sets, used instead of the run keys when KEYSTORE.map is not NULL.
+struct keystore_deriver DERIVER;			// per ECU keys derived from a master secret, used when DERIVE is set.
+int DERIVE=0;
+uint8_t MASTER_KEY[KEYSTORE_MASTER_MAXLEN]={0};
+atomic_uint KEY_HITS;					// per ECU key sets found in the workers' caches / looked up or derived.
+atomic_uint KEY_MISSES;
 
-uint8_t path[MAX_PATH_LEN]={0};
+#define KEY_CACHE_SIZE 256				// expanded per ECU key sets kept by each worker.
 
+/* One image of a batch run, status and timing are filled by the worker which processed it. */
+struct image_job {
+	char* file;
+	char* iv_file;						// per-image IV, NULL to use the run IV.
+	uint64_t name;						// J1939 NAME of the target ECU.
+	int status;
+	long size;
+	long secured_size;
+	double elapsed;
+};
 
-void main(int argc, char** argv){ // Encrypts only one file at a time.
-	// getting AES256-CBC key.
-	printf("Pass your AES256-CBC key path (maximum path length : 200 bytes) : ");
-	scanf("%200s",path);
-	FILE* fptr_aes=fopen(path,"rb");
-	if(fptr_aes==NULL){
-		printf("Error : Unable to find the specified file %s\n",path);
-		return;
-	}	
-	if((fread(AES256CBC_KEY,sizeof(uint8_t),AES256,fptr_aes))!=AES256){
-		printf("Error : Unable to read the specified file %s\n",path);
-		return;
+/* Work queue shared by the workers, each one claims the next unprocessed image. */
+struct job_queue {
+	struct image_job* jobs;
+	size_t count;
+	atomic_size_t next;
+};
+
+
+/* Reads a key file of min_len to max_len bytes into buf, returns the read length or -1 on error. */
+static long load_key_file(const char* file, uint8_t* buf, long min_len, long max_len){
+	FILE* fptr=fopen(file,"rb");
+	if(fptr==NULL){
+		printf("Error : Unable to find the specified file %s\n",file);
+		return -1;
+	}
+	fseek(fptr,0,SEEK_END);
+	long size=ftell(fptr);
+	rewind(fptr);
+	if(size<min_len || size>max_len || fread(buf,sizeof(uint8_t),size,fptr)!=(size_t)size){
+		printf("Error : Unable to read the specified file %s\n",file);
+		fclose(fptr);
+		return -1;
 	}
-	fclose(fptr_aes);
-	memset(path,0,MAX_PATH_LEN);
+	fclose(fptr);
+	return size;
+}
 
+/* Loads the run IV, a NULL path (or "-") selects a random IV per image. */
+static int load_iv(const char* iv_path){
+	RANDOM_IV=(iv_path==NULL || strcmp(iv_path,"-")==0);
+	if(RANDOM_IV){
+		return 0;
+	}
+	return load_key_file(iv_path,IV,AES_BLOCKSIZE,AES_BLOCKSIZE)<0 ? -1 : 0;
+}
 
-	// getting IV
-	printf("Pass your IV path (maximum path length : 200 bytes) : ");
-	scanf("%200s",path);
-	FILE* fptr_iv=fopen(path,"rb");
-	if(fptr_iv==NULL){
-		printf("Error : Unable to find the specified file %s\n",path);
-		return;
+/* Loads the key files and prepares the expanded AES key and keyed HMAC context for the whole run. */
+static int load_keys(const char* aes_path, const char* iv_path, const char* hmac_path){
+	if(load_key_file(aes_path,AES256CBC_KEY,AES256,AES256)<0){
+		return -1;
 	}
-	if((fread(IV,sizeof(uint8_t),AES_BLOCKSIZE,fptr_iv))!=AES_BLOCKSIZE){
-		printf("Error : Unable to read the specified file %s\n",path);
-		return;
+	if(load_iv(iv_path)<0){
+		return -1;
 	}
-	fclose(fptr_iv);
-	memset(path,0,MAX_PATH_LEN);
+	long hmac_size=load_key_file(hmac_path,HMAC_KEY,1,HMAC_KEY_MAXLEN);
+	if(hmac_size<0){
+		return -1;
+	}
+	HMAC_KEY_LEN=(uint32_t)hmac_size;
 
+	AES_ExpandKey(AES256,AES256CBC_KEY,AES256CBC_EXPKEY);
+	hmac_sha1_init(&HMAC_CTX,HMAC_KEY,HMAC_KEY_LEN);
+	return 0;
+}
 
-	//getting HMAC key
-	printf("Pass your HMAC key path (maximum path length : 200 bytes) : ");
-	scanf("%200s",path);
-	FILE* fptr_hmac=fopen(path,"rb");
-	if(fptr_hmac==NULL){
-		printf("Error : Unable to find the specified file %s\n",path);
-		return;
+/* Loads the installed firmware the images of the run are diffed against. */
+static int load_base(const char* file){
+	FILE* fptr=fopen(file,"rb");
+	if(fptr==NULL){
+		printf("Error : Unable to find the specified file %s\n",file);
+		return -1;
 	}
-	fseek(fptr_hmac,0,SEEK_END);
-	long hmac_size=ftell(fptr_hmac);
-	rewind(fptr_hmac);
-	if(fread(HMAC_CODE,sizeof(uint8_t),hmac_size,fptr_hmac)!=hmac_size){
-		printf("Error : Unable to read the specified file %s\n",path);
-		return;
+	fseek(fptr,0,SEEK_END);
+	long size=ftell(fptr);
+	rewind(fptr);
+	BASE=(size<0 || size>FWIMG_MAX_PLAIN_SIZE) ? NULL : (uint8_t*)malloc(size>0 ? size : 1);
+	if(BASE==NULL || fread(BASE,sizeof(uint8_t),size,fptr)!=(size_t)size){
+		printf("Error : Unable to read the specified file %s\n",file);
+		free(BASE);
+		BASE=NULL;
+		fclose(fptr);
+		return -1;
 	}
-	fclose(fptr_hmac);
+	fclose(fptr);
+	BASE_SIZE=(uint32_t)size;
+	return 0;
+}
+
+/* Gives a signer its own copy of the run keys prepared by load_keys(), a private copy keeps the hot tables in that core's cache. */
+static void signer_init(struct keystore_schedule* signer){
+	memcpy(signer->ExpKey,AES256CBC_EXPKEY,sizeof(signer->ExpKey));
+	signer->hmac=HMAC_CTX;
+}
+
+/* Returns the expanded key set of the ECU named name, from the worker's cache or else looked up in the keystore
+ * or derived from the master secret, NULL if the keystore holds no key set for it. */
+static const struct keystore_schedule* signer_lookup(struct keystore_cache* cache, uint64_t name){
+	int hit;
+	struct keystore_schedule* signer=keystore_cache_get(cache,KEYSTORE_NAME_KEY(name),&hit);
+	if(hit){
+		atomic_fetch_add(&KEY_HITS,1);
+		return signer;
+	}
+	atomic_fetch_add(&KEY_MISSES,1);
+
+	struct keystore_keys keys;
+	uint32_t identity=KEYSTORE_NAME_IDENTITY(name);
+	if(DERIVE){
+		keystore_derive(&DERIVER,identity,KEYSTORE_NAME_MANUFACTURER(name),&keys);
+	}else{
+		int status=keystore_lookup(&KEYSTORE,identity,&keys);
+		if(status!=keystoreSuccess){
+			printf("Error : No key set for identity number %u in the keystore (status %d)\n",identity,status);
+			keystore_cache_drop(cache,KEYSTORE_NAME_KEY(name));
+			return NULL;
+		}
+	}
+	keystore_schedule_init(signer,&keys);
+	memset(&keys,0,sizeof(keys));
+	return signer;
+}
+
+/* Builds the output file name by prefixing the file name (not the directory part) with "secured_". */
+static char* secured_name(const char* file){
+	const char* base=strrchr(file,'/');
+	size_t dir_len=(base==NULL) ? 0 : (size_t)(base-file)+1;
+	char* rename=(char*)malloc(strlen(file)+FILE_RENAME_SECURED+1); // +1 for null terminator.
+	if(rename==NULL){
+		return NULL;
+	}
+	memcpy(rename,file,dir_len);
+	memcpy(rename+dir_len,FILE_RENAME_SECURED_STR,FILE_RENAME_SECURED);
+	strcpy(rename+dir_len+FILE_RENAME_SECURED,file+dir_len);
+	return rename;
+}
 
+/* Seconds needed to send size bytes over the bus with the transport protocol. */
+static double bus_time(long size){
+	return (double)((size+J1939_TP_DT_PAYLOAD-1)/J1939_TP_DT_PAYLOAD)*CAN_EXT_FRAME_BITS/J1939_BITRATE;
+}
+
+static double now_sec(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (double)ts.tv_sec+(double)ts.tv_nsec/1e9;
+}
 
-	
-	FILE* fptr_bin=fopen(argv[1],"rb");
+/* Encrypts and signs one firmware file for the ECU named name with the signer's keys and the given IV into a secured firmware container
+ * (see firmware_image.h), returns 0 on success. firmware_size and secured_size receive the input and container sizes. */
+static int secure_firmware(const struct keystore_schedule* signer, const char* file, const uint8_t* iv, uint64_t name, int verbose, long* firmware_size, long* secured_size){
+	FILE* fptr_bin=fopen(file,"rb");
 	if(fptr_bin==NULL){
-		printf("Error : Unable to open %s file.\n",argv[1]);
-		return;
+		printf("Error : Unable to open %s file.\n",file);
+		return -1;
 	}
 	// getting file size.
 	fseek(fptr_bin,0,SEEK_END);
 	long size=ftell(fptr_bin);
-	long firmware_size=size;
+	*firmware_size=size;
 	rewind(fptr_bin);
-	printf("Firmware size : %ld\n",size);
-
-	/* Size of the data to be encrypted is known, now need to calculate the padding byte count and then adding space for IV */
-	if((size%AES_BLOCKSIZE)==0){
-		/* padding = 16 bytes */
-		printf("Padding size : %d\n",AES_BLOCKSIZE);
-		size+=(2*AES_BLOCKSIZE);
-	}else{
-		printf("Padding size : %ld\n",AES_BLOCKSIZE-(size%AES_BLOCKSIZE));
-		size+=((2*AES_BLOCKSIZE)-(size%AES_BLOCKSIZE));
+	if(verbose){
+		printf("Firmware size : %ld\n",size);
+	}
+	if(size<0 || size>FWIMG_MAX_PLAIN_SIZE){
+		printf("Error : %s is too large for a secured firmware container\n",file);
+		fclose(fptr_bin);
+		return -1;
 	}
 
-	// Allocating memory for storing firmware file.
-	uint8_t* ptr=(uint8_t*)malloc(sizeof(uint8_t)*size);
-	printf("Reading firmware file...\n");
-	if(fread(ptr, sizeof(uint8_t), firmware_size,fptr_bin)!=firmware_size){
-		printf("Error : Unable to read from %s file\n",argv[1]);
-		return;
+	// Reading the firmware, it is diffed and compressed first when asked to since cipher text does not compress.
+	uint8_t* firmware=(uint8_t*)malloc(size>0 ? size : 1);
+	if(firmware==NULL){
+		printf("Error : Unable to allocate %ld bytes for %s\n",size,file);
+		fclose(fptr_bin);
+		return -1;
+	}
+	if(verbose){
+		printf("Reading firmware file...\n");
+	}
+	if(fread(firmware, sizeof(uint8_t), size,fptr_bin)!=(size_t)size){
+		printf("Error : Unable to read from %s file\n",file);
+		fclose(fptr_bin);
+		free(firmware);
+		return -1;
 	}
 	fclose(fptr_bin);
-	printf("Read completed, Encrypting the file...\n");
-	uint32_t encrypted_firmware_size=0;
-	AES_Encrypt(AES256,ptr,(uint32_t)firmware_size,AES256CBC_KEY,&encrypted_firmware_size,IV);
-	printf("Encryption completed !\nEncrypted firmware size : %d\n",encrypted_firmware_size);
-	/* Encrypted data with padding bytes and IV appended are in array pointed by "ptr" */
-
-	/* File rename handling. */
-	uint8_t* rename=(uint8_t*)malloc(sizeof(uint8_t)*(strlen(argv[1])+FILE_RENAME_SECURED+1)); // +1 for null terminator.
-	memcpy(rename,FILE_RENAME_SECURED_STR,FILE_RENAME_SECURED);
-	memcpy(rename+FILE_RENAME_SECURED,argv[1],strlen(argv[1]));
-	rename[FILE_RENAME_SECURED+strlen(argv[1])]='\0';
-
-	/* opening a file to write the encrypted data  */
-	FILE* fptr_encr=fopen(rename,"wb");
+
+	/* An incremental release ships the patch against the installed firmware instead of the firmware itself */
+	uint32_t decoded_size=(uint32_t)size;
+	uint8_t kind=FWIMG_PAYLOAD_IMAGE;
+	if(BASE!=NULL){
+		uint8_t* patch=(uint8_t*)malloc(fwdelta_bound(decoded_size));
+		uint32_t patch_size=(patch==NULL) ? 0 : fwdelta_generate(BASE,BASE_SIZE,firmware,decoded_size,patch);
+		if(patch_size==0 || patch_size>FWIMG_MAX_PLAIN_SIZE){
+			printf("Error : Unable to build the patch of %s\n",file);
+			free(patch);
+			free(firmware);
+			return -1;
+		}
+		if(verbose){
+			printf("Patch size : %u (%.1f%%)\n",patch_size,size>0 ? 100.0*patch_size/size : 0.0);
+		}
+		free(firmware);
+		firmware=patch;
+		decoded_size=patch_size;
+		kind=FWIMG_PAYLOAD_DELTA;
+	}
+
+	uint8_t* payload=firmware;
+	uint32_t payload_size=decoded_size;
+	uint8_t codec=FWIMG_CODEC_NONE;
+	if(COMPRESS){
+		uint8_t* packed=(uint8_t*)malloc(lzss_bound(decoded_size)+1);
+		if(packed==NULL){
+			printf("Error : Unable to allocate compression buffer for %s\n",file);
+			free(firmware);
+			return -1;
+		}
+		uint32_t packed_size=lzss_compress(firmware,decoded_size,packed);
+		if(verbose){
+			printf("Compressed size : %u (%.1f%%)\n",packed_size,decoded_size>0 ? 100.0*packed_size/decoded_size : 0.0);
+		}
+		if(packed_size<decoded_size){
+			payload=packed;
+			payload_size=packed_size;
+			codec=FWIMG_CODEC_LZSS;
+		}else{
+			free(packed);	/* incompressible image, stored as is */
+		}
+	}
+
+	/* The header is sized from the padded length, padding is PKCS#7 so a full block is added when size is already aligned */
+	struct fwimg_header header;
+	fwimg_header_init(&header,payload_size,CHUNK_SIZE,name,iv);
+	header.codec_id=codec;
+	header.image_size=decoded_size;
+	header.payload_kind=kind;
+	uint32_t padding=header.padded_size-header.plain_size;
+	if(verbose){
+		printf("Padding size : %u\nChunks : %u of %u bytes\n",padding,header.chunk_count,header.chunk_size);
+	}
+	long total=(long)header.header_size+header.padded_size+FWIMG_TAG_SIZE;
+	*secured_size=total;
+
+	// Allocating memory for the whole container, the payload goes straight behind the header.
+	uint8_t* ptr=(uint8_t*)malloc(sizeof(uint8_t)*total);
+	if(ptr==NULL){
+		printf("Error : Unable to allocate %ld bytes for %s\n",total,file);
+		if(payload!=firmware){
+			free(payload);
+		}
+		free(firmware);
+		return -1;
+	}
+	uint8_t* data=ptr+header.header_size;
+	memcpy(data,payload,payload_size);
+	if(payload!=firmware){
+		free(payload);
+	}
+	free(firmware);
+	memset(data+header.plain_size,(int)padding,padding);
+	if(verbose){
+		printf("Read completed, Encrypting the file...\n");
+	}
+
+	/* Each chunk is encrypted and tagged while it is still in cache, the CBC chain runs across chunk boundaries */
+	fwimg_write_header(&header,ptr);
+	uint8_t chain[AES_BLOCKSIZE];
+	memcpy(chain,iv,AES_BLOCKSIZE);
+	for(uint32_t i=0;i<header.chunk_count;i++){
+		struct fwimg_chunk chunk;
+		uint32_t offset=i*header.chunk_size;
+		chunk.offset=header.header_size+offset;
+		chunk.size=(header.padded_size-offset<header.chunk_size) ? header.padded_size-offset : header.chunk_size;
+		AES_Encrypt_Chunk(AES256,data+offset,chunk.size,signer->ExpKey,chain);
+		fwimg_chunk_tag(&signer->hmac,i,data+offset,chunk.size,chunk.tag);
+		fwimg_write_chunk(ptr,i,&chunk);
+	}
+	fwimg_header_tag(&signer->hmac,ptr,header.header_size,ptr+header.header_size-FWIMG_TAG_SIZE);
+	if(verbose){
+		printf("Encryption completed !\nEncrypted firmware size : %u\n",header.padded_size);
+		printf("Computing HMAC code...\n");
+	}
+	struct hmac_sha1 hmac=signer->hmac;
+	hmac_sha1_input(&hmac, ptr, (uint32_t)(total-FWIMG_TAG_SIZE));
+	hmac_sha1_result(&hmac, ptr+total-FWIMG_TAG_SIZE);
+
+	/* opening a file to write the secured container */
+	char* rename=secured_name(file);
+	FILE* fptr_encr=(rename==NULL) ? NULL : fopen(rename,"wb");
 	if(fptr_encr==NULL){
-		printf("Error : Unable to create new file %s\n",rename);
-		return;
+		printf("Error : Unable to create new file %s\n",rename==NULL ? file : rename);
+		free(rename);
+		free(ptr);
+		return -1;
 	}
 
-	if(fwrite(ptr,sizeof(uint8_t),size,fptr_encr)!=size){
-		printf("Error : Unable to write to %s\n",rename);
-		return;
+	int status=0;
+	if(fwrite(ptr,sizeof(uint8_t),total,fptr_encr)!=(size_t)total){
+		printf("Error : Unable to write to %s file\n",rename);
+		status=-1;
 	}
-	
-	printf("Computing HMAC code...\n");
-	hmac_sha1(HMAC_KEY, (uint32_t)strlen(HMAC_KEY), ptr, size, HMAC_CODE);
-	if(fwrite(HMAC_CODE, sizeof(uint8_t), HMAC_SHA1_DIGEST_SIZE, fptr_encr)!=HMAC_SHA1_DIGEST_SIZE){
+	if(fclose(fptr_encr)!=0 && status==0){
 		printf("Error : Unable to write to %s file\n",rename);
-		return;
+		status=-1;
+	}
+	if(verbose && status==0){
+		printf("File secured.\nBus time at %d kbit/s : %.2f s (%.2f s for the raw firmware)\n",J1939_BITRATE/1000,bus_time(total),bus_time(size));
 	}
-	printf("File secured.\n");
-	fclose(fptr_encr);
 	free(rename);
 	free(ptr);
+	return status;
+}
+
+/* Appends an image to the job list, iv_file may be NULL. */
+static int add_job(struct image_job** jobs, size_t* count, const char* file, const char* iv_file, uint64_t name){
+	struct image_job* grown=(struct image_job*)realloc(*jobs,sizeof(struct image_job)*(*count+1));
+	if(grown==NULL){
+		return -1;
+	}
+	*jobs=grown;
+	memset(&grown[*count],0,sizeof(struct image_job));
+	grown[*count].file=strdup(file);
+	grown[*count].iv_file=(iv_file==NULL) ? NULL : strdup(iv_file);
+	grown[*count].name=name;
+	grown[*count].status=-1;			// until a worker processes it.
+	if(grown[*count].file==NULL || (iv_file!=NULL && grown[*count].iv_file==NULL)){
+		free(grown[*count].file);
+		free(grown[*count].iv_file);
+		return -1;
+	}
+	(*count)++;
+	return 0;
+}
+
+/* Appends every non empty, non comment ('#') line of the manifest to the job list.
+ * A line holds the firmware path, optionally followed by a TAB and the path of that image's IV file (may be empty),
+ * optionally followed by a TAB and the NAME of that image's target ECU. */
+static int read_manifest(const char* manifest, struct image_job** jobs, size_t* count){
+	FILE* fptr=fopen(manifest,"r");
+	if(fptr==NULL){
+		printf("Error : Unable to open manifest %s\n",manifest);
+		return -1;
+	}
+	char line[2*MAX_PATH_LEN+3];
+	while(fgets(line,sizeof(line),fptr)!=NULL){
+		line[strcspn(line,"\r\n")]='\0';
+		if(line[0]=='\0' || line[0]=='#'){
+			continue;
+		}
+		char* iv_file=strchr(line,'\t');
+		uint64_t name=TARGET_NAME;
+		if(iv_file!=NULL){
+			*iv_file++='\0';
+			char* name_field=strchr(iv_file,'\t');
+			if(name_field!=NULL){
+				*name_field++='\0';
+				name=strtoull(name_field,NULL,0);
+			}
+			if(iv_file[0]=='\0'){
+				iv_file=NULL;
+			}
+		}
+		if(add_job(jobs,count,line,iv_file,name)<0){
+			printf("Error : Out of memory while reading manifest %s\n",manifest);
+			fclose(fptr);
+			return -1;
+		}
+	}
+	fclose(fptr);
+	return 0;
+}
+
+static void usage(const char* prog){
+	printf("Usage : %s <firmware.bin>\n",prog);
+	printf("        %s -k <AES256-CBC key> [-i <IV>] -m <HMAC key> [-l <manifest>] [-j <threads>] [-n <NAME>] [-c <chunk size>] [-z] [-b <installed firmware>] [firmware.bin ...]\n",prog);
+	printf("        %s -s <keystore> | -d <master secret> [-i <IV>] [-l <manifest>] [-j <threads>] [-n <NAME>] [-c <chunk size>] [-z] [-b <installed firmware>] [firmware.bin ...]\n",prog);
+	printf("  -k, -i, -m  key file paths, keys are loaded and expanded once for the whole run.\n");
+	printf("              without -i every image is encrypted with its own random IV (getrandom), stored in its header,\n");
+	printf("              -i is refused when more than one image would use it.\n");
+	printf("  -s          keystore written by keygen, each image uses the key set of its target ECU identity number.\n");
+	printf("  -d          master secret written by keygen -m, each image uses keys derived (HKDF) from it and its target ECU NAME.\n");
+	printf("  -l          text file listing one firmware path per line ('#' starts a comment),\n");
+	printf("              a TAB and an IV file path after the firmware path overrides -i for that image,\n");
+	printf("              a second TAB and a NAME overrides -n for that image.\n");
+	printf("  -j          worker threads, defaults to the number of online cores.\n");
+	printf("  -n          64 bit J1939 NAME of the target ECU recorded in the header, defaults to 0 (any ECU).\n");
+	printf("  -c          chunk size in bytes, a multiple of 16, defaults to %d.\n",FWIMG_DEFAULT_CHUNK_SIZE);
+	printf("  -z          compresses the firmware (LZSS) before encryption, images which do not shrink are stored as is.\n");
+	printf("  -b          builds delta updates, each image is stored as a patch against this installed firmware.\n");
+}
+
+/* Worker thread : copies the run keys once (or sets up its per ECU key cache), then claims images from the queue until it is empty. */
+static void* sign_worker(void* arg){
+	struct job_queue* queue=(struct job_queue*)arg;
+	struct keystore_schedule run_signer;
+	struct keystore_cache cache;
+	int per_ecu=(KEYSTORE.map!=NULL || DERIVE);
+	signer_init(&run_signer);
+	if(per_ecu && keystore_cache_init(&cache,KEY_CACHE_SIZE)<0){
+		printf("Error : Unable to allocate the key cache\n");
+		return NULL;	/* the images left are taken by the other workers or reported as not processed */
+	}
+
+	size_t i;
+	while((i=atomic_fetch_add(&queue->next,1))<queue->count){
+		struct image_job* job=&queue->jobs[i];
+		uint8_t iv[AES_BLOCKSIZE];
+		double start=now_sec();
+		const struct keystore_schedule* signer=per_ecu ? signer_lookup(&cache,job->name) : &run_signer;
+		if(signer==NULL){
+			job->status=-1;
+			continue;
+		}
+		/* A fresh IV costs one getrandom() call, no file is read or written for it */
+		if(job->iv_file!=NULL){
+			if(load_key_file(job->iv_file,iv,AES_BLOCKSIZE,AES_BLOCKSIZE)<0){
+				job->status=-1;
+				continue;
+			}
+		}else if(RANDOM_IV){
+			if(keystore_random(iv,AES_BLOCKSIZE)<0){
+				printf("Error : Unable to draw an IV for %s\n",job->file);
+				job->status=-1;
+				continue;
+			}
+		}else{
+			memcpy(iv,IV,AES_BLOCKSIZE);
+		}
+		job->status=secure_firmware(signer,job->file,iv,job->name,0,&job->size,&job->secured_size);
+		job->elapsed=now_sec()-start;
+	}
+	if(per_ecu){
+		keystore_cache_free(&cache);
+	}
+	memset(&run_signer,0,sizeof(run_signer));
+	return NULL;
+}
+
+/* Batch mode : no prompts, the listed images are secured with the same keys by a pool of worker threads,
+ * throughput is reported per image (in input order) and for the whole run. */
+static int batch_main(int argc, char** argv){
+	const char* aes_path=NULL;
+	const char* iv_path=NULL;
+	const char* hmac_path=NULL;
+	struct image_job* jobs=NULL;
+	size_t count=0;
+	long threads=sysconf(_SC_NPROCESSORS_ONLN);
+	long chunk_size=FWIMG_DEFAULT_CHUNK_SIZE;
+	const char* base_path=NULL;
+	const char* keystore_path=NULL;
+	const char* master_path=NULL;
+	const char* manifest_path=NULL;
+	int opt;
+
+	while((opt=getopt(argc,argv,"k:i:m:s:d:l:j:n:c:zb:"))!=-1){
+		switch(opt){
+		case 'k':
+			aes_path=optarg;
+			break;
+		case 'i':
+			iv_path=optarg;
+			break;
+		case 'm':
+			hmac_path=optarg;
+			break;
+		case 's':
+			keystore_path=optarg;
+			break;
+		case 'd':
+			master_path=optarg;
+			break;
+		case 'l':
+			manifest_path=optarg;
+			break;
+		case 'j':
+			threads=strtol(optarg,NULL,10);
+			break;
+		case 'n':
+			TARGET_NAME=strtoull(optarg,NULL,0);
+			break;
+		case 'c':
+			chunk_size=strtol(optarg,NULL,0);
+			break;
+		case 'z':
+			COMPRESS=1;
+			break;
+		case 'b':
+			base_path=optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	/* The manifest is read once every option is known, its lines default to the -n NAME */
+	if(manifest_path!=NULL && read_manifest(manifest_path,&jobs,&count)<0){
+		return 1;
+	}
+	for(int i=optind;i<argc;i++){
+		if(add_job(&jobs,&count,argv[i],NULL,TARGET_NAME)<0){
+			printf("Error : Out of memory\n");
+			return 1;
+		}
+	}
+	/* The -i IV goes to every image without an IV of its own, CBC must never see the same IV twice */
+	size_t run_iv_images=0;
+	for(size_t i=0;i<count;i++){
+		run_iv_images+=(jobs[i].iv_file==NULL);
+	}
+	if(iv_path!=NULL && strcmp(iv_path,"-")!=0 && run_iv_images>1){
+		printf("Error : -i would encrypt %zu images with the same IV, leave -i out for a random IV per image or give each image its IV in the manifest\n",run_iv_images);
+		return 1;
+	}
+	int key_sources=(keystore_path!=NULL)+(master_path!=NULL)+(aes_path!=NULL || hmac_path!=NULL);
+	int have_keys=(key_sources==1) && (aes_path==NULL)==(hmac_path==NULL);
+	if(!have_keys || count==0 || threads<1 || chunk_size<AES_BLOCKSIZE || chunk_size%AES_BLOCKSIZE!=0 || chunk_size>0x1000000){
+		usage(argv[0]);
+		return 1;
+	}
+	CHUNK_SIZE=(uint32_t)chunk_size;
+	if(keystore_path!=NULL){
+		int status=keystore_open(&KEYSTORE,keystore_path);
+		if(status!=keystoreSuccess){
+			printf("Error : Unable to open keystore %s (status %d)\n",keystore_path,status);
+			return 1;
+		}
+		if(load_iv(iv_path)<0){
+			return 1;
+		}
+	}else if(master_path!=NULL){
+		long master_size=load_key_file(master_path,MASTER_KEY,AES_BLOCKSIZE,KEYSTORE_MASTER_MAXLEN);
+		if(master_size<0 || load_iv(iv_path)<0){
+			return 1;
+		}
+		keystore_deriver_init(&DERIVER,MASTER_KEY,(uint32_t)master_size);
+		memset(MASTER_KEY,0,sizeof(MASTER_KEY));
+		DERIVE=1;
+	}else if(load_keys(aes_path,iv_path,hmac_path)<0){
+		return 1;
+	}
+	if(base_path!=NULL && load_base(base_path)<0){
+		return 1;
+	}
+	if((size_t)threads>count){
+		threads=(long)count;
+	}
+
+	struct job_queue queue={ jobs, count, 0 };
+	pthread_t* workers=(pthread_t*)malloc(sizeof(pthread_t)*threads);
+	if(workers==NULL){
+		printf("Error : Out of memory\n");
+		return 1;
+	}
+	double run_start=now_sec();
+	long started=0;
+	for(;started<threads;started++){
+		if(pthread_create(&workers[started],NULL,sign_worker,&queue)!=0){
+			break;
+		}
+	}
+	if(started==0){
+		sign_worker(&queue);	/* no thread could be created, sign on the calling thread */
+	}
+	for(long t=0;t<started;t++){
+		pthread_join(workers[t],NULL);
+	}
+	double run_elapsed=now_sec()-run_start;
+	free(workers);
+
+	size_t failed=0;
+	long long total_bytes=0;
+	double total_bus=0.0;
+	double total_bus_raw=0.0;
+	for(size_t i=0;i<count;i++){
+		if(jobs[i].status<0){
+			failed++;
+		}else{
+			total_bytes+=jobs[i].size;
+			total_bus+=bus_time(jobs[i].secured_size);
+			total_bus_raw+=bus_time(jobs[i].size);
+			printf("%s : %ld bytes, %.3f ms, %.2f MB/s, secured %ld bytes, bus time %.2f s\n",jobs[i].file,jobs[i].size,jobs[i].elapsed*1e3,
+				jobs[i].elapsed>0 ? jobs[i].size/jobs[i].elapsed/1e6 : 0.0,jobs[i].secured_size,bus_time(jobs[i].secured_size));
+		}
+		free(jobs[i].file);
+		free(jobs[i].iv_file);
+	}
+	free(jobs);
+	free(BASE);
+	printf("Secured %zu of %zu images with %ld threads, %lld bytes in %.3f s, %.2f MB/s, %.1f images/s\n",count-failed,count,started==0 ? 1 : started,total_bytes,run_elapsed,
+		run_elapsed>0 ? total_bytes/run_elapsed/1e6 : 0.0,run_elapsed>0 ? (count-failed)/run_elapsed : 0.0);
+	printf("Bus time at %d kbit/s : %.2f s (%.2f s for the raw firmware)\n",J1939_BITRATE/1000,total_bus,total_bus_raw);
+	if(KEYSTORE.map!=NULL || DERIVE){
+		printf("Per ECU key sets : %u %s, %u taken from the key cache\n",atomic_load(&KEY_MISSES),DERIVE ? "derived" : "looked up",atomic_load(&KEY_HITS));
+	}
+	keystore_close(&KEYSTORE);
+	return failed==0 ? 0 : 1;
+}
+
+int main(int argc, char** argv){
+	if(argc>2 || (argc==2 && argv[1][0]=='-')){
+		return batch_main(argc,argv);
+	}
+	if(argc!=2){
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Interactive mode, encrypts only one file at a time.
+	char aes_path[MAX_PATH_LEN+1]={0};			// +1 for null terminator written by scanf.
+	char iv_path[MAX_PATH_LEN+1]={0};
+	char hmac_path[MAX_PATH_LEN+1]={0};
+
+	// getting AES256-CBC key.
+	printf("Pass your AES256-CBC key path (maximum path length : 200 bytes) : ");
+	scanf("%200s",aes_path);
+
+	// getting IV
+	printf("Pass your IV path, - for a random IV (maximum path length : 200 bytes) : ");
+	scanf("%200s",iv_path);
+
+	//getting HMAC key
+	printf("Pass your HMAC key path (maximum path length : 200 bytes) : ");
+	scanf("%200s",hmac_path);
+
+	if(load_keys(aes_path,iv_path,hmac_path)<0){
+		return 1;
+	}
+
+	struct keystore_schedule signer;
+	signer_init(&signer);
+	if(RANDOM_IV && keystore_random(IV,AES_BLOCKSIZE)<0){
+		printf("Error : Unable to draw an IV\n");
+		return 1;
+	}
+	long firmware_size=0;
+	long secured_size=0;
+	return secure_firmware(&signer,argv[1],IV,TARGET_NAME,1,&firmware_size,&secured_size)<0 ? 1 : 0;
 }
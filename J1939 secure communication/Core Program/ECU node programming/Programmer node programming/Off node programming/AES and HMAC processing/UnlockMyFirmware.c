@@ -6,6 +6,9 @@
 #include "aes.h"
 #include "sha1.h"
 #include "hmac.h"
+#include "firmware_image.h"
+#include "lzss.h"
+#include "fwdelta.h"
 
 #define HMAC_KEY_MAXLEN 0x100
 #define FILE_RENAME_UNLOCKED 0x09
@@ -14,24 +17,93 @@
 
 
 uint8_t AES256CBC_KEY[AES256]={0};
-uint8_t HMAC_KEY[HMAC_KEY_MAXLEN]={0};	// nullifying bytes will help using this array with string.h routines since this will behave like C string (null-terminated string)
+uint8_t HMAC_KEY[HMAC_KEY_MAXLEN]={0};
 uint8_t HMAC_CODE[HMAC_SHA1_DIGEST_SIZE]={0};
 
-uint8_t path[MAX_PATH_LEN]={0};
+uint8_t path[MAX_PATH_LEN+1]={0};	// +1 for null terminator written by scanf.
 
+/* Consumer of the decoded payload, never takes more than the size announced in the header.
+ * A complete image goes to the output file, a patch goes to the patch routine which writes the output file. */
+struct payload_sink {
+	FILE* fptr;
+	struct fwdelta_patch* patch;	// NULL for a complete image.
+	int patch_status;
+	uint32_t written;
+	uint32_t limit;
+};
+
+static int file_sink(void* ctx, const uint8_t* data, uint32_t size){
+	return fwrite(data, sizeof(uint8_t), size, (FILE*)ctx)==size ? 0 : -1;
+}
+
+static int write_sink(void* ctx, const uint8_t* data, uint32_t size){
+	struct payload_sink* out=(struct payload_sink*)ctx;
+	if(size>out->limit-out->written){
+		return -1;
+	}
+	if(out->patch!=NULL){
+		out->patch_status=fwdelta_apply(out->patch, data, size);
+		if(out->patch_status!=fwdeltaSuccess){
+			return -1;
+		}
+	}else if(file_sink(out->fptr, data, size)!=0){
+		return -1;
+	}
+	out->written+=size;
+	return 0;
+}
+
+/* Reads the installed firmware a patch applies to. */
+static int base_reader(void* ctx, uint32_t offset, uint8_t* buf, uint32_t size){
+	FILE* fptr=(FILE*)ctx;
+	return (fseek(fptr, offset, SEEK_SET)==0 && fread(buf, sizeof(uint8_t), size, fptr)==size) ? 0 : -1;
+}
+
+/* What main holds while it unlocks, NULL until taken. */
+struct unlock_files {
+	uint8_t* ptr;
+	char* rename;
+	FILE* fptr_encr;
+	FILE* fptr_unlock;
+	FILE* fptr_base;
+};
+
+/* Releases what main holds and returns its exit code. An output file that is still open is a half written one, it is removed. */
+static int finish(struct unlock_files* files, int status){
+	if(files->fptr_encr!=NULL){
+		fclose(files->fptr_encr);
+	}
+	if(files->fptr_base!=NULL){
+		fclose(files->fptr_base);
+	}
+	if(files->fptr_unlock!=NULL){
+		fclose(files->fptr_unlock);
+		remove(files->rename);
+	}
+	free(files->rename);
+	free(files->ptr);
+	return status;
+}
+
+int main(int argc, char** argv){ // Encrypts only one file at a time.
+	struct unlock_files files={ NULL, NULL, NULL, NULL, NULL };
+	if(argc<2){
+		printf("Usage : %s <secured firmware> [installed firmware, for a delta update]\n",argv[0]);
+		return 1;
+	}
 
-void main(int argc, char** argv){ // Encrypts only one file at a time.
 	// getting AES256-CBC key.
 	printf("Pass your AES256-CBC key path (maximum path length : 200 bytes) : ");
 	scanf("%200s",path);
-	FILE* fptr_aes=fopen(path,"rb");
+	FILE* fptr_aes=fopen((char*)path,"rb");
 	if(fptr_aes==NULL){
 		printf("Error : Unable to find the specified file %s\n",path);
-		return;
+		return 1;
 	}	
 	if((fread(AES256CBC_KEY,sizeof(uint8_t),AES256,fptr_aes))!=AES256){
 		printf("Error : Unable to read the specified file %s\n",path);
-		return;
+		fclose(fptr_aes);
+		return 1;
 	}
 	fclose(fptr_aes);
 	memset(path,0,MAX_PATH_LEN);
@@ -39,71 +111,157 @@ void main(int argc, char** argv){ // Encrypts only one file at a time.
 	//getting HMAC key
 	printf("Pass your HMAC key path (maximum path length : 200 bytes) : ");
 	scanf("%200s",path);
-	FILE* fptr_hmac=fopen(path,"rb");
+	FILE* fptr_hmac=fopen((char*)path,"rb");
 	if(fptr_hmac==NULL){
 		printf("Error : Unable to find the specified file %s\n",path);
-		return;
+		return 1;
 	}
 	fseek(fptr_hmac,0,SEEK_END);
 	long hmac_size=ftell(fptr_hmac);
 	rewind(fptr_hmac);
-	if(fread(HMAC_CODE,sizeof(uint8_t),hmac_size,fptr_hmac)!=hmac_size){
+	if(hmac_size<1 || hmac_size>HMAC_KEY_MAXLEN || fread(HMAC_KEY,sizeof(uint8_t),hmac_size,fptr_hmac)!=(size_t)hmac_size){
 		printf("Error : Unable to read the specified file %s\n",path);
-		return;
+		fclose(fptr_hmac);
+		return 1;
 	}
 	fclose(fptr_hmac);
 
 	// opening secured firmware file.
-	FILE* fptr_encr=fopen(argv[1],"rb");
-	if(fptr_encr==NULL){
+	files.fptr_encr=fopen(argv[1],"rb");
+	if(files.fptr_encr==NULL){
 		printf("Error : Unable to open the specified file %s\n",argv[1]);
-		return;
+		return 1;
 	}
 
-	fseek(fptr_encr,0,SEEK_END);
-	long file_size=ftell(fptr_encr);
-	rewind(fptr_encr);
+	fseek(files.fptr_encr,0,SEEK_END);
+	long file_size=ftell(files.fptr_encr);
+	rewind(files.fptr_encr);
 	printf("File size : %ld\n",file_size);
 	printf("Allocating memory for secured firmware file...\n");
-	uint8_t* ptr=(uint8_t*)malloc(sizeof(uint8_t)*file_size);
+	files.ptr=(file_size<1) ? NULL : (uint8_t*)malloc(sizeof(uint8_t)*file_size);
+	uint8_t* ptr=files.ptr;
 	printf("Allocated addr : %p\n",ptr);
-	if(fread(ptr,sizeof(uint8_t),file_size,fptr_encr)!=file_size){
+	if(ptr==NULL || fread(ptr,sizeof(uint8_t),file_size,files.fptr_encr)!=(size_t)file_size){
 		printf("Error : Unable to read the firmware file.\n");
-		return;
+		return finish(&files,1);
 	}	
+	fclose(files.fptr_encr);
+	files.fptr_encr=NULL;
 	
-	printf("Computing HMAC code...\n");
-	hmac_sha1(HMAC_KEY, (uint32_t)strlen(HMAC_KEY), ptr, file_size-HMAC_SHA1_DIGEST_SIZE, HMAC_CODE);
-	
+	printf("Parsing container header...\n");
+	struct fwimg_header header;
+	int status=(file_size<0 || file_size>UINT32_MAX) ? fwimgTruncated : fwimg_read_header(ptr,(uint32_t)file_size,&header);
+	if(status==fwimgSuccess && (uint64_t)file_size!=(uint64_t)header.header_size+header.padded_size+FWIMG_TAG_SIZE){
+		status=fwimgTruncated;
+	}
+	if(status!=fwimgSuccess){
+		printf("Error : %s is not a valid secured firmware container (status %d).\n",argv[1],status);
+		return finish(&files,1);
+	}
+	printf("Container version : %u, chunks : %u of %u bytes, target NAME : 0x%016llx\n",header.version,header.chunk_count,header.chunk_size,(unsigned long long)header.target_name);
+
+	struct hmac_sha1 hmac_key;
+	hmac_sha1_init(&hmac_key, HMAC_KEY, (uint32_t)hmac_size);
+
 	printf("Verifying firmware integrity...\n");
-	if(strncmp(HMAC_CODE, ptr+file_size-HMAC_SHA1_DIGEST_SIZE, HMAC_SHA1_DIGEST_SIZE)!=0){
+	fwimg_header_tag(&hmac_key, ptr, header.header_size, HMAC_CODE);
+	if(fwimg_tag_compare(HMAC_CODE, ptr+header.header_size-FWIMG_TAG_SIZE)!=0){
+		printf("Firmware header is tampered, integrity verification failed.\n");
+		return finish(&files,1);
+	}
+	struct hmac_sha1 hmac=hmac_key;
+	hmac_sha1_input(&hmac, ptr, (uint32_t)file_size-FWIMG_TAG_SIZE);
+	hmac_sha1_result(&hmac, HMAC_CODE);
+	if(fwimg_tag_compare(HMAC_CODE, ptr+file_size-FWIMG_TAG_SIZE)!=0){
 		printf("Firmware is tampered, integrity verification failed.\n");
+		return finish(&files,1);
 	}
 
-	printf("Decrypting...\n");
-	uint32_t decrypted_firmware_size=0;
-	AES_Decrypt(AES256, ptr, file_size-HMAC_SHA1_DIGEST_SIZE-AES_BLOCKSIZE, AES256CBC_KEY, &decrypted_firmware_size);
-	
-	printf("Decrypted firmware size : %d\n",decrypted_firmware_size);
-
 	// rename handling for the file.
 	char* rename=(char*)malloc(sizeof(char)*(strlen(argv[1])+FILE_RENAME_UNLOCKED+1));
+	if(rename==NULL){
+		printf("Error : Out of memory\n");
+		return finish(&files,1);
+	}
+	files.rename=rename;
 	memcpy(rename, FILE_RENAME_UNLOCKED_STR, FILE_RENAME_UNLOCKED);
 	memcpy(rename+FILE_RENAME_UNLOCKED, argv[1], strlen(argv[1]));
 	rename[FILE_RENAME_UNLOCKED+strlen(argv[1])]='\0';
 
-	FILE* fptr_unlock = fopen(rename,"wb");
-	if(fwrite(ptr, sizeof(uint8_t), decrypted_firmware_size, fptr_unlock)!=decrypted_firmware_size){
-		printf("Error : Unable to write to %s file.\n",rename);
-		return;
+	/* A delta update is applied on top of the installed firmware given as second argument */
+	static struct fwdelta_patch patch;
+	if(header.payload_kind==FWIMG_PAYLOAD_DELTA){
+		files.fptr_base=(argc>2) ? fopen(argv[2],"rb") : NULL;
+		if(files.fptr_base==NULL){
+			printf("Error : %s is a delta update, pass the installed firmware as second argument.\n",argv[1]);
+			return finish(&files,1);
+		}
 	}
 
+	FILE* fptr_unlock = fopen(rename,"wb");
+	if(fptr_unlock==NULL){
+		printf("Error : Unable to create new file %s\n",rename);
+		return finish(&files,1);
+	}
+	files.fptr_unlock=fptr_unlock;
+	FILE* fptr_base=files.fptr_base;
+	if(fptr_base!=NULL){
+		fwdelta_apply_init(&patch, base_reader, fptr_base, file_sink, fptr_unlock);
+	}
 
-	printf("firmware unlocked, file name : %s\n",rename);
-	free(rename);
-	fclose(fptr_unlock);
-	
-
+	/* Chunks are decrypted one at a time and the plain text goes straight to the decoder (or the file), as a receiver node would do */
+	printf("Decrypting...\n");
+	struct payload_sink out={ fptr_unlock, (fptr_base!=NULL) ? &patch : NULL, fwdeltaSuccess, 0, header.image_size };
+	static struct lzss_decoder decoder;
+	lzss_decoder_init(&decoder, write_sink, &out);
+	uint8_t ExpKey[AES_EXPKEY_MAXSIZE];
+	uint8_t chain[AES_BLOCKSIZE];
+	AES_ExpandKey(AES256, AES256CBC_KEY, ExpKey);
+	memcpy(chain, header.iv, AES_BLOCKSIZE);
+	for(uint32_t i=0;i<header.chunk_count;i++){
+		struct fwimg_chunk chunk;
+		uint32_t offset=i*header.chunk_size;
+		fwimg_read_chunk(ptr, i, &chunk);
+		if(chunk.offset!=header.header_size+offset || chunk.size!=((header.padded_size-offset<header.chunk_size) ? header.padded_size-offset : header.chunk_size)){
+			printf("Error : chunk %u does not match the container layout.\n",i);
+			return finish(&files,1);
+		}
+		fwimg_chunk_tag(&hmac_key, i, ptr+chunk.offset, chunk.size, HMAC_CODE);
+		if(fwimg_tag_compare(HMAC_CODE, chunk.tag)!=0){
+			printf("Chunk %u is tampered, integrity verification failed.\n",i);
+			return finish(&files,1);
+		}
+		AES_Decrypt_Chunk(AES256, ptr+chunk.offset, chunk.size, ExpKey, chain);
 
+		uint32_t plain=(header.plain_size-offset<chunk.size) ? header.plain_size-offset : chunk.size;	// padding is dropped
+		status=(header.codec_id==FWIMG_CODEC_LZSS) ? lzss_decode(&decoder, ptr+chunk.offset, plain) : write_sink(&out, ptr+chunk.offset, plain);
+		if(status!=0){
+			printf("Error : Unable to decode or write chunk %u to %s file (patch status %d).\n",i,rename,out.patch_status);
+			return finish(&files,1);
+		}
+	}
+	if(out.written!=header.image_size){
+		printf("Error : decoded %u bytes, the header announces %u.\n",out.written,header.image_size);
+		return finish(&files,1);
+	}
+	if(fptr_base!=NULL){
+		status=fwdelta_apply_finish(&patch);
+		if(status!=fwdeltaSuccess){
+			printf("Error : the patched firmware does not match the release (patch status %d).\n",status);
+			return finish(&files,1);
+		}
+		printf("Patch of %u bytes applied, firmware size : %u\n",out.written,patch.produced);
+	}else{
+		printf("Decrypted firmware size : %d\n",out.written);
+	}
 
+	/* The firmware is only complete once the file is closed */
+	files.fptr_unlock=NULL;
+	if(fclose(fptr_unlock)!=0){
+		printf("Error : Unable to write to %s file\n",rename);
+		remove(rename);
+		return finish(&files,1);
+	}
+	printf("firmware unlocked, file name : %s\n",rename);
+	return finish(&files,0);
 }
@@ -140,11 +140,11 @@ void InverseSubstitutionTransformation(uint8_t* StateArray){
 /**
  * @brief Add Round key transformation , This transformation performs just simple XOR operation between 'state array' and 4 words of expanded key.
  *        Add round key transformation is an 'involution' i.e. (a^b)^b = a
- * @param uint8_t* RoundKey passes the address of the 4 word round key to be XORed.
+ * @param const uint8_t* RoundKey passes the address of the 4 word round key to be XORed.
  * @param uint8_t* StateArray passes the address of the state array to be XORed with RoundKey.
  * @retval void
  */
-void AddRoundKeyTransformation(uint8_t* RoundKey, uint8_t* StateArray){
+void AddRoundKeyTransformation(const uint8_t* RoundKey, uint8_t* StateArray){
     for(uint8_t i=0;i<16;i++){
         StateArray[i]=((StateArray[i])^(RoundKey[i]));
     }
@@ -192,13 +192,21 @@ void ROTL_4Bytes(uint8_t* ptr, uint8_t count){
 /**
  * @brief Performs the row shifting operation on each row, on row 0, no operation is performed, on row 1, left rotational shift by 1, on row 2, left rotational shift by 2, on row 3, 
  *        left rotational shift by 3.
+ *        The state array is filled column by column (FIPS-197 section 3.4), row i is made of the bytes i, i+4, i+8 and i+12.
  * @param uint8_t* StateArray passes the address of the state array on which row shifting transformation has to be performed.
  * @retval void
  */
 void ForwardShiftRowTransformation(uint8_t* StateArray){
+    uint8_t row[4];
     /* First row remains as it is thus ommiting running loop over it. */
     for(uint8_t i=1;i<WORD;i++){
-        ROTL_4Bytes(StateArray + (WORD)*i , i);    
+        for(uint8_t c=0;c<WORD;c++){
+            row[c]=StateArray[i+WORD*c];
+        }
+        ROTL_4Bytes(row, i);
+        for(uint8_t c=0;c<WORD;c++){
+            StateArray[i+WORD*c]=row[c];
+        }
     }
 }
 #endif
@@ -232,9 +240,16 @@ void ROTR_4Bytes(uint8_t* ptr, uint8_t count){
  * @retval void 
  */
 void InverseShiftRowTransformation(uint8_t* StateArray){
-        for(uint8_t i=1;i<WORD;i++){
-            ROTR_4Bytes(StateArray + (WORD)*i , i);
+    uint8_t row[4];
+    for(uint8_t i=1;i<WORD;i++){
+        for(uint8_t c=0;c<WORD;c++){
+            row[c]=StateArray[i+WORD*c];
+        }
+        ROTR_4Bytes(row, i);
+        for(uint8_t c=0;c<WORD;c++){
+            StateArray[i+WORD*c]=row[c];
         }
+    }
 }
 #endif
 
@@ -314,15 +329,15 @@ void ForwardMixColumnTransformation(uint8_t* StateArray){
     for(uint8_t col=0;col<WORD;col++){
         for(uint8_t i=0;i<WORD;i++){
     		col_vector[i] = GF_MUL(Forward_MixColumn[i][0], StateArray[0]) 
-                          ^ GF_MUL(Forward_MixColumn[i][1], StateArray[4]) 
-                          ^ GF_MUL(Forward_MixColumn[i][2], StateArray[8]) 
-                          ^ GF_MUL(Forward_MixColumn[i][3], StateArray[12]);
+                          ^ GF_MUL(Forward_MixColumn[i][1], StateArray[1]) 
+                          ^ GF_MUL(Forward_MixColumn[i][2], StateArray[2]) 
+                          ^ GF_MUL(Forward_MixColumn[i][3], StateArray[3]);
         }
         
 	    for(uint8_t j=0;j<WORD;j++){
-		    StateArray[WORD*j]=col_vector[j];
+		    StateArray[j]=col_vector[j];
 	    }
-	    StateArray++;	
+	    StateArray+=WORD;	/* a column is 4 consecutive bytes of the state array */
 	}
 }
 #endif
@@ -339,15 +354,15 @@ void InverseMixColumnTransformation(uint8_t* StateArray){/* External for loop fo
     for(uint8_t col=0;col<WORD;col++){
         for(uint8_t i=0;i<WORD;i++){
     		col_vector[i] = GF_MUL(Inverse_MixColumn[i][0], StateArray[0]) 
-                          ^ GF_MUL(Inverse_MixColumn[i][1], StateArray[4]) 
-                          ^ GF_MUL(Inverse_MixColumn[i][2], StateArray[8]) 
-                          ^ GF_MUL(Inverse_MixColumn[i][3], StateArray[12]);
+                          ^ GF_MUL(Inverse_MixColumn[i][1], StateArray[1]) 
+                          ^ GF_MUL(Inverse_MixColumn[i][2], StateArray[2]) 
+                          ^ GF_MUL(Inverse_MixColumn[i][3], StateArray[3]);
         }
         
 	    for(uint8_t j=0;j<WORD;j++){
-		    StateArray[WORD*j]=col_vector[j];
+		    StateArray[j]=col_vector[j];
 	    }
-	    StateArray++;	
+	    StateArray+=WORD;	/* a column is 4 consecutive bytes of the state array */
 	}
 }
 #endif
@@ -405,12 +420,18 @@ void AES_ExpandKey(uint8_t AES_Type, const uint8_t* key, uint8_t* ExpKey){
                 }
 
                 /* step 3 : XORing with round constant , 1st byte of the word will be XORed with the round constant and left 3 will be XORed with 0x00 (need not to do XOR for last 3 bytes since a^0x00=a) */
-                ((uint8_t*)(&Word[i]))[0]^=rcon[i];   
+                ((uint8_t*)(&Word[i]))[0]^=rcon[i/(uint8_t)(AES_Type/WORD)-1]; /* one round constant per key length worth of words, rcon[0] for the first one */
 
                 /* step 4 : XORing the current value of Word[i] with Word[i-(uint8_t)(AES_Type/WORD)] */
                 for(uint8_t k=0;k<4;k++){
                     ((uint8_t*)(&Word[i]))[k]^=((uint8_t*)(&Word[i-(uint8_t)(AES_Type/WORD)]))[k];
                 }
+            }else
+            if(AES_Type==AES256 && i%(uint8_t)(AES_Type/WORD)==4){
+                /* AES256 only : the word half way through each key length is Word[i-1] substituted from S-box (no rotation, no round constant) XORed with Word[i-8] */
+                for(uint8_t l=0;l<4;l++){
+                    ((uint8_t*)(&Word[i]))[l]= ( ForwardSubByte(((uint8_t*)(&Word[i-1]))[l]) ^ ((uint8_t*)(&Word[i-(uint8_t)(AES_Type/WORD)]))[l] );
+                }
             }else{ /* i > (uint8_t)(AES_Type/WORD)  */
                 for(uint8_t l=0;l<4;l++){
                     ((uint8_t*)(&Word[i]))[l]= ( ((uint8_t*)(&Word[i-1]))[l] ^ ((uint8_t*)(&Word[i-(uint8_t)(AES_Type/WORD)]))[l] );
@@ -451,9 +472,17 @@ void AES_ExpandKey(uint8_t AES_Type, const uint8_t* key, uint8_t* ExpKey){
  * @retval void
  */
 void AES_Encrypt(uint8_t AES_Type, uint8_t* PlainByteStream, uint32_t Size_PlainByteStream, const uint8_t* key, uint32_t* Size_EncryptedByteStream, uint8_t* IV){
-    uint8_t AES_RC=(AES_Type/4)+6;
-    uint8_t AES_ExpKey_WC=(AES_RC+1)*4; /* expanded key size in words  */
-    
+    uint8_t ExpKey[AES_EXPKEY_MAXSIZE];
+    AES_ExpandKey(AES_Type, key, ExpKey);
+    AES_Encrypt_ExpKey(AES_Type, PlainByteStream, Size_PlainByteStream, ExpKey, Size_EncryptedByteStream, IV);
+}
+
+/**
+ * @brief Same as AES_Encrypt but uses a key already expanded by AES_ExpandKey, thus the key expansion can be done once and reused for any number of byte streams encrypted with the same key.
+ * @param const uint8_t* ExpKey passes the address of the expanded key produced by AES_ExpandKey for the same AES_Type.
+ * @retval void
+ */
+void AES_Encrypt_ExpKey(uint8_t AES_Type, uint8_t* PlainByteStream, uint32_t Size_PlainByteStream, const uint8_t* ExpKey, uint32_t* Size_EncryptedByteStream, uint8_t* IV){
     /* Checking for padding possibility other than 16 bytes which are must to be appended as per PKCS#7. */
     
        /* additional padding needed. */
@@ -477,21 +506,38 @@ void AES_Encrypt(uint8_t AES_Type, uint8_t* PlainByteStream, uint32_t Size_Plain
         }
     }
     
-    /* Padding added as per PKCS#7 and IV is also appended, now expanding key */
-    uint8_t ExpKey[AES_ExpKey_WC*WORD];
-    AES_ExpandKey(AES_Type, key, ExpKey); 
+    /* Padding added as per PKCS#7 and IV is also appended, key is already expanded by the caller */
+    uint8_t chain[AES_BLOCKSIZE];   /* AES_Encrypt_Chunk advances the chaining value, the appended IV must stay untouched */
+    for(uint8_t k=0;k<16;k++){
+        chain[k]=(PlainByteStream+(*Size_EncryptedByteStream))[k];
+    }
+    AES_Encrypt_Chunk(AES_Type, PlainByteStream, *Size_EncryptedByteStream, ExpKey, chain);
+}
+
+/**
+ * @brief Encrypts a chunk of whole AES blocks in place with CBC chaining, no padding is added, this lets a long byte stream be encrypted piece by piece (e.g. sector by sector).
+ * @param uint8_t AES_Type tell which AES algorithm to use.
+ * @param uint8_t* Chunk passes the address of the data to be encrypted in place.
+ * @param uint32_t Size_Chunk passes the size of the chunk, must be a multiple of AES_BLOCKSIZE.
+ * @param const uint8_t* ExpKey passes the address of the expanded key produced by AES_ExpandKey for the same AES_Type.
+ * @param uint8_t* IV passes the address of the 16 byte chaining value, the IV for the first chunk, on return it holds the last cipher block which is the IV of the next chunk.
+ * @retval void
+ */
+void AES_Encrypt_Chunk(uint8_t AES_Type, uint8_t* Chunk, uint32_t Size_Chunk, const uint8_t* ExpKey, uint8_t* IV){
+    uint8_t AES_RC=(AES_Type/4)+6;
+    uint8_t AES_ExpKey_WC=(AES_RC+1)*4; /* expanded key size in words  */
+    const uint8_t* chain=IV;
 
-    
     /* ExpKey for AES128, size is 44 words or 176 bytes , 11 quadwords or 11 aes_blocks  */
     /* ExpKey for AES192, size is 52 words or 208 bytes , 13 quadwords or 13 aes_blocks  */
     /* ExpKey for AES256, size is 60 words or 240 bytes , 15 quadwords or 15 aes_blocks  */
 
-    aes_block* quad1=(aes_block*)PlainByteStream;
+    aes_block* quad1=(aes_block*)Chunk;
 
-    for(uint32_t i=0;i<((*Size_EncryptedByteStream)/AES_BLOCKSIZE);i++){ /* encrypting quadword by quadword or state array by state array */
+    for(uint32_t i=0;i<(Size_Chunk/AES_BLOCKSIZE);i++){ /* encrypting quadword by quadword or state array by state array */
         /* Befor starting the core AES algorithm, we'll first XOR the plaintext with the IV. */
         for(uint8_t m=0;m<16;m++){
-            ((uint8_t*)quad1)[m]^=IV[m];
+            ((uint8_t*)quad1)[m]^=chain[m];
         }        
         /* CORE AES ENCRYPTION BEGIN. */
 
@@ -518,10 +564,17 @@ void AES_Encrypt(uint8_t AES_Type, uint8_t* PlainByteStream, uint32_t Size_Plain
         /* CORE AES ENCRYPTION END. */
 
         /* IV for next data block will be the cipher text of the previous data block. */
-        IV=(uint8_t*)quad1;
+        chain=(uint8_t*)quad1;
         /* advancing quad1 pointer to point to next data block */
         quad1++;
-    }  
+    }
+
+    /* handing the last cipher block back as IV of the next chunk */
+    if(chain!=IV){
+        for(uint8_t k=0;k<16;k++){
+            IV[k]=chain[k];
+        }
+    }
 }
 #endif
 
@@ -537,27 +590,63 @@ void AES_Encrypt(uint8_t AES_Type, uint8_t* PlainByteStream, uint32_t Size_Plain
  * @retval void
  */
 void AES_Decrypt(uint8_t AES_Type, uint8_t* EncryptedByteStream, uint32_t Size_EncryptedByteStream, const uint8_t* key, uint32_t* Size_DecryptedByteStream){
+    uint8_t ExpKey[AES_EXPKEY_MAXSIZE];
+    AES_ExpandKey(AES_Type, key, ExpKey);
+    AES_Decrypt_ExpKey(AES_Type, EncryptedByteStream, Size_EncryptedByteStream, ExpKey, Size_DecryptedByteStream);
+}
+
+/**
+ * @brief Same as AES_Decrypt but uses a key already expanded by AES_ExpandKey, thus the key expansion can be done once and reused for any number of byte streams decrypted with the same key.
+ * @param const uint8_t* ExpKey passes the address of the expanded key produced by AES_ExpandKey for the same AES_Type.
+ * @retval void
+ */
+void AES_Decrypt_ExpKey(uint8_t AES_Type, uint8_t* EncryptedByteStream, uint32_t Size_EncryptedByteStream, const uint8_t* ExpKey, uint32_t* Size_DecryptedByteStream){
+    /* The IV for the first encrypted block will be whats appended by AES_Encrypt at the end of given input encrypted stream. */
+    uint8_t IV[AES_BLOCKSIZE];
+    for(uint8_t k=0;k<16;k++){
+        IV[k]=EncryptedByteStream[Size_EncryptedByteStream+k];
+    }
+    AES_Decrypt_Chunk(AES_Type, EncryptedByteStream, Size_EncryptedByteStream, ExpKey, IV);
+
+    /* Encrypted data has been decrypted, now removing padding and populating the Size_DecryptedByteStream */
+    uint8_t padding=EncryptedByteStream[Size_EncryptedByteStream-1]; /* using PKCS#7, last byte value will tell the padding bytes. */
+    *Size_DecryptedByteStream=Size_EncryptedByteStream-padding; /* decrypted data length = cipher text length - padding */
+    for(uint8_t k=0;k<padding;k++){
+        EncryptedByteStream[*Size_DecryptedByteStream+k]=0x00;  /* Nullifying all padding bytes */
+    }
+}
+
+/**
+ * @brief Decrypts a chunk of whole AES blocks in place with CBC chaining, padding is not removed, this lets a long encrypted byte stream be decrypted piece by piece (e.g. sector by sector) in a small buffer.
+ * @param uint8_t AES_Type tell which AES algorithm to use.
+ * @param uint8_t* Chunk passes the address of the cipher text to be decrypted in place.
+ * @param uint32_t Size_Chunk passes the size of the chunk, must be a multiple of AES_BLOCKSIZE.
+ * @param const uint8_t* ExpKey passes the address of the expanded key produced by AES_ExpandKey for the same AES_Type.
+ * @param uint8_t* IV passes the address of the 16 byte chaining value, the IV for the first chunk or the last cipher block of the previous chunk, on return it holds the last cipher block of this chunk.
+ * @retval void
+ */
+void AES_Decrypt_Chunk(uint8_t AES_Type, uint8_t* Chunk, uint32_t Size_Chunk, const uint8_t* ExpKey, uint8_t* IV){
     uint8_t AES_RC=(AES_Type/4)+6;
     uint8_t AES_ExpKey_WC=(AES_RC+1)*4; /* expanded key size in words  */
 
-    uint8_t ExpKey[AES_ExpKey_WC*WORD];
-    uint8_t* ExpKey_ptr=ExpKey;
-    
-    AES_ExpandKey(AES_Type, key, ExpKey_ptr); 
+    const uint8_t* ExpKey_ptr=ExpKey;
 
     /* ExpKey for AES128, size is 44 words or 176 bytes , 11 quadwords or 11 aes_blocks  */
     /* ExpKey for AES192, size is 52 words or 208 bytes , 13 quadwords or 13 aes_blocks  */
     /* ExpKey for AES256, size is 60 words or 240 bytes , 15 quadwords or 15 aes_blocks  */
 
-    aes_block* quad1=(aes_block*)EncryptedByteStream;
+    aes_block* quad1=(aes_block*)Chunk;
     /* Allocating an IV Block */
-    aes_block IV_block0 = *((aes_block*)(EncryptedByteStream+Size_EncryptedByteStream)); /* The IV for the first encrypted block will be whats appended by AES_Encrypt at the end of given input encrypted stream. */
-    aes_block IV_block1 = *(quad1); /* Cipher text of block(i-1) will be IV for block(i), thus storing separately else after decryption of block(i-1), IV will be lost for block(i) */
+    aes_block IV_block0 = *((aes_block*)IV);
+    aes_block IV_block1; /* Cipher text of block(i-1) will be IV for block(i), thus storing separately else after decryption of block(i-1), IV will be lost for block(i) */
     /* Since we know the size of ExpKey which is AES_ExpKey_WC*4 , thus we'll now move the ExpKey pointer to the end of the expanded key and then with the loop, we'll fall back to initial word */
 
     ExpKey_ptr+=(AES_ExpKey_WC*4);
 
-    for(uint32_t i=0;i<Size_EncryptedByteStream/AES_BLOCKSIZE;i++){ /* decrypting quadword by quadword or state array by state array */
+    for(uint32_t i=0;i<Size_Chunk/AES_BLOCKSIZE;i++){ /* decrypting quadword by quadword or state array by state array */
+        /* saving cipher of this block as IV of next block */
+        IV_block1=*(quad1);
+
         /* AES CORE DECRYPTION BEGIN. */
 
         /* Proceeding to Initialization round. */
@@ -592,17 +681,10 @@ void AES_Decrypt(uint8_t AES_Type, uint8_t* EncryptedByteStream, uint32_t Size_E
 
         /* advancing quad1 pointer to point to next data block */
         quad1++;
-
-        /* saving cipher of next block as IV of next to next block */
-        IV_block1=*(quad1);
     }
 
-
-    /* Encrypted data has been decrypted, now removing padding and populating the Size_DecryptedByteStream */
-    *Size_DecryptedByteStream=Size_EncryptedByteStream-EncryptedByteStream[Size_EncryptedByteStream-1]; /* decrypted data length = cipher text length - padding, using PKCS#7, last byte value will tell the padding bytes. */
-    for(uint8_t k=0;k<EncryptedByteStream[Size_EncryptedByteStream];k++){
-        EncryptedByteStream[*Size_DecryptedByteStream+k]=0x00;  /* Nullifying all padding bytes */
-    }
+    /* handing the last cipher block back as IV of the next chunk */
+    *((aes_block*)IV)=IV_block0;
 }
 #endif
 
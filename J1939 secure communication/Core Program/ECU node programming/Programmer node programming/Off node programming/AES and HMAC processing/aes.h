@@ -102,6 +102,11 @@ typedef struct {
 #define AES192_EXPKEY_WC (AES192_RC+1)*4
 #define AES256_EXPKEY_WC (AES256_RC+1)*4
 
+/**
+ * @brief Size in bytes of the largest expanded key (AES256), enough to hold the expanded key of any AES algorithm.
+ */
+#define AES_EXPKEY_MAXSIZE (AES256_EXPKEY_WC*WORD)
+
 
 
 
@@ -163,11 +168,11 @@ void InverseSubstitutionTransformation(uint8_t* StateArray);
 /**
  * @brief Add Round key transformation , This transformation performs just simple XOR operation between 'state array' and 4 words of expanded key.
  *        Add round key transformation is an 'involution' i.e. (a^b)^b = a
- * @param uint8_t* RoundKey passes the address of the 4 word round key to be XORed.
+ * @param const uint8_t* RoundKey passes the address of the 4 word round key to be XORed.
  * @param uint8_t* StateArray passes the address of the state array to be XORed with RoundKey.
  * @retval void 
  */
-void AddRoundKeyTransformation(uint8_t* RoundKey, uint8_t* StateArray);
+void AddRoundKeyTransformation(const uint8_t* RoundKey, uint8_t* StateArray);
 
 /**
  * @}
@@ -315,6 +320,24 @@ void AES_ExpandKey(uint8_t AES_Type, const uint8_t* key, uint8_t* ExpKey);
  * @retval void
  */
 void AES_Encrypt(uint8_t AES_Type, uint8_t* PlainByteStream, uint32_t Size_PlainByteStream, const uint8_t* key, uint32_t* Size_EncryptedByteStream, uint8_t* IV);
+
+/**
+ * @brief Same as AES_Encrypt but uses a key already expanded by AES_ExpandKey, thus the key expansion can be done once and reused for any number of byte streams encrypted with the same key.
+ * @param const uint8_t* ExpKey passes the address of the expanded key produced by AES_ExpandKey for the same AES_Type.
+ * @retval void
+ */
+void AES_Encrypt_ExpKey(uint8_t AES_Type, uint8_t* PlainByteStream, uint32_t Size_PlainByteStream, const uint8_t* ExpKey, uint32_t* Size_EncryptedByteStream, uint8_t* IV);
+
+/**
+ * @brief Encrypts a chunk of whole AES blocks in place with CBC chaining, no padding is added, this lets a long byte stream be encrypted piece by piece (e.g. sector by sector).
+ * @param uint8_t AES_Type tell which AES algorithm to use.
+ * @param uint8_t* Chunk passes the address of the data to be encrypted in place.
+ * @param uint32_t Size_Chunk passes the size of the chunk, must be a multiple of AES_BLOCKSIZE.
+ * @param const uint8_t* ExpKey passes the address of the expanded key produced by AES_ExpandKey for the same AES_Type.
+ * @param uint8_t* IV passes the address of the 16 byte chaining value, the IV for the first chunk, on return it holds the last cipher block which is the IV of the next chunk.
+ * @retval void
+ */
+void AES_Encrypt_Chunk(uint8_t AES_Type, uint8_t* Chunk, uint32_t Size_Chunk, const uint8_t* ExpKey, uint8_t* IV);
 #endif
 
 #if ROUTINE_SELECTOR == DECRY_ONLY || ROUTINE_SELECTOR == _ALL
@@ -329,6 +352,24 @@ void AES_Encrypt(uint8_t AES_Type, uint8_t* PlainByteStream, uint32_t Size_Plain
  * @retval void
  */
 void AES_Decrypt(uint8_t AES_Type, uint8_t* EncryptedByteStream, uint32_t Size_EncryptedByteStream, const uint8_t* key, uint32_t* Size_DecryptedByteStream);
+
+/**
+ * @brief Same as AES_Decrypt but uses a key already expanded by AES_ExpandKey, thus the key expansion can be done once and reused for any number of byte streams decrypted with the same key.
+ * @param const uint8_t* ExpKey passes the address of the expanded key produced by AES_ExpandKey for the same AES_Type.
+ * @retval void
+ */
+void AES_Decrypt_ExpKey(uint8_t AES_Type, uint8_t* EncryptedByteStream, uint32_t Size_EncryptedByteStream, const uint8_t* ExpKey, uint32_t* Size_DecryptedByteStream);
+
+/**
+ * @brief Decrypts a chunk of whole AES blocks in place with CBC chaining, padding is not removed, this lets a long encrypted byte stream be decrypted piece by piece (e.g. sector by sector) in a small buffer.
+ * @param uint8_t AES_Type tell which AES algorithm to use.
+ * @param uint8_t* Chunk passes the address of the cipher text to be decrypted in place.
+ * @param uint32_t Size_Chunk passes the size of the chunk, must be a multiple of AES_BLOCKSIZE.
+ * @param const uint8_t* ExpKey passes the address of the expanded key produced by AES_ExpandKey for the same AES_Type.
+ * @param uint8_t* IV passes the address of the 16 byte chaining value, the IV for the first chunk or the last cipher block of the previous chunk, on return it holds the last cipher block of this chunk.
+ * @retval void
+ */
+void AES_Decrypt_Chunk(uint8_t AES_Type, uint8_t* Chunk, uint32_t Size_Chunk, const uint8_t* ExpKey, uint8_t* IV);
 #endif
 
 /**
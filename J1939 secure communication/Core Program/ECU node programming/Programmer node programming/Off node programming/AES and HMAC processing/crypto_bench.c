@@ -0,0 +1,235 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<time.h>
+#include<unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include<x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "aes.h"
+#include "sha1.h"
+#include "hmac.h"
+#include "crypto_check.h"
+
+#define MIN_SIZE_DEFAULT 16
+#define MAX_SIZE_DEFAULT (64u<<20)
+#define MIN_TIME_DEFAULT 0.2					// seconds each measurement runs for at least.
+#define HMAC_BENCH_KEY_LEN 32
+#define CHECK_ROUNDS_DEFAULT 200				// random differential rounds of the self check.
+
+
+/* Buffers shared by every routine under test, sized for the largest input plus padding and appended IV. */
+uint8_t* BUF=NULL;
+uint8_t* CIPHER=NULL;					// pristine AES_Encrypt output the decryption restarts from.
+uint8_t KEY[AES256];
+uint8_t EXPKEY[AES_EXPKEY_MAXSIZE];
+uint8_t IV[AES_BLOCKSIZE];
+double MIN_TIME=MIN_TIME_DEFAULT;
+const char* FILTER=NULL;
+
+/* One routine under test, run processes size bytes of BUF once. */
+struct bench {
+	const char* name;
+	void (*prepare)(uint32_t size);			// called once per size outside the timed region, may be NULL.
+	void (*run)(uint32_t size);
+	int sized;					// 0 when the routine does not depend on the buffer size (key expansion).
+};
+
+static double now_sec(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (double)ts.tv_sec+(double)ts.tv_nsec/1e9;
+}
+
+static uint64_t cycles(void){
+#if HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void run_expand_key(uint32_t size){
+	(void)size;
+	AES_ExpandKey(AES256,KEY,EXPKEY);
+}
+
+/* The buffer is encrypted in place again and again, its content does not change the work done. */
+static void run_encrypt(uint32_t size){
+	uint32_t encrypted_size;
+	AES_Encrypt(AES256,BUF,size,KEY,&encrypted_size,IV);
+}
+
+/* Decryption works on the real cipher text of size bytes, the padding it strips must be valid. */
+static void prepare_decrypt(uint32_t size){
+	uint32_t encrypted_size;
+	AES_Encrypt(AES256,BUF,size,KEY,&encrypted_size,IV);
+	memcpy(CIPHER,BUF,encrypted_size+AES_BLOCKSIZE);
+}
+
+/* Restoring the cipher text is part of the measurement, a memcpy is several hundred times faster than the decryption. */
+static void run_decrypt(uint32_t size){
+	uint32_t decrypted_size;
+	uint32_t encrypted_size=size+AES_BLOCKSIZE-size%AES_BLOCKSIZE;
+	memcpy(BUF,CIPHER,encrypted_size+AES_BLOCKSIZE);
+	AES_Decrypt(AES256,BUF,encrypted_size,KEY,&decrypted_size);
+}
+
+static void run_sha1(uint32_t size){
+	struct sha1 ctx;
+	uint8_t digest[SHA1HashSize];
+	sha1_reset(&ctx);
+	sha1_input(&ctx,BUF,size);
+	sha1_result(&ctx,digest);
+}
+
+static void run_hmac(uint32_t size){
+	uint8_t code[HMAC_SHA1_DIGEST_SIZE];
+	hmac_sha1(KEY,HMAC_BENCH_KEY_LEN,BUF,size,code);
+}
+
+static const struct bench BENCHES[]={
+	{ "AES_ExpandKey", NULL, run_expand_key, 0 },
+	{ "AES_Encrypt", NULL, run_encrypt, 1 },
+	{ "AES_Decrypt", prepare_decrypt, run_decrypt, 1 },
+	{ "sha1_input", NULL, run_sha1, 1 },
+	{ "hmac_sha1", NULL, run_hmac, 1 },
+};
+
+/* Runs b on size bytes for at least MIN_TIME seconds and prints one CSV record. */
+static void measure(const struct bench* b, uint32_t size){
+	if(b->prepare!=NULL){
+		b->prepare(size);
+	}
+	/* A single call (also warms the caches) sizes the timed loop, it is the measurement when it already lasts MIN_TIME */
+	uint64_t c0=cycles();
+	double start=now_sec();
+	b->run(size);
+	double elapsed=now_sec()-start;
+	uint64_t c1=cycles();
+	uint64_t iterations=1;
+
+	if(elapsed<MIN_TIME){
+		iterations=(uint64_t)(MIN_TIME/(elapsed>1e-9 ? elapsed : 1e-9))+1;
+		c0=cycles();
+		start=now_sec();
+		for(uint64_t i=0;i<iterations;i++){
+			b->run(size);
+		}
+		elapsed=now_sec()-start;
+		c1=cycles();
+	}
+
+	double bytes=(double)size*iterations;
+	printf("%s,%u,%llu,%.1f,",b->name,size,(unsigned long long)iterations,elapsed/iterations*1e9);
+	if(HAVE_TSC){
+		printf("%.2f,",(double)(c1-c0)/bytes);
+	}else{
+		printf("nan,");
+	}
+	printf("%.3f\n",elapsed>0 ? bytes/elapsed/1e6 : 0.0);
+	fflush(stdout);
+}
+
+static void usage(const char* prog){
+	printf("Usage : %s [-s <min size>] [-m <max size>] [-t <min time ms>] [-f <routine>] [-k] [-r <seed>] [-n <rounds>]\n",prog);
+	printf("  Measures AES_ExpandKey, then AES_Encrypt, AES_Decrypt, sha1_input and hmac_sha1 over buffer sizes from -s to -m bytes\n");
+	printf("  (x4 steps, default %u to %u), AES is AES256-CBC.\n",MIN_SIZE_DEFAULT,MAX_SIZE_DEFAULT);
+	printf("  Each measurement runs for at least -t ms (default %.0f), -f keeps the routines whose name contains the given text.\n",MIN_TIME_DEFAULT*1e3);
+	printf("  Output is CSV : routine,bytes,iterations,ns_per_call,cycles_per_byte,mb_per_s\n");
+	printf("  cycles are time stamp counter ticks, i.e. reference cycles, nan where no counter is available.\n");
+	printf("  Every run starts with the self check (crypto_check.h) : known answers and -n rounds (default %d) of random\n",CHECK_ROUNDS_DEFAULT);
+	printf("  differential checks from seed -r (default : time based), nothing is measured if a check fails. -k runs the check only.\n");
+}
+
+int main(int argc, char** argv){
+	unsigned long min_size=MIN_SIZE_DEFAULT;
+	unsigned long max_size=MAX_SIZE_DEFAULT;
+	unsigned long long seed=(unsigned long long)time(NULL);
+	unsigned long rounds=CHECK_ROUNDS_DEFAULT;
+	int check_only=0;
+	int opt;
+
+	while((opt=getopt(argc,argv,"s:m:t:f:kr:n:"))!=-1){
+		switch(opt){
+		case 's':
+			min_size=strtoul(optarg,NULL,0);
+			break;
+		case 'm':
+			max_size=strtoul(optarg,NULL,0);
+			break;
+		case 't':
+			MIN_TIME=strtod(optarg,NULL)/1e3;
+			break;
+		case 'f':
+			FILTER=optarg;
+			break;
+		case 'k':
+			check_only=1;
+			break;
+		case 'r':
+			seed=strtoull(optarg,NULL,0);
+			break;
+		case 'n':
+			rounds=strtoul(optarg,NULL,0);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(optind!=argc || min_size==0 || min_size>max_size || max_size>0x40000000 || MIN_TIME<=0){
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* The failing seed is printed so a mismatch found by random inputs can be replayed with -r */
+	uint32_t failures=crypto_check(seed,(uint32_t)rounds,1);
+	if(failures!=0 || check_only){
+		if(failures!=0){
+			printf("# self check failed : %u mismatches with seed %llu, nothing measured\n",failures,seed);
+		}
+		return failures!=0 ? 1 : 0;
+	}
+
+	/* Room for PKCS#7 padding and the IV AES_Encrypt appends */
+	BUF=(uint8_t*)malloc(max_size+2*AES_BLOCKSIZE);
+	CIPHER=(uint8_t*)malloc(max_size+2*AES_BLOCKSIZE);
+	if(BUF==NULL || CIPHER==NULL){
+		printf("Error : Unable to allocate %lu bytes\n",max_size);
+		return 1;
+	}
+	srand(1);
+	for(unsigned long i=0;i<max_size+2*AES_BLOCKSIZE;i++){
+		BUF[i]=(uint8_t)rand();
+	}
+	for(int i=0;i<AES256;i++){
+		KEY[i]=(uint8_t)rand();
+	}
+	for(int i=0;i<AES_BLOCKSIZE;i++){
+		IV[i]=(uint8_t)rand();
+	}
+
+	printf("# crypto_bench, %ld cores online, min time %.0f ms\n",sysconf(_SC_NPROCESSORS_ONLN),MIN_TIME*1e3);
+	printf("routine,bytes,iterations,ns_per_call,cycles_per_byte,mb_per_s\n");
+	for(size_t b=0;b<sizeof(BENCHES)/sizeof(BENCHES[0]);b++){
+		if(FILTER!=NULL && strstr(BENCHES[b].name,FILTER)==NULL){
+			continue;
+		}
+		if(!BENCHES[b].sized){
+			measure(&BENCHES[b],AES256);	/* key bytes processed per call */
+			continue;
+		}
+		for(unsigned long size=min_size;size<=max_size;size*=4){
+			measure(&BENCHES[b],(uint32_t)size);
+		}
+	}
+	free(BUF);
+	free(CIPHER);
+	return 0;
+}
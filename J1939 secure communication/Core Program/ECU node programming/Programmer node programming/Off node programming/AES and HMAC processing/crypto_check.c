@@ -0,0 +1,391 @@
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: crypto_check.c
+ * Description: Known answer and differential checks of the AES, SHA1, HMAC, HKDF and delta routines, see crypto_check.h.
+ * --------------------------------------------------------------------------------------------------
+ */
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "aes.h"
+#include "sha1.h"
+#include "hmac.h"
+#include "fwdelta.h"
+#include "keystore.h"
+#include "crypto_check.h"
+
+#define MAX_AES_INPUT       4096        /* random AES inputs are 0 to MAX_AES_INPUT bytes */
+#define MAX_HASH_INPUT      20000
+#define MAX_IMAGE_SIZE      40000       /* random firmware images of the delta round trip */
+#define SHA1_MILLION        1000000
+
+static uint32_t failures;
+static uint64_t rng_state;
+
+/* xorshift64*, reproducible from the seed printed by the caller */
+static uint64_t rng(void)
+{
+	rng_state^=rng_state>>12;
+	rng_state^=rng_state<<25;
+	rng_state^=rng_state>>27;
+	return rng_state*0x2545F4914F6CDD1Dull;
+}
+
+static uint32_t rng_below(uint32_t n)
+{
+	return (n==0) ? 0 : (uint32_t)(rng()%n);
+}
+
+static void rng_fill(uint8_t* buf, uint32_t size)
+{
+	for(uint32_t i=0; i<size; i++)
+		buf[i]=(uint8_t)(rng()>>32);
+}
+
+/* Random size, one time in four a multiple of AES_BLOCKSIZE so full padding blocks are covered */
+static uint32_t rng_size(uint32_t max)
+{
+	uint32_t size=rng_below(max+1);
+	return (rng_below(4)==0) ? size-size%AES_BLOCKSIZE : size;
+}
+
+static void hex_decode(const char* hex, uint8_t* out)
+{
+	for(uint32_t i=0; hex[2*i]!='\0'; i++)
+	{
+		unsigned v;
+		sscanf(hex+2*i,"%2x",&v);
+		out[i]=(uint8_t)v;
+	}
+}
+
+static void check(int ok, const char* what, uint32_t detail)
+{
+	if(!ok)
+	{
+		failures++;
+		printf("FAIL : %s (%u)\n",what,detail);
+	}
+}
+
+static void check_hex(const uint8_t* got, const char* expected, const char* what)
+{
+	uint8_t want[64];
+	uint32_t size=(uint32_t)strlen(expected)/2;
+	hex_decode(expected,want);
+	check(memcmp(got,want,size)==0,what,size);
+}
+
+static void sha1_of(const uint8_t* data, uint32_t size, uint8_t digest[SHA1HashSize])
+{
+	struct sha1 ctx;
+	sha1_reset(&ctx);
+	sha1_input(&ctx,data,size);
+	sha1_result(&ctx,digest);
+}
+
+static void known_answers(void)
+{
+	uint8_t digest[SHA1HashSize];
+	uint8_t key[80];
+	uint8_t okm[42];
+	struct sha1 ctx;
+
+	/* FIPS 180-2 appendix A and B */
+	sha1_of((const uint8_t*)"abc",3,digest);
+	check_hex(digest,"a9993e364706816aba3e25717850c26c9cd0d89d","SHA1 \"abc\"");
+	sha1_of((const uint8_t*)"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",56,digest);
+	check_hex(digest,"84983e441c3bd26ebaae4aa1f95129e5e54670f1","SHA1 448 bit message");
+	uint8_t* a=(uint8_t*)malloc(SHA1_MILLION);
+	if(a!=NULL)
+	{
+		memset(a,'a',SHA1_MILLION);
+		sha1_of(a,SHA1_MILLION,digest);
+		check_hex(digest,"34aa973cd4c4daa4f61eeb2bdbad27316534016f","SHA1 one million 'a'");
+		free(a);
+	}
+	sha1_reset(&ctx);
+	sha1_result(&ctx,digest);
+	check_hex(digest,"da39a3ee5e6b4b0d3255bfef95601890afd80709","SHA1 empty message");
+
+	/* RFC 2202 test cases 1, 2 and 6 (key longer than a block) */
+	memset(key,0x0b,20);
+	hmac_sha1(key,20,(const uint8_t*)"Hi There",8,digest);
+	check_hex(digest,"b617318655057264e28bc0b6fb378c8ef146be00","HMAC-SHA1 RFC 2202 case 1");
+	hmac_sha1((const uint8_t*)"Jefe",4,(const uint8_t*)"what do ya want for nothing?",28,digest);
+	check_hex(digest,"effcdf6ae5eb2fa2d27416d5f184df9c259a7c79","HMAC-SHA1 RFC 2202 case 2");
+	memset(key,0xaa,80);
+	hmac_sha1(key,80,(const uint8_t*)"Test Using Larger Than Block-Size Key - Hash Key First",54,digest);
+	check_hex(digest,"aa4ae5e15272d00e95705637ce8a3b55ed402112","HMAC-SHA1 RFC 2202 case 6");
+
+	/* RFC 5869 test cases 4 and 7 */
+	uint8_t ikm[22], salt[13], info[10];
+	memset(ikm,0x0b,11);
+	for(uint8_t i=0; i<13; i++)
+		salt[i]=i;
+	for(uint8_t i=0; i<10; i++)
+		info[i]=(uint8_t)(0xf0+i);
+	keystore_hkdf(salt,13,ikm,11,info,10,okm,42);
+	check_hex(okm,"085a01ea1b10f36933068b56efa5ad81a4f14b822f5b091568a9cdd4f155fda2c22e422478d305f3f896","HKDF-SHA1 RFC 5869 case 4");
+	memset(ikm,0x0c,22);
+	keystore_hkdf(NULL,0,ikm,22,NULL,0,okm,42);
+	check_hex(okm,"2c91117204d745f3500d636a62f64f0ab3bae548aa53d423b0d1f27ebba6f5e5673a081d70cce7acfc48","HKDF-SHA1 RFC 5869 case 7");
+
+	/* FIPS-197 appendix A keys with the last round key of their expansion, appendix C example blocks and the first
+	 * AESAVS GFSbox vector of each key size (zero key), every block encrypted under a zero IV and decrypted back */
+	static const struct
+	{
+		uint8_t type;
+		const char* key;
+		const char* last_round_key;
+		const char* plain;
+		const char* cipher;
+	} aes_answers[]=
+	{
+		{ AES128, "2b7e151628aed2a6abf7158809cf4f3c", "d014f9a8c9ee2589e13f0cc8b6630ca6", NULL, NULL },
+		{ AES192, "8e73b0f7da0e6452c810f32b809079e562f8ead2522c6b7b", "e98ba06f448c773c8ecc720401002202", NULL, NULL },
+		{ AES256, "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4", "fe4890d1e6188d0b046df344706c631e", NULL, NULL },
+		{ AES128, "000102030405060708090a0b0c0d0e0f", NULL, "00112233445566778899aabbccddeeff", "69c4e0d86a7b0430d8cdb78070b4c55a" },
+		{ AES192, "000102030405060708090a0b0c0d0e0f1011121314151617", NULL, "00112233445566778899aabbccddeeff", "dda97ca4864cdfe06eaf70a0ec0d7191" },
+		{ AES256, "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f", NULL, "00112233445566778899aabbccddeeff", "8ea2b7ca516745bfeafc49904b496089" },
+		{ AES128, "00000000000000000000000000000000", NULL, "f34481ec3cc627bacd5dc3fb08f273e6", "0336763e966d92595a567cc9ce537f5e" },
+		{ AES192, "000000000000000000000000000000000000000000000000", NULL, "1b077a6af4b7f98229de786d7516b639", "275cfc0413d8ccb70513c3859b1d0f72" },
+		{ AES256, "0000000000000000000000000000000000000000000000000000000000000000", NULL, "014730f80ac625fe84f026c60bfd547d", "5c9d844ed46f9885085e5d6a4f94c7d7" },
+	};
+	for(uint32_t n=0; n<sizeof(aes_answers)/sizeof(aes_answers[0]); n++)
+	{
+		uint8_t ExpKey[AES_EXPKEY_MAXSIZE];
+		uint8_t plain[AES_BLOCKSIZE];
+		uint8_t block[AES_BLOCKSIZE];
+		uint8_t iv[AES_BLOCKSIZE]={0};
+		uint32_t rounds=aes_answers[n].type/4+6;
+		hex_decode(aes_answers[n].key,key);
+		AES_ExpandKey(aes_answers[n].type,key,ExpKey);
+		if(aes_answers[n].last_round_key!=NULL)
+		{
+			check_hex(ExpKey+rounds*AES_BLOCKSIZE,aes_answers[n].last_round_key,"AES key expansion");
+			continue;
+		}
+		hex_decode(aes_answers[n].plain,plain);
+		memcpy(block,plain,AES_BLOCKSIZE);
+		AES_Encrypt_Chunk(aes_answers[n].type,block,AES_BLOCKSIZE,ExpKey,iv);
+		check_hex(block,aes_answers[n].cipher,"AES block encryption");
+		memset(iv,0,AES_BLOCKSIZE);
+		AES_Decrypt_Chunk(aes_answers[n].type,block,AES_BLOCKSIZE,ExpKey,iv);
+		check(memcmp(block,plain,AES_BLOCKSIZE)==0,"AES block decryption",n);
+	}
+
+	/* NIST SP 800-38A F.2.1 and F.2.5, four chained CBC blocks, the chaining value handed back must be the last cipher block */
+	static const char cbc_plain[]="6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e5130c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+	static const struct
+	{
+		uint8_t type;
+		const char* key;
+		const char* cipher;
+	} cbc_answers[]=
+	{
+		{ AES128, "2b7e151628aed2a6abf7158809cf4f3c",
+			"7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b273bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7" },
+		{ AES256, "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+			"f58c4c04d6e5f1ba779eabfb5f7bfbd69cfc4e967edb808d679f777bc6702c7d39f23369a9d9bacfa530e26304231461b2eb05e2c39be9fcda6c19078c6a9d1b" },
+	};
+	for(uint32_t n=0; n<sizeof(cbc_answers)/sizeof(cbc_answers[0]); n++)
+	{
+		uint8_t ExpKey[AES_EXPKEY_MAXSIZE];
+		uint8_t plain[4*AES_BLOCKSIZE];
+		uint8_t buf[4*AES_BLOCKSIZE];
+		uint8_t iv[AES_BLOCKSIZE];
+		hex_decode(cbc_answers[n].key,key);
+		hex_decode(cbc_plain,plain);
+		AES_ExpandKey(cbc_answers[n].type,key,ExpKey);
+		memcpy(buf,plain,sizeof(buf));
+		for(uint8_t i=0; i<AES_BLOCKSIZE; i++)
+			iv[i]=i;
+		AES_Encrypt_Chunk(cbc_answers[n].type,buf,sizeof(buf),ExpKey,iv);
+		check_hex(buf,cbc_answers[n].cipher,"AES-CBC SP 800-38A encryption");
+		check(memcmp(iv,buf+3*AES_BLOCKSIZE,AES_BLOCKSIZE)==0,"AES-CBC chaining value",n);
+		for(uint8_t i=0; i<AES_BLOCKSIZE; i++)
+			iv[i]=i;
+		AES_Decrypt_Chunk(cbc_answers[n].type,buf,sizeof(buf),ExpKey,iv);
+		check(memcmp(buf,plain,sizeof(buf))==0,"AES-CBC SP 800-38A decryption",n);
+	}
+}
+
+/* AES_Encrypt, AES_Encrypt_ExpKey and AES_Encrypt_Chunk cut at random block boundaries must give the same cipher text,
+ * AES_Decrypt, AES_Decrypt_ExpKey and chunked AES_Decrypt_Chunk must give the plain text back. */
+static void aes_differential(uint8_t* plain, uint8_t* a, uint8_t* b)
+{
+	static const uint8_t types[3]={ AES128, AES192, AES256 };
+	uint8_t key[AES256], iv[AES_BLOCKSIZE], chain[AES_BLOCKSIZE];
+	uint8_t ExpKey[AES_EXPKEY_MAXSIZE];
+	uint32_t size_a, size_b, size=rng_size(MAX_AES_INPUT);
+	uint8_t type=types[rng_below(3)];
+
+	rng_fill(key,sizeof(key));
+	rng_fill(iv,sizeof(iv));
+	rng_fill(plain,size);
+	AES_ExpandKey(type,key,ExpKey);
+
+	memcpy(a,plain,size);
+	AES_Encrypt(type,a,size,key,&size_a,iv);
+	memcpy(b,plain,size);
+	AES_Encrypt_ExpKey(type,b,size,ExpKey,&size_b,iv);
+	check(size_a==size_b && size_a==size+AES_BLOCKSIZE-size%AES_BLOCKSIZE,"AES_Encrypt padded size",size);
+	check(memcmp(a,b,size_a+AES_BLOCKSIZE)==0,"AES_Encrypt / AES_Encrypt_ExpKey",size);
+
+	/* Same padding by hand, then the chain cut at random block boundaries */
+	memcpy(b,plain,size);
+	memset(b+size,(int)(size_a-size),size_a-size);
+	memcpy(chain,iv,AES_BLOCKSIZE);
+	for(uint32_t off=0; off<size_a; )
+	{
+		uint32_t n=(rng_below((size_a-off)/AES_BLOCKSIZE)+1)*AES_BLOCKSIZE;
+		AES_Encrypt_Chunk(type,b+off,n,ExpKey,chain);
+		off+=n;
+	}
+	check(memcmp(a,b,size_a)==0,"AES_Encrypt / AES_Encrypt_Chunk split",size);
+	check(memcmp(a+size_a,iv,AES_BLOCKSIZE)==0,"AES_Encrypt appended IV",size);
+
+	memcpy(chain,iv,AES_BLOCKSIZE);
+	for(uint32_t off=0; off<size_a; )
+	{
+		uint32_t n=(rng_below((size_a-off)/AES_BLOCKSIZE)+1)*AES_BLOCKSIZE;
+		AES_Decrypt_Chunk(type,b+off,n,ExpKey,chain);
+		off+=n;
+	}
+	check(memcmp(b,plain,size)==0,"AES_Decrypt_Chunk split",size);
+
+	memcpy(b,a,size_a+AES_BLOCKSIZE);
+	AES_Decrypt(type,a,size_a,key,&size_b);
+	check(size_b==size && memcmp(a,plain,size)==0,"AES_Decrypt round trip",size);
+	AES_Decrypt_ExpKey(type,b,size_a,ExpKey,&size_b);
+	check(size_b==size && memcmp(b,plain,size)==0,"AES_Decrypt_ExpKey round trip",size);
+}
+
+/* One shot SHA1/HMAC against the same message streamed in random pieces, and a keyed HMAC context reused by copy */
+static void hash_differential(uint8_t* msg)
+{
+	uint8_t one_shot[SHA1HashSize], streamed[SHA1HashSize], key[100];
+	uint32_t size=rng_below(MAX_HASH_INPUT+1);
+	uint32_t key_len=rng_below(sizeof(key))+1;
+	struct sha1 ctx;
+	struct hmac_sha1 keyed, hmac;
+
+	rng_fill(msg,size);
+	rng_fill(key,key_len);
+	sha1_of(msg,size,one_shot);
+	sha1_reset(&ctx);
+	for(uint32_t off=0; off<size; )
+	{
+		uint32_t n=rng_below(size-off)+1;
+		sha1_input(&ctx,msg+off,n);
+		off+=n;
+	}
+	sha1_result(&ctx,streamed);
+	check(memcmp(one_shot,streamed,SHA1HashSize)==0,"sha1_input split",size);
+
+	hmac_sha1(key,key_len,msg,size,one_shot);
+	hmac_sha1_init(&keyed,key,key_len);
+	for(int pass=0; pass<2; pass++)
+	{
+		hmac=keyed;
+		for(uint32_t off=0; off<size; )
+		{
+			uint32_t n=rng_below(size-off)+1;
+			hmac_sha1_input(&hmac,msg+off,n);
+			off+=n;
+		}
+		hmac_sha1_result(&hmac,streamed);
+		check(memcmp(one_shot,streamed,SHA1HashSize)==0,"hmac_sha1 streamed / reused key",size);
+	}
+}
+
+/* Receives the patched image of the delta round trip */
+struct buffer_sink
+{
+	uint8_t* data;
+	uint32_t size;
+	uint32_t limit;
+};
+
+static int buffer_sink(void* ctx, const uint8_t* data, uint32_t size)
+{
+	struct buffer_sink* out=(struct buffer_sink*)ctx;
+	if(size>out->limit-out->size)
+		return -1;
+	memcpy(out->data+out->size,data,size);
+	out->size+=size;
+	return 0;
+}
+
+static int base_reader(void* ctx, uint32_t offset, uint8_t* buf, uint32_t size)
+{
+	memcpy(buf,(const uint8_t*)ctx+offset,size);
+	return 0;
+}
+
+/* Delta between a random base and an edited copy, applied in random pieces */
+static void delta_round_trip(uint8_t* base, uint8_t* target, uint8_t* patch, uint8_t* decoded)
+{
+	uint32_t base_size=rng_below(MAX_IMAGE_SIZE/2+1);
+	uint32_t target_size=base_size;
+	static struct fwdelta_patch p;
+
+	rng_fill(base,base_size);
+	memcpy(target,base,base_size);
+	for(uint32_t edits=rng_below(8); edits>0 && target_size>0; edits--)
+		rng_fill(target+rng_below(target_size),1+rng_below(40)%(target_size));
+	if(target_size>0)
+		target_size-=rng_below(target_size/4+1);
+
+	uint32_t patch_size=fwdelta_generate(base,base_size,target,target_size,patch);
+	check(patch_size>0 && patch_size<=fwdelta_bound(target_size),"fwdelta_generate size",patch_size);
+
+	struct buffer_sink out={ decoded, 0, target_size };
+	fwdelta_apply_init(&p,base_reader,base,buffer_sink,&out);
+	int status=fwdeltaSuccess;
+	for(uint32_t off=0; off<patch_size && status==fwdeltaSuccess; )
+	{
+		uint32_t n=rng_below(patch_size-off)+1;
+		status=fwdelta_apply(&p,patch+off,n);
+		off+=n;
+	}
+	if(status==fwdeltaSuccess)
+		status=fwdelta_apply_finish(&p);
+	check(status==fwdeltaSuccess && out.size==target_size && memcmp(decoded,target,target_size)==0,"fwdelta round trip",status);
+}
+
+uint32_t crypto_check(uint64_t seed, uint32_t rounds, int verbose)
+{
+	/* Room for the padding, appended IV and patch worst case of the largest inputs */
+	uint32_t room=MAX_IMAGE_SIZE*2+0x10000;
+	uint8_t* buf[4];
+	failures=0;
+	rng_state=seed ? seed : 1;
+
+	for(int i=0; i<4; i++)
+		buf[i]=(uint8_t*)malloc(room);
+	if(buf[0]==NULL || buf[1]==NULL || buf[2]==NULL || buf[3]==NULL)
+	{
+		printf("FAIL : unable to allocate the check buffers\n");
+		for(int i=0; i<4; i++)
+			free(buf[i]);
+		return 1;
+	}
+
+	known_answers();
+	if(verbose)
+		printf("# known answers : SHA1, HMAC-SHA1, HKDF-SHA1, AES key expansion, block and CBC, %u failures\n",failures);
+	for(uint32_t r=0; r<rounds; r++)
+	{
+		aes_differential(buf[0],buf[1],buf[2]);
+		hash_differential(buf[0]);
+		delta_round_trip(buf[0],buf[1],buf[2],buf[3]);
+	}
+	if(verbose)
+		printf("# differential : %u rounds of AES, SHA1/HMAC and delta round trips, seed %llu, %u failures\n",rounds,(unsigned long long)seed,failures);
+
+	for(int i=0; i<4; i++)
+		free(buf[i]);
+	return failures;
+}
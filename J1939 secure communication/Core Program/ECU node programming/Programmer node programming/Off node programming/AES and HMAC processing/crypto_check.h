@@ -0,0 +1,23 @@
+#ifndef __CRYPTO_CHECK_H__
+#define __CRYPTO_CHECK_H__
+#include<stdint.h>
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: crypto_check.h
+ * Description: This file contains the self check run by crypto_bench before any measurement, a faster routine is only worth timing once
+ *              it is known to produce the same bytes as the routines already deployed on the ECUs.
+ *              Known answers : SHA1 (FIPS 180-2), HMAC-SHA1 (RFC 2202), HKDF-SHA1 (RFC 5869), AES key expansion and block cipher (FIPS-197,
+ *              AESAVS GFSbox), AES-CBC (SP 800-38A).
+ *              Differential checks with random inputs : one shot against key expanded, chunked and streamed entry points split at random
+ *              points, and delta patches applied in random pieces. Secured containers are checked with the real tools by fw_round_trip.sh.
+ * --------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * @brief Runs every known answer check and rounds random differential checks drawn from seed.
+ * @param int verbose prints one line per check group when set, failures are always printed.
+ * @retval uint32_t number of failed checks, 0 when every routine agrees.
+ */
+uint32_t crypto_check(uint64_t seed, uint32_t rounds, int verbose);
+
+#endif /* __CRYPTO_CHECK_H__ */
@@ -0,0 +1,158 @@
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: firmware_image.c
+ * Description: Routines to build, parse and authenticate the secured firmware container header, see firmware_image.h for the layout.
+ * --------------------------------------------------------------------------------------------------
+ */
+#include<string.h>
+#include "firmware_image.h"
+
+/* Field offsets inside the fixed part of the header */
+#define OFF_MAGIC        0
+#define OFF_VERSION      4
+#define OFF_CIPHER       5
+#define OFF_MAC          6
+#define OFF_CODEC        7
+#define OFF_HEADER_SIZE  8
+#define OFF_PLAIN_SIZE   12
+#define OFF_PADDED_SIZE  16
+#define OFF_CHUNK_SIZE   20
+#define OFF_CHUNK_COUNT  24
+#define OFF_TARGET_NAME  28
+#define OFF_IV           36
+#define OFF_IMAGE_SIZE   52
+#define OFF_PAYLOAD_KIND 56
+
+static void put_le32(uint8_t* p, uint32_t v)
+{
+	p[0]=(uint8_t)v; p[1]=(uint8_t)(v>>8); p[2]=(uint8_t)(v>>16); p[3]=(uint8_t)(v>>24);
+}
+
+static uint32_t get_le32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1]<<8) | ((uint32_t)p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+uint32_t fwimg_chunk_count(uint32_t padded_size, uint32_t chunk_size)
+{
+	return (padded_size+chunk_size-1)/chunk_size;
+}
+
+uint32_t fwimg_header_size(uint32_t chunk_count)
+{
+	return FWIMG_FIXED_HEADER_SIZE+chunk_count*FWIMG_CHUNK_ENTRY_SIZE+FWIMG_TAG_SIZE;
+}
+
+void fwimg_header_init(struct fwimg_header* header, uint32_t plain_size, uint32_t chunk_size, uint64_t target_name, const uint8_t* iv)
+{
+	memset(header,0,sizeof(*header));
+	header->version=FWIMG_VERSION;
+	header->cipher_id=FWIMG_CIPHER_AES256_CBC;
+	header->mac_id=FWIMG_MAC_HMAC_SHA1;
+	header->codec_id=FWIMG_CODEC_NONE;
+	header->plain_size=plain_size;
+	header->padded_size=(plain_size/FWIMG_IV_SIZE+1)*FWIMG_IV_SIZE;        // PKCS style padding, always at least one byte
+	header->chunk_size=chunk_size;
+	header->chunk_count=fwimg_chunk_count(header->padded_size,chunk_size);
+	header->header_size=fwimg_header_size(header->chunk_count);
+	header->target_name=target_name;
+	memcpy(header->iv,iv,FWIMG_IV_SIZE);
+	header->image_size=plain_size;
+}
+
+void fwimg_write_header(const struct fwimg_header* header, uint8_t* out)
+{
+	memset(out,0,FWIMG_FIXED_HEADER_SIZE);
+	memcpy(out+OFF_MAGIC,FWIMG_MAGIC,FWIMG_MAGIC_SIZE);
+	out[OFF_VERSION]=header->version;
+	out[OFF_CIPHER]=header->cipher_id;
+	out[OFF_MAC]=header->mac_id;
+	out[OFF_CODEC]=header->codec_id;
+	put_le32(out+OFF_HEADER_SIZE,header->header_size);
+	put_le32(out+OFF_PLAIN_SIZE,header->plain_size);
+	put_le32(out+OFF_PADDED_SIZE,header->padded_size);
+	put_le32(out+OFF_CHUNK_SIZE,header->chunk_size);
+	put_le32(out+OFF_CHUNK_COUNT,header->chunk_count);
+	put_le32(out+OFF_TARGET_NAME,(uint32_t)header->target_name);
+	put_le32(out+OFF_TARGET_NAME+4,(uint32_t)(header->target_name>>32));
+	memcpy(out+OFF_IV,header->iv,FWIMG_IV_SIZE);
+	put_le32(out+OFF_IMAGE_SIZE,header->image_size);
+	out[OFF_PAYLOAD_KIND]=header->payload_kind;
+}
+
+int fwimg_read_header(const uint8_t* in, uint32_t size, struct fwimg_header* header)
+{
+	if(size<FWIMG_FIXED_HEADER_SIZE)
+		return fwimgTruncated;
+	if(memcmp(in+OFF_MAGIC,FWIMG_MAGIC,FWIMG_MAGIC_SIZE)!=0)
+		return fwimgBadMagic;
+	header->version=in[OFF_VERSION];
+	if(header->version!=FWIMG_VERSION)
+		return fwimgBadVersion;
+	header->cipher_id=in[OFF_CIPHER];
+	header->mac_id=in[OFF_MAC];
+	header->codec_id=in[OFF_CODEC];
+	if(header->cipher_id!=FWIMG_CIPHER_AES256_CBC || header->mac_id!=FWIMG_MAC_HMAC_SHA1 || (header->codec_id!=FWIMG_CODEC_NONE && header->codec_id!=FWIMG_CODEC_LZSS))
+		return fwimgUnsupported;
+	header->header_size=get_le32(in+OFF_HEADER_SIZE);
+	header->plain_size=get_le32(in+OFF_PLAIN_SIZE);
+	header->padded_size=get_le32(in+OFF_PADDED_SIZE);
+	header->chunk_size=get_le32(in+OFF_CHUNK_SIZE);
+	header->chunk_count=get_le32(in+OFF_CHUNK_COUNT);
+	header->target_name=(uint64_t)get_le32(in+OFF_TARGET_NAME) | ((uint64_t)get_le32(in+OFF_TARGET_NAME+4)<<32);
+	memcpy(header->iv,in+OFF_IV,FWIMG_IV_SIZE);
+	header->image_size=get_le32(in+OFF_IMAGE_SIZE);
+	header->payload_kind=in[OFF_PAYLOAD_KIND];
+	if(header->payload_kind!=FWIMG_PAYLOAD_IMAGE && header->payload_kind!=FWIMG_PAYLOAD_DELTA)
+		return fwimgUnsupported;
+
+	/* Sizes are checked before anything is indexed with them */
+	if(header->chunk_size==0 || header->chunk_size%FWIMG_IV_SIZE!=0 || header->padded_size==0 || header->padded_size%FWIMG_IV_SIZE!=0
+	   || header->plain_size>FWIMG_MAX_PLAIN_SIZE || header->plain_size>=header->padded_size || header->padded_size-header->plain_size>FWIMG_IV_SIZE
+	   || header->chunk_count!=fwimg_chunk_count(header->padded_size,header->chunk_size)
+	   || header->header_size!=fwimg_header_size(header->chunk_count)
+	   || (header->codec_id==FWIMG_CODEC_NONE && header->image_size!=header->plain_size))
+		return fwimgBadLayout;
+	return fwimgSuccess;
+}
+
+void fwimg_write_chunk(uint8_t* header_bytes, uint32_t index, const struct fwimg_chunk* chunk)
+{
+	uint8_t* entry=header_bytes+FWIMG_FIXED_HEADER_SIZE+index*FWIMG_CHUNK_ENTRY_SIZE;
+	put_le32(entry,chunk->offset);
+	put_le32(entry+4,chunk->size);
+	memcpy(entry+8,chunk->tag,FWIMG_TAG_SIZE);
+}
+
+void fwimg_read_chunk(const uint8_t* header_bytes, uint32_t index, struct fwimg_chunk* chunk)
+{
+	const uint8_t* entry=header_bytes+FWIMG_FIXED_HEADER_SIZE+index*FWIMG_CHUNK_ENTRY_SIZE;
+	chunk->offset=get_le32(entry);
+	chunk->size=get_le32(entry+4);
+	memcpy(chunk->tag,entry+8,FWIMG_TAG_SIZE);
+}
+
+void fwimg_chunk_tag(const struct hmac_sha1* key, uint32_t index, const uint8_t* data, uint32_t size, uint8_t tag[FWIMG_TAG_SIZE])
+{
+	struct hmac_sha1 ctx=*key;
+	uint8_t le_index[4];
+	put_le32(le_index,index);
+	hmac_sha1_input(&ctx,le_index,sizeof(le_index));
+	hmac_sha1_input(&ctx,data,size);
+	hmac_sha1_result(&ctx,tag);
+}
+
+void fwimg_header_tag(const struct hmac_sha1* key, const uint8_t* header_bytes, uint32_t header_size, uint8_t tag[FWIMG_TAG_SIZE])
+{
+	struct hmac_sha1 ctx=*key;
+	hmac_sha1_input(&ctx,header_bytes,header_size-FWIMG_TAG_SIZE);
+	hmac_sha1_result(&ctx,tag);
+}
+
+int fwimg_tag_compare(const uint8_t* a, const uint8_t* b)
+{
+	uint8_t diff=0;
+	for(uint32_t i=0; i<FWIMG_TAG_SIZE; i++)
+		diff|=a[i]^b[i];
+	return diff;
+}
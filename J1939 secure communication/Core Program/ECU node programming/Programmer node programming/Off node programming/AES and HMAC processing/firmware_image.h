@@ -0,0 +1,150 @@
+#ifndef __FIRMWARE_IMAGE_H__
+#define __FIRMWARE_IMAGE_H__
+#include<stdint.h>
+#include "hmac.h"
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: firmware_image.h
+ * Description: This file contains the layout of the secured firmware container and the routines used to build and parse its header, the same
+ *              routines are meant to be used by the off node tools, the programmer node and the receiver node.
+ * --------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * Secured firmware container layout, every multi byte field is little endian :
+ *     ____________________________________________________________________________________
+ *    | header (fixed part, FWIMG_FIXED_HEADER_SIZE bytes)                                  |
+ *    |   magic "SFWI" | version | cipher id | MAC id | codec id | header size               |
+ *    |   plain size | padded size | chunk size | chunk count | target ECU NAME | IV        |
+ *    |   image size | payload kind | rsvd                                                |
+ *    |------------------------------------------------------------------------------------|
+ *    | chunk table, chunk count entries of FWIMG_CHUNK_ENTRY_SIZE bytes                     |
+ *    |   file offset of the chunk | chunk size | HMAC(chunk index | chunk cipher text)      |
+ *    |------------------------------------------------------------------------------------|
+ *    | header tag, HMAC of every header byte before it                                     |
+ *    |------------------------------------------------------------------------------------|
+ *    | cipher text, padded size bytes of AES-CBC output split in chunk size pieces         |
+ *    |------------------------------------------------------------------------------------|
+ *    | image tag, HMAC of header and cipher text                                           |
+ *    |____________________________________________________________________________________|
+ *
+ *    The cipher text is a single CBC chain, chunk k is decrypted with the last cipher block of chunk k-1 (or the IV for chunk 0) as its IV,
+ *    thus a reader can verify and decrypt any chunk on its own, e.g. to resume an interrupted transfer at a sector boundary.
+ */
+
+#define FWIMG_MAGIC                 "SFWI"
+#define FWIMG_MAGIC_SIZE            4
+#define FWIMG_VERSION               0x02        /* 0x01 containers were encrypted by the pre FIPS-197 aes.c and are rejected */
+
+/* Algorithm identifiers */
+#define FWIMG_CIPHER_AES256_CBC     0x01
+#define FWIMG_MAC_HMAC_SHA1         0x01
+#define FWIMG_CODEC_NONE            0x00
+#define FWIMG_CODEC_LZSS            0x01        /* see lzss.h, the firmware is compressed before padding and encryption */
+
+/* Payload kinds, what the decoded payload holds */
+#define FWIMG_PAYLOAD_IMAGE         0x00        /* the complete firmware */
+#define FWIMG_PAYLOAD_DELTA         0x01        /* a patch against the installed firmware, see fwdelta.h */
+
+#define FWIMG_FIXED_HEADER_SIZE     64
+#define FWIMG_CHUNK_ENTRY_SIZE      (8+HMAC_SHA1_DIGEST_SIZE)
+#define FWIMG_TAG_SIZE              HMAC_SHA1_DIGEST_SIZE
+#define FWIMG_IV_SIZE               16
+
+/* Largest firmware a container holds, keeps every offset of the container inside 32 bits for any valid chunk size */
+#define FWIMG_MAX_PLAIN_SIZE        0x40000000
+
+/* Default chunk size, a multiple of the SD card sector and of the AES block size */
+#define FWIMG_DEFAULT_CHUNK_SIZE    4096
+
+/* Status codes */
+enum
+{
+  fwimgSuccess = 0,
+  fwimgTruncated,             /* fewer bytes than the header claims */
+  fwimgBadMagic,              /* not a secured firmware container */
+  fwimgBadVersion,            /* container version not supported */
+  fwimgUnsupported,           /* unknown cipher, MAC or codec */
+  fwimgBadLayout,             /* sizes and chunk table disagree */
+  fwimgBadTag                 /* HMAC verification failed */
+};
+
+/* Fixed part of the header in host representation */
+struct fwimg_header
+{
+  uint8_t  version;
+  uint8_t  cipher_id;
+  uint8_t  mac_id;
+  uint8_t  codec_id;
+  uint32_t header_size;       /* fixed part + chunk table + header tag */
+  uint32_t plain_size;        /* encrypted payload size before padding, i.e. the compressed size when a codec is used */
+  uint32_t padded_size;       /* cipher text size */
+  uint32_t chunk_size;        /* cipher text bytes per chunk, multiple of 16 */
+  uint32_t chunk_count;
+  uint64_t target_name;       /* 64 bit J1939 NAME of the ECU the image is built for, 0 for any */
+  uint8_t  iv[FWIMG_IV_SIZE];
+  uint32_t image_size;        /* payload size once decoded, equals plain_size without codec */
+  uint8_t  payload_kind;
+};
+
+/* One chunk table entry */
+struct fwimg_chunk
+{
+  uint32_t offset;            /* file offset of the chunk cipher text */
+  uint32_t size;
+  uint8_t  tag[FWIMG_TAG_SIZE];
+};
+
+/**
+ * @brief Returns the number of chunks needed for padded_size bytes of cipher text.
+ */
+uint32_t fwimg_chunk_count(uint32_t padded_size, uint32_t chunk_size);
+
+/**
+ * @brief Returns the complete header size (fixed part, chunk table and header tag) for chunk_count chunks.
+ */
+uint32_t fwimg_header_size(uint32_t chunk_count);
+
+/**
+ * @brief Fills header for a firmware of plain_size bytes, sizes and chunk count are derived, algorithm ids are set to AES256-CBC and HMAC-SHA1.
+ *        The codec is set to none and the payload to a complete image, a caller storing compressed data or a patch
+ *        sets codec_id, image_size and payload_kind afterwards.
+ */
+void fwimg_header_init(struct fwimg_header* header, uint32_t plain_size, uint32_t chunk_size, uint64_t target_name, const uint8_t* iv);
+
+/**
+ * @brief Serializes the fixed part of header into the first FWIMG_FIXED_HEADER_SIZE bytes of out.
+ */
+void fwimg_write_header(const struct fwimg_header* header, uint8_t* out);
+
+/**
+ * @brief Parses and checks the fixed part of a header.
+ * @param const uint8_t* in passes the address of the first header byte.
+ * @param uint32_t size passes the number of bytes available at in, at least FWIMG_FIXED_HEADER_SIZE.
+ * @retval int fwimgSuccess or a fwimg status code.
+ */
+int fwimg_read_header(const uint8_t* in, uint32_t size, struct fwimg_header* header);
+
+/**
+ * @brief Serializes / parses chunk table entry index of a header whose first byte is at header_bytes.
+ */
+void fwimg_write_chunk(uint8_t* header_bytes, uint32_t index, const struct fwimg_chunk* chunk);
+void fwimg_read_chunk(const uint8_t* header_bytes, uint32_t index, struct fwimg_chunk* chunk);
+
+/**
+ * @brief Computes the tag of chunk index, the index is authenticated along with the data so chunks cannot be reordered.
+ * @param const struct hmac_sha1* key passes a keyed HMAC context (see hmac_sha1_init), it is not modified.
+ */
+void fwimg_chunk_tag(const struct hmac_sha1* key, uint32_t index, const uint8_t* data, uint32_t size, uint8_t tag[FWIMG_TAG_SIZE]);
+
+/**
+ * @brief Computes the header tag over the header_size-FWIMG_TAG_SIZE bytes in front of it.
+ */
+void fwimg_header_tag(const struct hmac_sha1* key, const uint8_t* header_bytes, uint32_t header_size, uint8_t tag[FWIMG_TAG_SIZE]);
+
+/**
+ * @brief Constant time comparison of two tags, returns 0 when equal.
+ */
+int fwimg_tag_compare(const uint8_t* a, const uint8_t* b);
+
+#endif /* __FIRMWARE_IMAGE_H__ */
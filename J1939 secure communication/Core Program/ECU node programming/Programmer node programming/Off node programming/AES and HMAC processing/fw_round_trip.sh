@@ -0,0 +1,88 @@
+#!/bin/sh
+# Secures firmware images with the built SecureMyFirmware and unlocks them with the built UnlockMyFirmware, keys come from keygen.
+# Usage : fw_round_trip.sh <directory of the built tools> <firmware.bin>
+# Run by ctest (see CMakeLists.txt), exits with 1 on the first mismatch.
+
+TOOLS=$(cd "$1" && pwd)
+FIRMWARE=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+fail(){
+	echo "FAIL : $1"
+	exit 1
+}
+
+# UnlockMyFirmware prompts for the key paths, its output is kept in unlock.log and its exit code is returned
+unlock(){
+	printf 'AES256CBC_KEY.bin\nHMAC_KEY.bin\n' | "$TOOLS/UnlockMyFirmware" "$@" > unlock.log
+}
+
+# Overwrites the byte at offset $2 of file $1 with the value $3
+poke(){
+	printf "$(printf '\\%03o' "$3")" | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+}
+
+peek(){
+	od -An -tu1 -j "$2" -N1 "$1" | tr -d ' '
+}
+
+"$TOOLS/keygen" > /dev/null || fail "keygen"
+cp "$FIRMWARE" firmware.bin
+
+# Full image with the IV file, then compressed, each unlocked back to the firmware
+for opts in "" "-z" "-c 16"; do
+	rm -f secured_firmware.bin unlocked_secured_firmware.bin
+	"$TOOLS/SecureMyFirmware" -k AES256CBC_KEY.bin -i IV.bin -m HMAC_KEY.bin $opts firmware.bin > /dev/null || fail "SecureMyFirmware $opts"
+	unlock secured_firmware.bin || fail "UnlockMyFirmware $opts : $(tail -n 1 unlock.log)"
+	grep -q "firmware unlocked" unlock.log || fail "UnlockMyFirmware $opts : $(tail -n 1 unlock.log)"
+	cmp -s unlocked_secured_firmware.bin firmware.bin || fail "round trip $opts"
+	echo "round trip ${opts:-full image} : ok"
+done
+
+# Delta update against the installed firmware, a few bytes of the release differ
+cp firmware.bin release.bin
+poke release.bin 100 $(( ($(peek release.bin 100)+1) % 256 ))
+poke release.bin 3000 $(( ($(peek release.bin 3000)+1) % 256 ))
+"$TOOLS/SecureMyFirmware" -k AES256CBC_KEY.bin -i IV.bin -m HMAC_KEY.bin -z -b firmware.bin release.bin > /dev/null || fail "SecureMyFirmware -b"
+unlock secured_release.bin firmware.bin || fail "UnlockMyFirmware delta : $(tail -n 1 unlock.log)"
+grep -q "firmware unlocked" unlock.log || fail "UnlockMyFirmware delta : $(tail -n 1 unlock.log)"
+cmp -s unlocked_secured_release.bin release.bin || fail "delta round trip"
+echo "delta round trip : ok"
+
+# Without -i every run draws a fresh IV, the same image never gives the same container twice
+"$TOOLS/SecureMyFirmware" -k AES256CBC_KEY.bin -m HMAC_KEY.bin firmware.bin > /dev/null || fail "SecureMyFirmware random IV"
+cp secured_firmware.bin first.bin
+"$TOOLS/SecureMyFirmware" -k AES256CBC_KEY.bin -m HMAC_KEY.bin firmware.bin > /dev/null || fail "SecureMyFirmware random IV"
+cmp -s secured_firmware.bin first.bin && fail "random IV repeated"
+unlock secured_firmware.bin || fail "UnlockMyFirmware random IV : $(tail -n 1 unlock.log)"
+cmp -s unlocked_secured_firmware.bin firmware.bin || fail "random IV round trip"
+echo "random IV round trip : ok"
+
+# One IV file for several images would repeat the IV, the run is refused
+cp firmware.bin second.bin
+"$TOOLS/SecureMyFirmware" -k AES256CBC_KEY.bin -i IV.bin -m HMAC_KEY.bin firmware.bin second.bin > secure.log && fail "-i accepted for two images"
+grep -q "same IV" secure.log || fail "-i with two images : $(tail -n 1 secure.log)"
+echo "-i refused for two images : ok"
+
+# A flipped cipher text byte (the last one before the image tag) and a version 1 header must both be refused, with exit code 1 and no output file
+SIZE=$(wc -c < secured_firmware.bin)
+cp secured_firmware.bin tampered.bin
+poke tampered.bin $((SIZE-21)) $(( $(peek tampered.bin $((SIZE-21))) ^ 1 ))
+rm -f unlocked_tampered.bin
+unlock tampered.bin && fail "tampered cipher text exits with 0"
+grep -q "tampered" unlock.log || fail "tampered cipher text accepted"
+[ -e unlocked_tampered.bin ] && fail "unlocked_tampered.bin left behind"
+cp secured_firmware.bin version1.bin
+poke version1.bin 4 1
+unlock version1.bin && fail "version 1 container exits with 0"
+grep -q "status 3" unlock.log || fail "version 1 container accepted"
+echo "tampered and version 1 containers refused : ok"
+
+# A delta update on top of the wrong installed firmware fails while the output file is written, the half written file is removed
+rm -f unlocked_secured_release.bin
+unlock secured_release.bin release.bin && fail "delta on the wrong firmware exits with 0"
+[ -e unlocked_secured_release.bin ] && fail "unlocked_secured_release.bin left behind"
+echo "failed delta removed : ok"
+exit 0
@@ -0,0 +1,294 @@
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: fwdelta.c
+ * Description: Block matching delta generator (rolling hash over the target, index of the base blocks) and streaming patch apply,
+ *              see fwdelta.h for the patch format.
+ * --------------------------------------------------------------------------------------------------
+ */
+#include<stdlib.h>
+#include<string.h>
+#include "fwdelta.h"
+
+#define ROLL_MULT       0x01000193u     /* rolling hash multiplier, hash = sum of byte * ROLL_MULT^(BLOCK-1-n) */
+#define MAX_CANDIDATES  16              /* base blocks verified per hash hit */
+#define NO_BLOCK        0xFFFFFFFFu
+
+/* Apply states */
+enum { ST_HEADER = 0, ST_OPCODE, ST_ARGS, ST_DATA, ST_DONE };
+
+static void put_le32(uint8_t* p, uint32_t v)
+{
+	p[0]=(uint8_t)v; p[1]=(uint8_t)(v>>8); p[2]=(uint8_t)(v>>16); p[3]=(uint8_t)(v>>24);
+}
+
+static uint32_t get_le32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1]<<8) | ((uint32_t)p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static uint32_t block_hash(const uint8_t* p)
+{
+	uint32_t h=0;
+	for(uint32_t n=0; n<FWDELTA_BLOCK_SIZE; n++)
+		h=h*ROLL_MULT+p[n];
+	return h;
+}
+
+static void sha1_of(const uint8_t* data, uint32_t size, uint8_t digest[SHA1HashSize])
+{
+	struct sha1 ctx;
+	sha1_reset(&ctx);
+	sha1_input(&ctx,data,size);
+	sha1_result(&ctx,digest);
+}
+
+uint32_t fwdelta_bound(uint32_t target_size)
+{
+	/* A COPY replaces at least FWDELTA_BLOCK_SIZE literal bytes with fewer operation bytes, all literals is the worst case */
+	return FWDELTA_HEADER_SIZE+5+target_size;
+}
+
+static uint32_t emit_data(uint8_t* patch, uint32_t pos, const uint8_t* data, uint32_t size)
+{
+	if(size==0)
+		return pos;
+	patch[pos]=FWDELTA_OP_DATA;
+	put_le32(patch+pos+1,size);
+	memcpy(patch+pos+5,data,size);
+	return pos+5+size;
+}
+
+uint32_t fwdelta_generate(const uint8_t* base, uint32_t base_size, const uint8_t* target, uint32_t target_size, uint8_t* patch)
+{
+	uint32_t blocks=base_size/FWDELTA_BLOCK_SIZE;
+	uint32_t table_size=1;
+	while(table_size<2*blocks)
+		table_size<<=1;
+	uint32_t* head=(uint32_t*)malloc(sizeof(uint32_t)*table_size);
+	uint32_t* next=(uint32_t*)malloc(sizeof(uint32_t)*(blocks ? blocks : 1));
+	if(head==NULL || next==NULL)
+	{
+		free(head);
+		free(next);
+		return 0;
+	}
+
+	/* Index of the aligned base blocks, later blocks are pushed first so chains list the lowest offsets first */
+	memset(head,0xFF,sizeof(uint32_t)*table_size);
+	for(uint32_t b=blocks; b-->0; )
+	{
+		uint32_t slot=block_hash(base+b*FWDELTA_BLOCK_SIZE)&(table_size-1);
+		next[b]=head[slot];
+		head[slot]=b;
+	}
+
+	/* ROLL_MULT^BLOCK_SIZE, weight of the byte leaving the rolling window */
+	uint32_t out_weight=1;
+	for(uint32_t n=0; n<FWDELTA_BLOCK_SIZE; n++)
+		out_weight*=ROLL_MULT;
+
+	memcpy(patch,FWDELTA_MAGIC,FWDELTA_MAGIC_SIZE);
+	put_le32(patch+4,base_size);
+	put_le32(patch+8,target_size);
+	sha1_of(base,base_size,patch+12);
+	sha1_of(target,target_size,patch+12+SHA1HashSize);
+	uint32_t pos=FWDELTA_HEADER_SIZE;
+
+	uint32_t literal=0;         /* first target byte not yet covered by an operation */
+	uint32_t i=0;
+	uint32_t h=(target_size>=FWDELTA_BLOCK_SIZE && blocks>0) ? block_hash(target) : 0;
+	while(blocks>0 && i+FWDELTA_BLOCK_SIZE<=target_size)
+	{
+		uint32_t best_len=0, best_off=0;
+		uint32_t n=0;
+		for(uint32_t b=head[h&(table_size-1)]; b!=NO_BLOCK && n<MAX_CANDIDATES; b=next[b], n++)
+		{
+			uint32_t off=b*FWDELTA_BLOCK_SIZE;
+			if(memcmp(base+off,target+i,FWDELTA_BLOCK_SIZE)!=0)
+				continue;
+			uint32_t len=FWDELTA_BLOCK_SIZE;
+			while(off+len<base_size && i+len<target_size && base[off+len]==target[i+len])
+				len++;
+			if(len>best_len)
+			{
+				best_len=len;
+				best_off=off;
+			}
+		}
+
+		if(best_len==0)
+		{
+			/* Slide the window by one byte */
+			if(i+FWDELTA_BLOCK_SIZE<target_size)
+				h=h*ROLL_MULT-target[i]*out_weight+target[i+FWDELTA_BLOCK_SIZE];
+			i++;
+			continue;
+		}
+
+		/* Grow the match backwards over the pending literal bytes */
+		while(i>literal && best_off>0 && base[best_off-1]==target[i-1])
+		{
+			i--;
+			best_off--;
+			best_len++;
+		}
+		pos=emit_data(patch,pos,target+literal,i-literal);
+		patch[pos]=FWDELTA_OP_COPY;
+		put_le32(patch+pos+1,best_off);
+		put_le32(patch+pos+5,best_len);
+		pos+=9;
+		i+=best_len;
+		literal=i;
+		if(i+FWDELTA_BLOCK_SIZE<=target_size)
+			h=block_hash(target+i);
+	}
+	pos=emit_data(patch,pos,target+literal,target_size-literal);
+
+	free(head);
+	free(next);
+	return pos;
+}
+
+void fwdelta_apply_init(struct fwdelta_patch* p, fwdelta_read read_base, void* read_ctx, fwdelta_sink sink, void* sink_ctx)
+{
+	memset(p,0,sizeof(*p));
+	p->state=ST_HEADER;
+	p->read_base=read_base;
+	p->read_ctx=read_ctx;
+	p->sink=sink;
+	p->sink_ctx=sink_ctx;
+	sha1_reset(&p->hash);
+}
+
+/* Hands produced bytes to the sink and to the target hash */
+static int produce(struct fwdelta_patch* p, const uint8_t* data, uint32_t size)
+{
+	if(size>p->target_size-p->produced)
+		return fwdeltaBadOperation;
+	if(p->sink(p->sink_ctx,data,size)!=0)
+		return fwdeltaIOError;
+	sha1_input(&p->hash,data,size);
+	p->produced+=size;
+	return fwdeltaSuccess;
+}
+
+/* Parses the header and checks the installed image against the base SHA1 */
+static int start(struct fwdelta_patch* p)
+{
+	uint8_t base_hash[SHA1HashSize];
+	uint8_t digest[SHA1HashSize];
+	struct sha1 ctx;
+
+	if(memcmp(p->buf,FWDELTA_MAGIC,FWDELTA_MAGIC_SIZE)!=0)
+		return fwdeltaBadMagic;
+	p->base_size=get_le32(p->buf+4);
+	p->target_size=get_le32(p->buf+8);
+	memcpy(base_hash,p->buf+12,SHA1HashSize);
+	memcpy(p->target_hash,p->buf+12+SHA1HashSize,SHA1HashSize);
+
+	sha1_reset(&ctx);
+	for(uint32_t off=0; off<p->base_size; )
+	{
+		uint32_t n=(p->base_size-off<FWDELTA_COPY_BUFFER) ? p->base_size-off : FWDELTA_COPY_BUFFER;
+		if(p->read_base(p->read_ctx,off,p->buf,n)!=0)
+			return fwdeltaBaseMismatch;
+		sha1_input(&ctx,p->buf,n);
+		off+=n;
+	}
+	sha1_result(&ctx,digest);
+	if(memcmp(digest,base_hash,SHA1HashSize)!=0)
+		return fwdeltaBaseMismatch;
+	return fwdeltaSuccess;
+}
+
+/* Runs a complete COPY operation through the bounce buffer */
+static int copy(struct fwdelta_patch* p, uint32_t offset, uint32_t length)
+{
+	int status;
+	if(offset>p->base_size || length>p->base_size-offset)
+		return fwdeltaBadOperation;
+	while(length>0)
+	{
+		uint32_t n=(length<FWDELTA_COPY_BUFFER) ? length : FWDELTA_COPY_BUFFER;
+		if(p->read_base(p->read_ctx,offset,p->buf,n)!=0)
+			return fwdeltaIOError;
+		if((status=produce(p,p->buf,n))!=fwdeltaSuccess)
+			return status;
+		offset+=n;
+		length-=n;
+	}
+	return fwdeltaSuccess;
+}
+
+int fwdelta_apply(struct fwdelta_patch* p, const uint8_t* in, uint32_t size)
+{
+	int status;
+	uint32_t i=0;
+	while(i<size)
+	{
+		switch(p->state)
+		{
+		case ST_HEADER:
+			p->buf[p->have++]=in[i++];
+			if(p->have==FWDELTA_HEADER_SIZE)
+			{
+				if((status=start(p))!=fwdeltaSuccess)
+					return status;
+				p->have=0;
+				p->state=(p->target_size==0) ? ST_DONE : ST_OPCODE;
+			}
+			break;
+
+		case ST_OPCODE:
+			p->op=in[i++];
+			if(p->op!=FWDELTA_OP_COPY && p->op!=FWDELTA_OP_DATA)
+				return fwdeltaBadOperation;
+			p->have=0;
+			p->state=ST_ARGS;
+			break;
+
+		case ST_ARGS:
+			p->buf[p->have++]=in[i++];
+			if(p->op==FWDELTA_OP_DATA && p->have==4)
+			{
+				p->remaining=get_le32(p->buf);
+				if(p->remaining==0 || p->remaining>p->target_size-p->produced)
+					return fwdeltaBadOperation;
+				p->state=ST_DATA;
+			}
+			else if(p->op==FWDELTA_OP_COPY && p->have==8)
+			{
+				if((status=copy(p,get_le32(p->buf),get_le32(p->buf+4)))!=fwdeltaSuccess)
+					return status;
+				p->state=(p->produced==p->target_size) ? ST_DONE : ST_OPCODE;
+			}
+			break;
+
+		case ST_DATA:
+		{
+			/* Literal bytes go straight from the input to the sink, nothing is buffered */
+			uint32_t n=(size-i<p->remaining) ? size-i : p->remaining;
+			if((status=produce(p,in+i,n))!=fwdeltaSuccess)
+				return status;
+			i+=n;
+			p->remaining-=n;
+			if(p->remaining==0)
+				p->state=(p->produced==p->target_size) ? ST_DONE : ST_OPCODE;
+			break;
+		}
+
+		default:
+			return fwdeltaBadOperation;     /* bytes after the end of the patch */
+		}
+	}
+	return fwdeltaSuccess;
+}
+
+int fwdelta_apply_finish(struct fwdelta_patch* p)
+{
+	uint8_t digest[SHA1HashSize];
+	if(p->state!=ST_DONE)
+		return fwdeltaIncomplete;
+	sha1_result(&p->hash,digest);
+	return (memcmp(digest,p->target_hash,SHA1HashSize)==0) ? fwdeltaSuccess : fwdeltaTargetMismatch;
+}
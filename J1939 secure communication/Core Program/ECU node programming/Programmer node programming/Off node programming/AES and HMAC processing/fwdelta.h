@@ -0,0 +1,106 @@
+#ifndef __FWDELTA_H__
+#define __FWDELTA_H__
+#include<stdint.h>
+#include "sha1.h"
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: fwdelta.h
+ * Description: This file contains the binary delta (patch) generator and the streaming patch apply routine, an incremental release
+ *              is sent as the difference against the image already installed on the ECU instead of the full firmware.
+ *              The apply routine needs FWDELTA_COPY_BUFFER bytes plus a SHA1 context of RAM whatever the image size, it suits the receiver node.
+ * --------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * Patch format, every multi byte field is little endian :
+ *     header   : magic "SFWD" | base size | target size | SHA1 of the base image | SHA1 of the target image
+ *     operations until target size bytes are produced :
+ *         FWDELTA_OP_COPY | base offset | length       copies length bytes of the base image
+ *         FWDELTA_OP_DATA | length | length bytes      literal bytes of the target image
+ * The patch applies only to the base image whose SHA1 it carries, and the produced image is checked against the target SHA1.
+ */
+
+#define FWDELTA_MAGIC           "SFWD"
+#define FWDELTA_MAGIC_SIZE      4
+#define FWDELTA_HEADER_SIZE     (FWDELTA_MAGIC_SIZE+4+4+2*SHA1HashSize)
+
+#define FWDELTA_OP_COPY         0x01
+#define FWDELTA_OP_DATA         0x02
+
+/* Matching granularity of the generator, the smallest run of the base image reused by a COPY */
+#define FWDELTA_BLOCK_SIZE      32
+
+/* Bounce buffer used by the apply routine to move COPY data from the base image to the output */
+#define FWDELTA_COPY_BUFFER     256
+
+/* Status codes */
+enum
+{
+  fwdeltaSuccess = 0,
+  fwdeltaBadMagic,            /* not a patch */
+  fwdeltaBaseMismatch,        /* the installed image is not the one the patch was built against */
+  fwdeltaBadOperation,        /* unknown operation or out of range copy/length */
+  fwdeltaIncomplete,          /* patch ended before the target image was complete */
+  fwdeltaTargetMismatch,      /* the produced image does not match the target SHA1 */
+  fwdeltaIOError              /* a read or sink callback reported an error */
+};
+
+/**
+ * @brief Reads size bytes of the installed (base) image from offset into buf, returns 0 on success.
+ */
+typedef int (*fwdelta_read)(void* ctx, uint32_t offset, uint8_t* buf, uint32_t size);
+
+/**
+ * @brief Receives the produced image in order, returns 0 to continue.
+ */
+typedef int (*fwdelta_sink)(void* ctx, const uint8_t* data, uint32_t size);
+
+/* Streaming apply state */
+struct fwdelta_patch
+{
+  uint8_t  buf[FWDELTA_COPY_BUFFER];   /* header, operation arguments and COPY bounce buffer */
+  uint32_t have;              /* bytes collected in buf for the current field */
+  uint8_t  state;
+  uint8_t  op;
+  uint32_t remaining;         /* literal bytes left in the current DATA operation */
+  uint32_t base_size;
+  uint32_t target_size;
+  uint32_t produced;
+  uint8_t  target_hash[SHA1HashSize];
+  struct sha1 hash;           /* SHA1 of the produced image */
+  fwdelta_read read_base;
+  void*    read_ctx;
+  fwdelta_sink sink;
+  void*    sink_ctx;
+};
+
+/**
+ * @brief Returns the largest patch size for a target image of target_size bytes.
+ */
+uint32_t fwdelta_bound(uint32_t target_size);
+
+/**
+ * @brief Builds the patch turning base into target.
+ * @param uint8_t* patch passes the address of fwdelta_bound(target_size) bytes receiving the patch.
+ * @retval uint32_t patch size, 0 if memory for the base index could not be allocated.
+ */
+uint32_t fwdelta_generate(const uint8_t* base, uint32_t base_size, const uint8_t* target, uint32_t target_size, uint8_t* patch);
+
+/**
+ * @brief Prepares to apply a patch, read_base gives access to the installed image and sink receives the new one.
+ */
+void fwdelta_apply_init(struct fwdelta_patch* p, fwdelta_read read_base, void* read_ctx, fwdelta_sink sink, void* sink_ctx);
+
+/**
+ * @brief Applies the next size bytes of the patch, the patch can be split at any byte.
+ *        The base image is hashed and checked as soon as the patch header is complete, before any output is produced.
+ * @retval int fwdeltaSuccess or a fwdelta status code.
+ */
+int fwdelta_apply(struct fwdelta_patch* p, const uint8_t* in, uint32_t size);
+
+/**
+ * @brief Checks that the whole target image was produced and matches its SHA1, to be called once the patch has been fed.
+ */
+int fwdelta_apply_finish(struct fwdelta_patch* p);
+
+#endif /* __FWDELTA_H__ */
@@ -1,45 +1,55 @@
 #include "hmac.h"
 
-/* function doing the HMAC-SHA-1 calculation */
-void hmac_sha1(const uint8_t* key, const uint32_t keysize, const uint8_t* msg, const uint32_t msgsize, uint8_t* output)
+/* absorbs the ipad/opad key blocks, keys longer than a block are hashed first */
+void hmac_sha1_init(struct hmac_sha1* ctx, const uint8_t* key, const uint32_t keysize)
 {
-  struct sha1 outer, inner;
-  uint8_t tmp;
+  uint8_t new_key[HMAC_SHA1_DIGEST_SIZE];
+  uint8_t pad[HMAC_SHA1_BLOCK_SIZE];
+  uint32_t i;
 
   if (keysize > HMAC_SHA1_BLOCK_SIZE) // if len(key) > blocksize(sha1) => key = sha1(key)
   {
-    uint8_t new_key[HMAC_SHA1_DIGEST_SIZE];
-    sha1_reset(&outer);
-    sha1_input(&outer, key, keysize);
-    sha1_result(&outer, new_key);
-    return hmac_sha1(new_key, HMAC_SHA1_DIGEST_SIZE, msg, msgsize, output);
-  } 
-  sha1_reset(&outer);
-  sha1_reset(&inner);
+    sha1_reset(&ctx->outer);
+    sha1_input(&ctx->outer, key, keysize);
+    sha1_result(&ctx->outer, new_key);
+    hmac_sha1_init(ctx, new_key, HMAC_SHA1_DIGEST_SIZE);
+    return;
+  }
+  sha1_reset(&ctx->outer);
+  sha1_reset(&ctx->inner);
 
-  uint32_t i;
-  for (i = 0; i < keysize; ++i)
+  for (i = 0; i < HMAC_SHA1_BLOCK_SIZE; ++i)
   {
-    tmp = key[i] ^ 0x5C;
-    sha1_input(&outer, &tmp, 1);
-    tmp = key[i] ^ 0x36;
-    sha1_input(&inner, &tmp, 1);
+    pad[i] = (i < keysize ? key[i] : 0x00) ^ 0x36;
   }
-  for (; i < HMAC_SHA1_BLOCK_SIZE; ++i)
+  sha1_input(&ctx->inner, pad, HMAC_SHA1_BLOCK_SIZE);
+
+  for (i = 0; i < HMAC_SHA1_BLOCK_SIZE; ++i)
   {
-    tmp = 0x5C;
-    sha1_input(&outer, &tmp, 1);
-    tmp = 0x36;
-    sha1_input(&inner, &tmp, 1);
+    pad[i] = (i < keysize ? key[i] : 0x00) ^ 0x5C;
   }
+  sha1_input(&ctx->outer, pad, HMAC_SHA1_BLOCK_SIZE);
+}
 
-  sha1_input(&inner, msg, msgsize);
-  sha1_result(&inner, output);
-
-  sha1_input(&outer, output, HMAC_SHA1_DIGEST_SIZE);
-  sha1_result(&outer, output);
+void hmac_sha1_input(struct hmac_sha1* ctx, const uint8_t* msg, const uint32_t msgsize)
+{
+  sha1_input(&ctx->inner, msg, msgsize);
 }
 
+void hmac_sha1_result(struct hmac_sha1* ctx, uint8_t* output)
+{
+  sha1_result(&ctx->inner, output);
 
+  sha1_input(&ctx->outer, output, HMAC_SHA1_DIGEST_SIZE);
+  sha1_result(&ctx->outer, output);
+}
 
+/* function doing the HMAC-SHA-1 calculation */
+void hmac_sha1(const uint8_t* key, const uint32_t keysize, const uint8_t* msg, const uint32_t msgsize, uint8_t* output)
+{
+  struct hmac_sha1 ctx;
 
+  hmac_sha1_init(&ctx, key, keysize);
+  hmac_sha1_input(&ctx, msg, msgsize);
+  hmac_sha1_result(&ctx, output);
+}
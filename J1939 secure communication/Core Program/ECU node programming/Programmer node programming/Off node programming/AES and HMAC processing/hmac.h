@@ -7,6 +7,18 @@
 #define HMAC_SHA1_DIGEST_SIZE 20
 #define HMAC_SHA1_BLOCK_SIZE  64
 
+/*
+ * Keyed HMAC-SHA1 context, holds the inner and outer SHA1 states after
+ * the ipad/opad key blocks have been absorbed. A context returned by
+ * hmac_sha1_init() can be copied by value and reused for any number of
+ * messages, so the key pads are hashed only once per key.
+ */
+struct hmac_sha1
+{
+  struct sha1 inner;
+  struct sha1 outer;
+};
+
 /***********************************************************************'
  * HMAC(K,m)      : HMAC SHA1
  * @param key     : secret key
@@ -17,7 +29,15 @@
  */
 void hmac_sha1(const uint8_t* key, const uint32_t keysize, const uint8_t* msg, const uint32_t msgsize, uint8_t* output);
 
-
-#endif /* __HMAC_H__ */
+/***********************************************************************'
+ * Streaming HMAC SHA1
+ * hmac_sha1_init   : absorbs the key pads into ctx
+ * hmac_sha1_input  : feeds the next portion of the message
+ * hmac_sha1_result : writes the 20 byte code to output, ctx is consumed
+ */
+void hmac_sha1_init(struct hmac_sha1* ctx, const uint8_t* key, const uint32_t keysize);
+void hmac_sha1_input(struct hmac_sha1* ctx, const uint8_t* msg, const uint32_t msgsize);
+void hmac_sha1_result(struct hmac_sha1* ctx, uint8_t* output);
 
 
+#endif /* __HMAC_H__ */
@@ -0,0 +1,231 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<sys/stat.h>
+
+#include "keystore.h"
+
+#define MAX_LINE_LEN 64
+
+/* Material drawn from the CSPRNG for one key set, the signing tools draw the IVs per image */
+#define KEYSET_RANDOM_SIZE (KEYSTORE_AES_KEY_SIZE+KEYSTORE_HMAC_KEY_SIZE)
+
+
+/* Fills buf from the OS CSPRNG. */
+static int random_bytes(uint8_t* buf, size_t size){
+	if(keystore_random(buf,size)<0){
+		printf("Error : getrandom failed (%s)\n",strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Key files are readable by their owner only, whatever the umask, an existing file is truncated and its mode reset first. */
+static int write_file(const char* file, const uint8_t* data, size_t size){
+	int fd=open(file,O_WRONLY|O_CREAT|O_TRUNC,0600);
+	FILE* fptr=(fd<0 || fchmod(fd,0600)!=0) ? NULL : fdopen(fd,"wb");
+	if(fptr==NULL){
+		printf("Error : Unable to create new file %s (%s)\n",file,strerror(errno));
+		if(fd>=0){
+			close(fd);
+		}
+		return -1;
+	}
+	int status=(fwrite(data,sizeof(uint8_t),size,fptr)==size) ? 0 : -1;
+	if(fclose(fptr)!=0){
+		status=-1;
+	}
+	if(status<0){
+		printf("Error : Unable to write to %s file\n",file);
+	}
+	return status;
+}
+
+/* Same outputs as keygen.py : one key set in AES256CBC_KEY.bin, IV.bin and HMAC_KEY.bin. */
+static int single_keyset(void){
+	uint8_t keyset[KEYSET_RANDOM_SIZE+AES_BLOCKSIZE];
+	int status=-1;
+	if(random_bytes(keyset,sizeof(keyset))==0
+		&& write_file("AES256CBC_KEY.bin",keyset,KEYSTORE_AES_KEY_SIZE)==0
+		&& write_file("HMAC_KEY.bin",keyset+KEYSTORE_AES_KEY_SIZE,KEYSTORE_HMAC_KEY_SIZE)==0
+		&& write_file("IV.bin",keyset+KEYSET_RANDOM_SIZE,AES_BLOCKSIZE)==0){
+		status=0;
+	}
+	memset(keyset,0,sizeof(keyset));
+	return status;
+}
+
+/* Master secret the per ECU keys are derived from (see keystore_derive). */
+static int master_secret(const char* file){
+	uint8_t master[KEYSTORE_AES_KEY_SIZE];
+	int status=(random_bytes(master,sizeof(master))==0) ? write_file(file,master,sizeof(master)) : -1;
+	memset(master,0,sizeof(master));
+	return status;
+}
+
+static int compare_identity(const void* a, const void* b){
+	uint32_t x=*(const uint32_t*)a, y=*(const uint32_t*)b;
+	return (x>y)-(x<y);
+}
+
+/* Reads one identity number per line ('#' starts a comment), decimal or 0x prefixed hexadecimal. */
+static int read_identities(const char* file, uint32_t** ids, size_t* count){
+	FILE* fptr=fopen(file,"r");
+	if(fptr==NULL){
+		printf("Error : Unable to open %s\n",file);
+		return -1;
+	}
+	size_t capacity=0;
+	char line[MAX_LINE_LEN];
+	while(fgets(line,sizeof(line),fptr)!=NULL){
+		line[strcspn(line,"#\r\n")]='\0';
+		char* end;
+		unsigned long id=strtoul(line,&end,0);
+		if(end==line){
+			continue;	/* empty or comment line */
+		}
+		if(id>KEYSTORE_MAX_IDENTITY){
+			printf("Error : Identity number %s is wider than 21 bits\n",line);
+			fclose(fptr);
+			return -1;
+		}
+		if(*count==capacity){
+			capacity=(capacity==0) ? 1024 : 2*capacity;
+			uint32_t* grown=(uint32_t*)realloc(*ids,sizeof(uint32_t)*capacity);
+			if(grown==NULL){
+				printf("Error : Out of memory while reading %s\n",file);
+				fclose(fptr);
+				return -1;
+			}
+			*ids=grown;
+		}
+		(*ids)[(*count)++]=(uint32_t)id;
+	}
+	fclose(fptr);
+	return 0;
+}
+
+/* Draws a key set for every identity number and writes them sorted into a keystore (see keystore.h). */
+static int bulk_keystore(const char* file, uint32_t* ids, size_t count){
+	qsort(ids,count,sizeof(uint32_t),compare_identity);
+	for(size_t i=1;i<count;i++){
+		if(ids[i]==ids[i-1]){
+			printf("Error : Identity number %u is listed twice\n",ids[i]);
+			return -1;
+		}
+	}
+
+	/* The random material of every key set is drawn in as few getrandom() calls as possible */
+	size_t size=KEYSTORE_HEADER_SIZE+count*KEYSTORE_ENTRY_SIZE;
+	uint8_t* store=(uint8_t*)malloc(size);
+	uint8_t* random=(uint8_t*)malloc(count*KEYSET_RANDOM_SIZE);
+	if(store==NULL || random==NULL){
+		printf("Error : Unable to allocate %zu key sets\n",count);
+		free(store);
+		free(random);
+		return -1;
+	}
+	int status=random_bytes(random,count*KEYSET_RANDOM_SIZE);
+	if(status==0){
+		keystore_write_header(store,(uint32_t)count);
+		for(size_t i=0;i<count;i++){
+			struct keystore_keys keys;
+			const uint8_t* r=random+i*KEYSET_RANDOM_SIZE;
+			memset(&keys,0,sizeof(keys));
+			keys.identity_number=ids[i];
+			keys.hmac_key_len=KEYSTORE_HMAC_KEY_SIZE;
+			memcpy(keys.aes_key,r,KEYSTORE_AES_KEY_SIZE);
+			memcpy(keys.hmac_key,r+KEYSTORE_AES_KEY_SIZE,KEYSTORE_HMAC_KEY_SIZE);
+			keystore_write_entry(store+KEYSTORE_HEADER_SIZE+i*KEYSTORE_ENTRY_SIZE,&keys);
+			memset(&keys,0,sizeof(keys));
+		}
+		status=write_file(file,store,size);
+	}
+	if(status==0){
+		printf("Wrote %zu key sets to %s (%zu bytes)\n",count,file,size);
+	}
+	memset(random,0,count*KEYSET_RANDOM_SIZE);
+	memset(store,0,size);
+	free(random);
+	free(store);
+	return status;
+}
+
+static void usage(const char* prog){
+	printf("Usage : %s                                     writes one key set to AES256CBC_KEY.bin, IV.bin and HMAC_KEY.bin\n",prog);
+	printf("        %s -o <keystore> -f <first id> -n <count> one key set per identity number from first id to first id + count - 1\n",prog);
+	printf("        %s -o <keystore> -l <identity list>       one key set per identity number listed (one per line, '#' starts a comment)\n",prog);
+	printf("        %s -m <master secret>                    writes a master secret, the signing tools derive the key set of any ECU from it\n",prog);
+	printf("  Identity numbers are the 21 bit J1939 NAME identity numbers (0 to %u) of the target ECUs.\n",KEYSTORE_MAX_IDENTITY);
+}
+
+int main(int argc, char** argv){
+	const char* output=NULL;
+	const char* list=NULL;
+	const char* master=NULL;
+	unsigned long first=0;
+	unsigned long count=0;
+	int opt;
+
+	if(argc==1){
+		return single_keyset()<0 ? 1 : 0;
+	}
+	while((opt=getopt(argc,argv,"o:f:n:l:m:"))!=-1){
+		switch(opt){
+		case 'o':
+			output=optarg;
+			break;
+		case 'f':
+			first=strtoul(optarg,NULL,0);
+			break;
+		case 'n':
+			count=strtoul(optarg,NULL,0);
+			break;
+		case 'l':
+			list=optarg;
+			break;
+		case 'm':
+			master=optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(master!=NULL && output==NULL && list==NULL && count==0 && optind==argc){
+		return master_secret(master)<0 ? 1 : 0;
+	}
+	if(output==NULL || optind!=argc || (list==NULL && (count==0 || first>KEYSTORE_MAX_IDENTITY || count>KEYSTORE_MAX_IDENTITY+1-first))){
+		usage(argv[0]);
+		return 1;
+	}
+
+	uint32_t* ids=NULL;
+	size_t total=0;
+	if(list!=NULL){
+		if(read_identities(list,&ids,&total)<0){
+			free(ids);
+			return 1;
+		}
+		if(total==0){
+			printf("Error : %s lists no identity number\n",list);
+			return 1;
+		}
+	}else{
+		ids=(uint32_t*)malloc(sizeof(uint32_t)*count);
+		if(ids==NULL){
+			printf("Error : Out of memory\n");
+			return 1;
+		}
+		for(total=0;total<count;total++){
+			ids[total]=(uint32_t)(first+total);
+		}
+	}
+	int status=bulk_keystore(output,ids,total);
+	free(ids);
+	return status<0 ? 1 : 0;
+}
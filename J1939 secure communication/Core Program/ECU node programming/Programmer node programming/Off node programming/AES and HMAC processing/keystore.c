@@ -0,0 +1,351 @@
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: keystore.c
+ * Description: Mapping and lookup of the per ECU keystore, see keystore.h for the file layout.
+ * --------------------------------------------------------------------------------------------------
+ */
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/random.h>
+#include "keystore.h"
+
+/* Entry field offsets */
+#define ENTRY_IDENTITY      0
+#define ENTRY_HMAC_LEN      4
+#define ENTRY_AES_KEY       8
+#define ENTRY_RESERVED      (ENTRY_AES_KEY+KEYSTORE_AES_KEY_SIZE)    /* 16 bytes, zero */
+#define ENTRY_HMAC_KEY      (ENTRY_RESERVED+16)
+
+static void put_le32(uint8_t* p, uint32_t v)
+{
+	p[0]=(uint8_t)v; p[1]=(uint8_t)(v>>8); p[2]=(uint8_t)(v>>16); p[3]=(uint8_t)(v>>24);
+}
+
+static uint32_t get_le32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1]<<8) | ((uint32_t)p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+int keystore_open(struct keystore* ks, const char* path)
+{
+	struct stat st;
+	int status=keystoreSuccess;
+
+	memset(ks,0,sizeof(*ks));
+	int fd=open(path,O_RDONLY);
+	if(fd<0)
+		return keystoreIOError;
+	if(fstat(fd,&st)!=0)
+	{
+		close(fd);
+		return keystoreIOError;
+	}
+	if(st.st_size<KEYSTORE_HEADER_SIZE)
+	{
+		close(fd);
+		return keystoreBadLayout;
+	}
+	void* map=mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(map==MAP_FAILED)
+		return keystoreIOError;
+
+	const uint8_t* in=(const uint8_t*)map;
+	uint32_t count=get_le32(in+8);
+	if(memcmp(in,KEYSTORE_MAGIC,KEYSTORE_MAGIC_SIZE)!=0)
+		status=keystoreBadMagic;
+	else if(in[4]!=KEYSTORE_VERSION)
+		status=keystoreBadVersion;
+	else if(get_le32(in+12)!=KEYSTORE_ENTRY_SIZE || (uint64_t)st.st_size!=KEYSTORE_HEADER_SIZE+(uint64_t)count*KEYSTORE_ENTRY_SIZE)
+		status=keystoreBadLayout;
+	if(status!=keystoreSuccess)
+	{
+		munmap(map,(size_t)st.st_size);
+		return status;
+	}
+
+	/* Lookups walk the entries in a random order */
+	madvise(map,(size_t)st.st_size,MADV_RANDOM);
+	ks->map=in;
+	ks->map_size=(size_t)st.st_size;
+	ks->count=count;
+	return keystoreSuccess;
+}
+
+void keystore_close(struct keystore* ks)
+{
+	if(ks->map!=NULL)
+		munmap((void*)ks->map,ks->map_size);
+	memset(ks,0,sizeof(*ks));
+}
+
+int keystore_lookup(const struct keystore* ks, uint32_t identity_number, struct keystore_keys* keys)
+{
+	uint32_t lo=0, hi=ks->count;
+	while(lo<hi)
+	{
+		uint32_t mid=lo+(hi-lo)/2;
+		const uint8_t* entry=ks->map+KEYSTORE_HEADER_SIZE+(size_t)mid*KEYSTORE_ENTRY_SIZE;
+		uint32_t id=get_le32(entry+ENTRY_IDENTITY);
+		if(id<identity_number)
+			lo=mid+1;
+		else if(id>identity_number)
+			hi=mid;
+		else
+		{
+			keys->identity_number=id;
+			keys->hmac_key_len=get_le32(entry+ENTRY_HMAC_LEN);
+			if(keys->hmac_key_len==0 || keys->hmac_key_len>KEYSTORE_HMAC_KEY_MAXLEN)
+				return keystoreBadLayout;
+			memcpy(keys->aes_key,entry+ENTRY_AES_KEY,KEYSTORE_AES_KEY_SIZE);
+			memcpy(keys->hmac_key,entry+ENTRY_HMAC_KEY,KEYSTORE_HMAC_KEY_MAXLEN);
+			return keystoreSuccess;
+		}
+	}
+	return keystoreNotFound;
+}
+
+int keystore_random(uint8_t* buf, size_t size)
+{
+	/* getrandom() returns at most 32 MB per call and may be interrupted by a signal */
+	while(size>0)
+	{
+		ssize_t n=getrandom(buf,size,0);
+		if(n<0)
+		{
+			if(errno==EINTR)
+				continue;
+			return -1;
+		}
+		buf+=n;
+		size-=(size_t)n;
+	}
+	return 0;
+}
+
+void keystore_write_header(uint8_t* out, uint32_t count)
+{
+	memset(out,0,KEYSTORE_HEADER_SIZE);
+	memcpy(out,KEYSTORE_MAGIC,KEYSTORE_MAGIC_SIZE);
+	out[4]=KEYSTORE_VERSION;
+	put_le32(out+8,count);
+	put_le32(out+12,KEYSTORE_ENTRY_SIZE);
+}
+
+void keystore_write_entry(uint8_t* out, const struct keystore_keys* keys)
+{
+	memset(out,0,KEYSTORE_ENTRY_SIZE);
+	put_le32(out+ENTRY_IDENTITY,keys->identity_number);
+	put_le32(out+ENTRY_HMAC_LEN,keys->hmac_key_len);
+	memcpy(out+ENTRY_AES_KEY,keys->aes_key,KEYSTORE_AES_KEY_SIZE);
+	memcpy(out+ENTRY_HMAC_KEY,keys->hmac_key,keys->hmac_key_len);
+}
+
+/* HKDF extract, prk receives the HMAC context keyed with the pseudo random key */
+static void hkdf_extract(const uint8_t* salt, uint32_t salt_len, const uint8_t* ikm, uint32_t ikm_len, struct hmac_sha1* prk)
+{
+	static const uint8_t zero_salt[HMAC_SHA1_DIGEST_SIZE]={0};
+	uint8_t key[HMAC_SHA1_DIGEST_SIZE];
+
+	if(salt==NULL || salt_len==0)
+	{
+		salt=zero_salt;
+		salt_len=sizeof(zero_salt);
+	}
+	hmac_sha1(salt,salt_len,ikm,ikm_len,key);
+	hmac_sha1_init(prk,key,HMAC_SHA1_DIGEST_SIZE);
+	memset(key,0,sizeof(key));
+}
+
+/* HKDF expand, T(n) = HMAC(PRK, T(n-1) | info | n), the keyed PRK context is copied for every block */
+static void hkdf_expand(const struct hmac_sha1* prk, const uint8_t* info, uint32_t info_len, uint8_t* okm, uint32_t okm_len)
+{
+	uint8_t t[HMAC_SHA1_DIGEST_SIZE];
+	for(uint8_t n=1; okm_len>0; n++)
+	{
+		struct hmac_sha1 ctx=*prk;
+		if(n>1)
+			hmac_sha1_input(&ctx,t,HMAC_SHA1_DIGEST_SIZE);
+		hmac_sha1_input(&ctx,info,info_len);
+		hmac_sha1_input(&ctx,&n,1);
+		hmac_sha1_result(&ctx,t);
+		uint32_t len=(okm_len<HMAC_SHA1_DIGEST_SIZE) ? okm_len : HMAC_SHA1_DIGEST_SIZE;
+		memcpy(okm,t,len);
+		okm+=len;
+		okm_len-=len;
+	}
+	memset(t,0,sizeof(t));
+}
+
+void keystore_hkdf(const uint8_t* salt, uint32_t salt_len, const uint8_t* ikm, uint32_t ikm_len, const uint8_t* info, uint32_t info_len, uint8_t* okm, uint32_t okm_len)
+{
+	struct hmac_sha1 prk;
+	hkdf_extract(salt,salt_len,ikm,ikm_len,&prk);
+	hkdf_expand(&prk,info,info_len,okm,okm_len);
+	memset(&prk,0,sizeof(prk));
+}
+
+void keystore_deriver_init(struct keystore_deriver* d, const uint8_t* master, uint32_t master_len)
+{
+	hkdf_extract(NULL,0,master,master_len,&d->prk);
+}
+
+void keystore_derive(const struct keystore_deriver* d, uint32_t identity_number, uint16_t manufacturer_code, struct keystore_keys* keys)
+{
+	uint8_t info[KEYSTORE_HKDF_INFO_SIZE+6];
+	uint8_t okm[KEYSTORE_DERIVED_SIZE];
+
+	memcpy(info,KEYSTORE_HKDF_INFO,KEYSTORE_HKDF_INFO_SIZE);
+	put_le32(info+KEYSTORE_HKDF_INFO_SIZE,identity_number);
+	info[KEYSTORE_HKDF_INFO_SIZE+4]=(uint8_t)manufacturer_code;
+	info[KEYSTORE_HKDF_INFO_SIZE+5]=(uint8_t)(manufacturer_code>>8);
+	hkdf_expand(&d->prk,info,sizeof(info),okm,KEYSTORE_DERIVED_SIZE);
+
+	memset(keys,0,sizeof(*keys));
+	keys->identity_number=identity_number;
+	keys->hmac_key_len=KEYSTORE_HMAC_KEY_SIZE;
+	memcpy(keys->aes_key,okm,KEYSTORE_AES_KEY_SIZE);
+	memcpy(keys->hmac_key,okm+KEYSTORE_AES_KEY_SIZE,KEYSTORE_HMAC_KEY_SIZE);
+	memset(okm,0,sizeof(okm));
+}
+
+void keystore_schedule_init(struct keystore_schedule* schedule, const struct keystore_keys* keys)
+{
+	AES_ExpandKey(AES256,keys->aes_key,schedule->ExpKey);
+	hmac_sha1_init(&schedule->hmac,keys->hmac_key,keys->hmac_key_len);
+}
+
+static uint32_t cache_bucket(const struct keystore_cache* cache, uint32_t key)
+{
+	return (key*2654435761u>>7)&cache->bucket_mask;
+}
+
+/* Unlinks entry e from the LRU list */
+static void lru_unlink(struct keystore_cache* cache, int32_t e)
+{
+	struct keystore_cache_entry* entry=&cache->entries[e];
+	if(entry->newer>=0)
+		cache->entries[entry->newer].older=entry->older;
+	else
+		cache->newest=entry->older;
+	if(entry->older>=0)
+		cache->entries[entry->older].newer=entry->newer;
+	else
+		cache->oldest=entry->newer;
+}
+
+static void lru_push_newest(struct keystore_cache* cache, int32_t e)
+{
+	struct keystore_cache_entry* entry=&cache->entries[e];
+	entry->newer=-1;
+	entry->older=cache->newest;
+	if(cache->newest>=0)
+		cache->entries[cache->newest].newer=e;
+	else
+		cache->oldest=e;
+	cache->newest=e;
+}
+
+static void lru_push_oldest(struct keystore_cache* cache, int32_t e)
+{
+	struct keystore_cache_entry* entry=&cache->entries[e];
+	entry->older=-1;
+	entry->newer=cache->oldest;
+	if(cache->oldest>=0)
+		cache->entries[cache->oldest].older=e;
+	else
+		cache->newest=e;
+	cache->oldest=e;
+}
+
+/* Removes entry e from its hash bucket */
+static void bucket_unlink(struct keystore_cache* cache, int32_t e)
+{
+	int32_t* link=&cache->buckets[cache_bucket(cache,cache->entries[e].key)];
+	while(*link!=e)
+		link=&cache->entries[*link].chain;
+	*link=cache->entries[e].chain;
+}
+
+int keystore_cache_init(struct keystore_cache* cache, uint32_t capacity)
+{
+	uint32_t buckets=1;
+	memset(cache,0,sizeof(*cache));
+	if(capacity==0 || capacity>0x1000000)
+		return -1;
+	while(buckets<2*capacity)
+		buckets<<=1;
+	cache->entries=(struct keystore_cache_entry*)calloc(capacity,sizeof(struct keystore_cache_entry));
+	cache->buckets=(int32_t*)malloc(sizeof(int32_t)*buckets);
+	if(cache->entries==NULL || cache->buckets==NULL)
+	{
+		keystore_cache_free(cache);
+		return -1;
+	}
+	memset(cache->buckets,0xFF,sizeof(int32_t)*buckets);
+	cache->capacity=capacity;
+	cache->bucket_mask=buckets-1;
+	cache->newest=cache->oldest=-1;
+	for(uint32_t e=0; e<capacity; e++)
+		lru_push_oldest(cache,(int32_t)e);
+	return 0;
+}
+
+void keystore_cache_free(struct keystore_cache* cache)
+{
+	if(cache->entries!=NULL)
+		memset(cache->entries,0,sizeof(struct keystore_cache_entry)*cache->capacity);
+	free(cache->entries);
+	free(cache->buckets);
+	memset(cache,0,sizeof(*cache));
+}
+
+struct keystore_schedule* keystore_cache_get(struct keystore_cache* cache, uint32_t key, int* hit)
+{
+	int32_t e;
+	for(e=cache->buckets[cache_bucket(cache,key)]; e>=0; e=cache->entries[e].chain)
+	{
+		if(cache->entries[e].key==key)
+			break;
+	}
+	*hit=(e>=0);
+	if(e>=0)
+		cache->hits++;
+	else
+	{
+		/* Miss, the least recently used entry is taken over */
+		cache->misses++;
+		e=cache->oldest;
+		if(cache->entries[e].valid)
+			bucket_unlink(cache,e);
+		cache->entries[e].key=key;
+		cache->entries[e].valid=1;
+		uint32_t b=cache_bucket(cache,key);
+		cache->entries[e].chain=cache->buckets[b];
+		cache->buckets[b]=e;
+	}
+	lru_unlink(cache,e);
+	lru_push_newest(cache,e);
+	return &cache->entries[e].schedule;
+}
+
+void keystore_cache_drop(struct keystore_cache* cache, uint32_t key)
+{
+	for(int32_t e=cache->buckets[cache_bucket(cache,key)]; e>=0; e=cache->entries[e].chain)
+	{
+		if(cache->entries[e].key==key)
+		{
+			bucket_unlink(cache,e);
+			cache->entries[e].valid=0;
+			memset(&cache->entries[e].schedule,0,sizeof(struct keystore_schedule));
+			lru_unlink(cache,e);
+			lru_push_oldest(cache,e);
+			return;
+		}
+	}
+}
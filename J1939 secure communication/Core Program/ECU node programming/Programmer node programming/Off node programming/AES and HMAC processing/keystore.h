@@ -0,0 +1,197 @@
+#ifndef __KEYSTORE_H__
+#define __KEYSTORE_H__
+#include<stdint.h>
+#include<stddef.h>
+#include "aes.h"
+#include "hmac.h"
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: keystore.h
+ * Description: This file contains the layout of the per ECU keystore written by keygen and the routines used to look a key set up by the
+ *              J1939 identity number of the ECU. The file is mapped read only and searched in place, nothing is parsed at load time
+ *              so a keystore of a whole fleet costs one open and one mmap whatever its size.
+ *              Key sets can also be derived on the fly from a single master secret and the NAME of the ECU (HKDF-SHA1), and the expanded
+ *              AES schedule and keyed HMAC context of the ECUs used last are kept in a small LRU cache.
+ * --------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * Keystore layout, every multi byte field is little endian :
+ *     header  : magic "SFWK" | version | rsvd (3 bytes) | entry count | entry size
+ *     entries : entry count entries of KEYSTORE_ENTRY_SIZE bytes sorted by increasing identity number, no duplicates
+ *               identity number | HMAC key length | AES256-CBC key | rsvd (16 bytes) | HMAC key (KEYSTORE_HMAC_KEY_MAXLEN bytes, zero filled) | rsvd
+ *               IVs are drawn per image by the signing tools, the 16 reserved bytes (an IV nothing read in earlier keystores) are written zero.
+ */
+
+#define KEYSTORE_MAGIC              "SFWK"
+#define KEYSTORE_MAGIC_SIZE         4
+#define KEYSTORE_VERSION            0x01
+#define KEYSTORE_HEADER_SIZE        16
+#define KEYSTORE_ENTRY_SIZE         128
+
+#define KEYSTORE_AES_KEY_SIZE       32
+#define KEYSTORE_HMAC_KEY_MAXLEN    64
+#define KEYSTORE_HMAC_KEY_SIZE      32          /* HMAC key length generated by keygen */
+
+/* J1939 identity numbers are 21 bits wide, bits 0 to 20 of the 64 bit NAME */
+#define KEYSTORE_MAX_IDENTITY       0x1FFFFF
+#define KEYSTORE_NAME_IDENTITY(name)    ((uint32_t)((name)&KEYSTORE_MAX_IDENTITY))
+
+/**
+ * Key derivation (RFC 5869 HKDF with HMAC-SHA1, no salt) :
+ *     PRK = HKDF-Extract(0, master secret)
+ *     OKM = HKDF-Expand(PRK, "SFWK" | identity number (4 bytes) | manufacturer code (2 bytes), KEYSTORE_DERIVED_SIZE)
+ *     AES256-CBC key = OKM[0..31], HMAC key = OKM[32..63]
+ * identity number and manufacturer code are the bits 0 to 20 and 21 to 31 of the J1939 NAME, i.e. its low 32 bits.
+ */
+#define KEYSTORE_HKDF_INFO          "SFWK"
+#define KEYSTORE_HKDF_INFO_SIZE     4
+#define KEYSTORE_MASTER_MAXLEN      64
+#define KEYSTORE_DERIVED_SIZE       (KEYSTORE_AES_KEY_SIZE+KEYSTORE_HMAC_KEY_SIZE)
+
+#define KEYSTORE_MANUFACTURER_MAX   0x7FF
+#define KEYSTORE_NAME_MANUFACTURER(name)    ((uint16_t)(((name)>>21)&KEYSTORE_MANUFACTURER_MAX))
+#define KEYSTORE_NAME_KEY(name)             ((uint32_t)(name))      /* identity number and manufacturer code, the key set cache key */
+
+/* Status codes */
+enum
+{
+  keystoreSuccess = 0,
+  keystoreIOError,            /* the file could not be opened or mapped */
+  keystoreBadMagic,           /* not a keystore */
+  keystoreBadVersion,         /* keystore version not supported */
+  keystoreBadLayout,          /* entry size or count disagree with the file size */
+  keystoreNotFound            /* no key set for this identity number */
+};
+
+/* One key set in host representation */
+struct keystore_keys
+{
+  uint32_t identity_number;
+  uint32_t hmac_key_len;
+  uint8_t  aes_key[KEYSTORE_AES_KEY_SIZE];
+  uint8_t  hmac_key[KEYSTORE_HMAC_KEY_MAXLEN];
+};
+
+/* Expanded key set, ready to encrypt and sign */
+struct keystore_schedule
+{
+  uint8_t  ExpKey[AES_EXPKEY_MAXSIZE];
+  struct hmac_sha1 hmac;
+};
+
+/* Keyed HKDF PRK, derives the key set of any ECU from the master secret */
+struct keystore_deriver
+{
+  struct hmac_sha1 prk;
+};
+
+/* LRU cache entry */
+struct keystore_cache_entry
+{
+  uint32_t key;
+  uint8_t  valid;
+  int32_t  newer;             /* LRU list neighbours, -1 at the ends */
+  int32_t  older;
+  int32_t  chain;             /* next entry of the same hash bucket, -1 at the end */
+  struct keystore_schedule schedule;
+};
+
+/* LRU cache of expanded key sets indexed by KEYSTORE_NAME_KEY, one per thread, it is not locked */
+struct keystore_cache
+{
+  struct keystore_cache_entry* entries;
+  int32_t* buckets;
+  uint32_t capacity;
+  uint32_t bucket_mask;
+  int32_t  newest;
+  int32_t  oldest;
+  uint32_t hits;
+  uint32_t misses;
+};
+
+/* Mapped keystore */
+struct keystore
+{
+  const uint8_t* map;
+  size_t   map_size;
+  uint32_t count;
+};
+
+/**
+ * @brief Maps a keystore file read only and checks its header.
+ * @retval int keystoreSuccess or a keystore status code, ks is left closed on error.
+ */
+int keystore_open(struct keystore* ks, const char* path);
+
+/**
+ * @brief Unmaps a keystore opened by keystore_open.
+ */
+void keystore_close(struct keystore* ks);
+
+/**
+ * @brief Binary search of the key set of identity_number, keys receives a copy of the entry.
+ * @retval int keystoreSuccess or keystoreNotFound.
+ */
+int keystore_lookup(const struct keystore* ks, uint32_t identity_number, struct keystore_keys* keys);
+
+/**
+ * @brief Fills buf with size bytes from the OS CSPRNG (getrandom), used for key sets and per image IVs.
+ * @retval int 0 on success, -1 if the CSPRNG failed.
+ */
+int keystore_random(uint8_t* buf, size_t size);
+
+/**
+ * @brief HKDF-SHA1 (RFC 5869) of ikm with the given salt and info into okm_len bytes of okm, okm_len at most 255*20.
+ */
+void keystore_hkdf(const uint8_t* salt, uint32_t salt_len, const uint8_t* ikm, uint32_t ikm_len, const uint8_t* info, uint32_t info_len, uint8_t* okm, uint32_t okm_len);
+
+/**
+ * @brief Runs the HKDF extract step on the master secret once, the deriver can then be shared read only between threads.
+ */
+void keystore_deriver_init(struct keystore_deriver* d, const uint8_t* master, uint32_t master_len);
+
+/**
+ * @brief Derives the key set of the ECU with the given identity number and manufacturer code.
+ */
+void keystore_derive(const struct keystore_deriver* d, uint32_t identity_number, uint16_t manufacturer_code, struct keystore_keys* keys);
+
+/**
+ * @brief Expands keys into schedule, AES256-CBC key schedule and keyed HMAC-SHA1 context.
+ */
+void keystore_schedule_init(struct keystore_schedule* schedule, const struct keystore_keys* keys);
+
+/**
+ * @brief Allocates a cache of capacity key sets.
+ * @retval int 0 on success, -1 if memory could not be allocated.
+ */
+int keystore_cache_init(struct keystore_cache* cache, uint32_t capacity);
+
+/**
+ * @brief Frees and wipes the cache.
+ */
+void keystore_cache_free(struct keystore_cache* cache);
+
+/**
+ * @brief Returns the schedule cached for key and makes it the most recently used one.
+ *        On a miss the least recently used entry is reassigned to key and returned with *hit set to 0, the caller fills its schedule
+ *        (or calls keystore_cache_drop if the key set could not be found).
+ */
+struct keystore_schedule* keystore_cache_get(struct keystore_cache* cache, uint32_t key, int* hit);
+
+/**
+ * @brief Removes key from the cache.
+ */
+void keystore_cache_drop(struct keystore_cache* cache, uint32_t key);
+
+/**
+ * @brief Serializes the keystore header for count entries into the first KEYSTORE_HEADER_SIZE bytes of out.
+ */
+void keystore_write_header(uint8_t* out, uint32_t count);
+
+/**
+ * @brief Serializes keys into the KEYSTORE_ENTRY_SIZE bytes of out, the caller keeps the entries sorted by identity number.
+ */
+void keystore_write_entry(uint8_t* out, const struct keystore_keys* keys);
+
+#endif /* __KEYSTORE_H__ */
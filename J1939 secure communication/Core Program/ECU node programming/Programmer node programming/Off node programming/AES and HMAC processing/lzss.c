@@ -0,0 +1,162 @@
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: lzss.c
+ * Description: LZSS compressor (hash chain match finder) and streaming decompressor, see lzss.h for the stream format.
+ * --------------------------------------------------------------------------------------------------
+ */
+#include<string.h>
+#include "lzss.h"
+
+#define HASH_BITS       12
+#define HASH_SIZE       (1<<HASH_BITS)
+#define MAX_CHAIN       128         /* candidates tried per position, bounds the compression time */
+#define NO_POS          (-1)
+
+static uint32_t hash3(const uint8_t* p)
+{
+	return ((uint32_t)p[0]<<16 | (uint32_t)p[1]<<8 | p[2])*2654435761u>>(32-HASH_BITS);
+}
+
+uint32_t lzss_bound(uint32_t size)
+{
+	return size+(size+7)/8;
+}
+
+uint32_t lzss_compress(const uint8_t* in, uint32_t size, uint8_t* out)
+{
+	int32_t head[HASH_SIZE];
+	int32_t prev[LZSS_WINDOW_SIZE];    /* previous position with the same hash, indexed by position modulo the window */
+	uint32_t out_pos=0, flags_pos=0, token=8;
+	uint32_t i=0;
+
+	for(uint32_t h=0; h<HASH_SIZE; h++)
+		head[h]=NO_POS;
+
+	while(i<size)
+	{
+		if(token==8)
+		{
+			flags_pos=out_pos++;
+			out[flags_pos]=0;
+			token=0;
+		}
+
+		/* Longest match in the window, only whole hash chains of the last LZSS_WINDOW_SIZE bytes are searched */
+		uint32_t best_len=0, best_dist=0;
+		uint32_t max_len=(size-i<LZSS_MAX_MATCH) ? size-i : LZSS_MAX_MATCH;
+		if(max_len>=LZSS_MIN_MATCH)
+		{
+			int32_t cand=head[hash3(in+i)];
+			for(uint32_t n=0; n<MAX_CHAIN && cand!=NO_POS && i-(uint32_t)cand<=LZSS_WINDOW_SIZE; n++)
+			{
+				uint32_t len=0;
+				while(len<max_len && in[cand+len]==in[i+len])
+					len++;
+				if(len>best_len)
+				{
+					best_len=len;
+					best_dist=i-(uint32_t)cand;
+					if(len==max_len)
+						break;
+				}
+				int32_t next=prev[cand%LZSS_WINDOW_SIZE];
+				if(next>=cand)
+					break;              /* slot reused by a newer position, the chain ends here */
+				cand=next;
+			}
+		}
+
+		uint32_t advance;
+		if(best_len>=LZSS_MIN_MATCH)
+		{
+			out[out_pos++]=(uint8_t)(best_dist-1);
+			out[out_pos++]=(uint8_t)(((best_dist-1)>>8)<<LZSS_LENGTH_BITS | (best_len-LZSS_MIN_MATCH));
+			advance=best_len;
+		}
+		else
+		{
+			out[flags_pos]|=(uint8_t)(1<<token);
+			out[out_pos++]=in[i];
+			advance=1;
+		}
+		token++;
+
+		/* Every covered position is inserted so later matches can start inside this one */
+		for(; advance>0; advance--, i++)
+		{
+			if(i+LZSS_MIN_MATCH<=size)
+			{
+				uint32_t h=hash3(in+i);
+				prev[i%LZSS_WINDOW_SIZE]=head[h];
+				head[h]=(int32_t)i;
+			}
+		}
+	}
+	return out_pos;
+}
+
+void lzss_decoder_init(struct lzss_decoder* dec, lzss_sink sink, void* sink_ctx)
+{
+	memset(dec,0,sizeof(*dec));
+	dec->sink=sink;
+	dec->sink_ctx=sink_ctx;
+}
+
+/* Hands the window bytes decoded since the last flush to the sink */
+static int flush(struct lzss_decoder* dec)
+{
+	if(dec->pos>dec->flushed && dec->sink(dec->sink_ctx,dec->window+dec->flushed,dec->pos-dec->flushed)!=0)
+		return lzssSinkError;
+	dec->flushed=dec->pos;
+	if(dec->pos==LZSS_WINDOW_SIZE)
+		dec->pos=dec->flushed=0;
+	return lzssSuccess;
+}
+
+static int put(struct lzss_decoder* dec, uint8_t byte)
+{
+	dec->window[dec->pos++]=byte;
+	dec->total++;
+	return (dec->pos==LZSS_WINDOW_SIZE) ? flush(dec) : lzssSuccess;
+}
+
+int lzss_decode(struct lzss_decoder* dec, const uint8_t* in, uint32_t size)
+{
+	int status;
+	for(uint32_t i=0; i<size; i++)
+	{
+		if(dec->flag_count==0)
+		{
+			dec->flags=in[i];
+			dec->flag_count=8;
+			continue;
+		}
+		if(dec->flags&1)
+		{
+			if((status=put(dec,in[i]))!=lzssSuccess)
+				return status;
+		}
+		else if(!dec->have_match_lo)
+		{
+			dec->match_lo=in[i];
+			dec->have_match_lo=1;
+			continue;
+		}
+		else
+		{
+			uint32_t dist=((uint32_t)(in[i]>>LZSS_LENGTH_BITS)<<8 | dec->match_lo)+1;
+			uint32_t len=(in[i]&((1<<LZSS_LENGTH_BITS)-1))+LZSS_MIN_MATCH;
+			dec->have_match_lo=0;
+			if(dist>dec->total)
+				return lzssBadDistance;
+			for(; len>0; len--)
+			{
+				if((status=put(dec,dec->window[(dec->pos+LZSS_WINDOW_SIZE-dist)%LZSS_WINDOW_SIZE]))!=lzssSuccess)
+					return status;
+			}
+		}
+		dec->flags>>=1;
+		dec->flag_count--;
+	}
+	return flush(dec);
+}
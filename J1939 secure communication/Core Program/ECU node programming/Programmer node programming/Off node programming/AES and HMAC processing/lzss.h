@@ -0,0 +1,78 @@
+#ifndef __LZSS_H__
+#define __LZSS_H__
+#include<stdint.h>
+/**
+ * --------------------------------------------------------------------------------------------------
+ * File: lzss.h
+ * Description: This file contains a small LZSS codec used to compress the firmware before encryption, cipher text can not be compressed
+ *              so this is the only place where the bytes sent over the CAN bus can be reduced.
+ *              The decoder works on a stream with a fixed LZSS_WINDOW_SIZE bytes of RAM, it suits the receiver node MCU.
+ * --------------------------------------------------------------------------------------------------
+ */
+
+/**
+ * Stream format, a sequence of groups :
+ *     [flags byte] followed by 8 tokens, bit n (LSB first) of the flags tells the kind of token n
+ *     bit set   : literal, 1 byte copied to the output
+ *     bit clear : match, 2 bytes  b0 = (distance-1) & 0xFF, b1 = ((distance-1) >> 8) << 4 | (length-LZSS_MIN_MATCH)
+ *                 copies length bytes starting distance bytes behind the current output position
+ * The last group may hold fewer than 8 tokens, the decoder stops with the input.
+ */
+
+#define LZSS_WINDOW_BITS    12
+#define LZSS_WINDOW_SIZE    (1<<LZSS_WINDOW_BITS)     /* 4096 bytes, largest match distance */
+#define LZSS_LENGTH_BITS    4
+#define LZSS_MIN_MATCH      3
+#define LZSS_MAX_MATCH      (LZSS_MIN_MATCH+(1<<LZSS_LENGTH_BITS)-1)   /* 18 bytes */
+
+/* Status codes */
+enum
+{
+  lzssSuccess = 0,
+  lzssBadDistance,            /* a match points in front of the first output byte */
+  lzssSinkError               /* the output callback reported an error */
+};
+
+/**
+ * @brief Output callback of the decoder, receives the decoded bytes in order, returns 0 to continue.
+ */
+typedef int (*lzss_sink)(void* ctx, const uint8_t* data, uint32_t size);
+
+/* Streaming decoder state, the window doubles as the output buffer */
+struct lzss_decoder
+{
+  uint8_t  window[LZSS_WINDOW_SIZE];
+  uint32_t pos;               /* next write position in window */
+  uint32_t flushed;           /* window bytes before this position were handed to the sink */
+  uint32_t total;             /* bytes decoded so far */
+  uint8_t  flags;
+  uint8_t  flag_count;        /* tokens left in the current group */
+  uint8_t  match_lo;          /* first byte of a match split across two input pieces */
+  uint8_t  have_match_lo;
+  lzss_sink sink;
+  void*    sink_ctx;
+};
+
+/**
+ * @brief Returns the largest compressed size for size input bytes (all literals).
+ */
+uint32_t lzss_bound(uint32_t size);
+
+/**
+ * @brief Compresses size bytes of in to out, out must hold lzss_bound(size) bytes.
+ * @retval uint32_t compressed size.
+ */
+uint32_t lzss_compress(const uint8_t* in, uint32_t size, uint8_t* out);
+
+/**
+ * @brief Prepares a decoder which hands its output to sink.
+ */
+void lzss_decoder_init(struct lzss_decoder* dec, lzss_sink sink, void* sink_ctx);
+
+/**
+ * @brief Decodes the next size bytes of the compressed stream, the input can be split at any byte.
+ * @retval int lzssSuccess or a lzss status code, every byte decoded from this piece has been handed to the sink on success.
+ */
+int lzss_decode(struct lzss_decoder* dec, const uint8_t* in, uint32_t size);
+
+#endif /* __LZSS_H__ */
@@ -0,0 +1,802 @@
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<time.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<sys/ioctl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/syscall.h>
+#include<sys/uio.h>
+#include<linux/fs.h>
+#include<linux/io_uring.h>
+
+#include "../AES and HMAC processing/sha1.h"
+
+/*
+ * Writes a secured firmware image to the data flash / SD card in raw binary format (the card is used as sequential memory)
+ * and writes the image size at the beginning of the last sector, this makes the card ready for the programmer node.
+ * The target can be a block device (/dev/sdX, /dev/loopN) or a plain image file already sized like the card.
+ * Several targets are written concurrently from one copy of the image, through io_uring or one thread per target.
+ */
+
+#define DEFAULT_CHUNK_SIZE (4*1024*1024)	// erase block multiple, one write per chunk.
+#define DEFAULT_SECTOR_SIZE 512			// sector size of plain image files, block devices report their own.
+#define BUFFER_ALIGN 4096			// O_DIRECT buffer, offset and length alignment.
+#define DEFAULT_QUEUE_DEPTH 8			// io_uring writes in flight per device.
+#define MAX_QUEUE_DEPTH 256
+
+/* Last sector layout, read by the programmer node before streaming the image */
+#define META_MAGIC "SFWM"
+#define META_OFF_SIZE 0				// le32 image size.
+#define META_OFF_MAGIC 4
+#define META_OFF_SHA1 8				// SHA1 of the image bytes.
+#define META_SIZE (META_OFF_SHA1+SHA1HashSize)
+
+
+/* Card or image file being written. */
+struct target {
+	const char* path;
+	int fd;
+	int direct;				// opened with O_DIRECT.
+	uint64_t size;				// bytes available on the target.
+	uint32_t sector;			// logical sector size.
+};
+
+/* Read-back verification running on its own thread and descriptor, it trails the writer and hashes every region as soon as
+ * the writer reports it written, thus most of the verification overlaps the writes of the later regions. */
+struct verifier {
+	struct target* t;
+	int fd;
+	int direct;
+	uint8_t* buf;
+	size_t chunk;
+	uint64_t image_size;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint64_t ready;				// bytes from the start of the target written by the writer, sector multiple.
+	int meta_ready;				// metadata sector written.
+	int aborted;				// writer failed, nothing more will come.
+	uint8_t expected[SHA1HashSize];		// SHA1 of the source image, valid once meta_ready is set.
+	int status;
+	double busy;				// seconds spent reading and hashing.
+};
+
+static double now_sec(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (double)ts.tv_sec+(double)ts.tv_nsec/1e9;
+}
+
+/* Opens the target for writing, with O_DIRECT when the file system or device supports it, and reads its size and sector size. */
+static int open_target(struct target* t, const char* path, uint32_t file_sector){
+	struct stat st;
+	memset(t,0,sizeof(*t));
+	t->path=path;
+	t->direct=1;
+	t->fd=open(path,O_RDWR|O_DIRECT);
+	if(t->fd<0 && errno==EINVAL){
+		t->direct=0;			// e.g. tmpfs, the page cache is used and flushed by the final fsync.
+		t->fd=open(path,O_RDWR);
+	}
+	if(t->fd<0){
+		printf("Error : Unable to open %s (%s)\n",path,strerror(errno));
+		return -1;
+	}
+	if(fstat(t->fd,&st)!=0){
+		printf("Error : Unable to stat %s (%s)\n",path,strerror(errno));
+		close(t->fd);
+		return -1;
+	}
+	if(S_ISBLK(st.st_mode)){
+		int sector=0;
+		if(ioctl(t->fd,BLKGETSIZE64,&t->size)!=0 || ioctl(t->fd,BLKSSZGET,&sector)!=0){
+			printf("Error : Unable to read the geometry of %s (%s)\n",path,strerror(errno));
+			close(t->fd);
+			return -1;
+		}
+		t->sector=(uint32_t)sector;
+	}else{
+		t->size=(uint64_t)st.st_size;
+		t->sector=file_sector;
+	}
+	return 0;
+}
+
+/* Writes the whole buffer at offset, a short write is retried from where it stopped. */
+static int write_at(struct target* t, const uint8_t* buf, size_t size, uint64_t offset){
+	while(size>0){
+		ssize_t n=pwrite(t->fd,buf,size,(off_t)offset);
+		if(n<0 && errno==EINTR){
+			continue;
+		}
+		if(n<0 && errno==EINVAL && t->direct){
+			/* The file system block is larger than the sector (e.g. a 512 byte tail on a 4 KB block file system), buffered writes from here on */
+			t->direct=0;
+			if(fcntl(t->fd,F_SETFL,fcntl(t->fd,F_GETFL)&~O_DIRECT)==0){
+				continue;
+			}
+		}
+		if(n<=0){
+			printf("Error : Unable to write %s at offset %llu (%s)\n",t->path,(unsigned long long)offset,n<0 ? strerror(errno) : "no space");
+			return -1;
+		}
+		buf+=n;
+		size-=(size_t)n;
+		offset+=(uint64_t)n;
+	}
+	return 0;
+}
+
+/* Reads the whole buffer at offset, same O_DIRECT fallback as write_at. */
+static int read_at(struct verifier* v, uint8_t* buf, size_t size, uint64_t offset){
+	while(size>0){
+		ssize_t n=pread(v->fd,buf,size,(off_t)offset);
+		if(n<0 && errno==EINTR){
+			continue;
+		}
+		if(n<0 && errno==EINVAL && v->direct){
+			v->direct=0;
+			if(fcntl(v->fd,F_SETFL,fcntl(v->fd,F_GETFL)&~O_DIRECT)==0){
+				continue;
+			}
+		}
+		if(n<=0){
+			printf("Error : Unable to read back %s at offset %llu (%s)\n",v->t->path,(unsigned long long)offset,n<0 ? strerror(errno) : "end of target");
+			return -1;
+		}
+		buf+=n;
+		size-=(size_t)n;
+		offset+=(uint64_t)n;
+	}
+	return 0;
+}
+
+/* Tells the verifier that the target holds the written data up to end (exclusive). */
+static void publish(struct verifier* v, uint64_t end){
+	if(v==NULL || end<=v->ready){
+		return;
+	}
+	if(!v->t->direct){
+		/* Buffered writes, the region is forced to the card and dropped from the page cache so the read back hits the card */
+		uint64_t from=v->ready;
+		sync_file_range(v->t->fd,(off_t)from,(off_t)(end-from),SYNC_FILE_RANGE_WAIT_BEFORE|SYNC_FILE_RANGE_WRITE|SYNC_FILE_RANGE_WAIT_AFTER);
+		posix_fadvise(v->t->fd,(off_t)from,(off_t)(end-from),POSIX_FADV_DONTNEED);
+	}
+	pthread_mutex_lock(&v->lock);
+	v->ready=end;
+	pthread_cond_signal(&v->cond);
+	pthread_mutex_unlock(&v->lock);
+}
+
+/* Waits until the writer has gone past offset (or wrote the metadata when meta is set), returns the written end or 0 if the writer failed. */
+static uint64_t wait_written(struct verifier* v, uint64_t offset, int meta){
+	pthread_mutex_lock(&v->lock);
+	while(!v->aborted && (meta ? !v->meta_ready : v->ready<=offset)){
+		pthread_cond_wait(&v->cond,&v->lock);
+	}
+	uint64_t ready=v->aborted ? 0 : v->ready;
+	pthread_mutex_unlock(&v->lock);
+	return ready;
+}
+
+static void* verify_worker(void* arg){
+	struct verifier* v=(struct verifier*)arg;
+	struct sha1 ctx;
+	uint8_t digest[SHA1HashSize];
+	uint64_t offset=0;
+
+	v->status=-1;
+	sha1_reset(&ctx);
+	while(offset<v->image_size){
+		uint64_t ready=wait_written(v,offset,0);
+		if(ready==0){
+			return NULL;
+		}
+		double start=now_sec();
+		size_t n=(ready-offset<v->chunk) ? (size_t)(ready-offset) : v->chunk;
+		if(read_at(v,v->buf,n,offset)<0){
+			return NULL;
+		}
+		size_t image_bytes=(v->image_size-offset<n) ? (size_t)(v->image_size-offset) : n;	// the sector padding is not hashed
+		sha1_input(&ctx,v->buf,(unsigned)image_bytes);
+		offset+=n;
+		v->busy+=now_sec()-start;
+	}
+	sha1_result(&ctx,digest);
+
+	if(wait_written(v,0,1)==0){
+		return NULL;
+	}
+	double start=now_sec();
+	if(memcmp(digest,v->expected,SHA1HashSize)!=0){
+		printf("Error : Read back of %s does not match the image, the card is faulty.\n",v->t->path);
+		return NULL;
+	}
+	if(read_at(v,v->buf,v->t->sector,v->t->size-v->t->sector)<0){
+		return NULL;
+	}
+	uint32_t size=(uint32_t)v->buf[META_OFF_SIZE] | ((uint32_t)v->buf[META_OFF_SIZE+1]<<8) | ((uint32_t)v->buf[META_OFF_SIZE+2]<<16) | ((uint32_t)v->buf[META_OFF_SIZE+3]<<24);
+	if(size!=v->image_size || memcmp(v->buf+META_OFF_MAGIC,META_MAGIC,4)!=0 || memcmp(v->buf+META_OFF_SHA1,v->expected,SHA1HashSize)!=0){
+		printf("Error : Read back of the %s size sector does not match, the card is faulty.\n",v->t->path);
+		return NULL;
+	}
+	v->busy+=now_sec()-start;
+	v->status=0;
+	return NULL;
+}
+
+/* Prepares the verifier of target t, returns -1 if the read back descriptor or buffer can not be set up. */
+static int verifier_init(struct verifier* v, struct target* t, uint64_t image_size, size_t chunk){
+	memset(v,0,sizeof(*v));
+	v->t=t;
+	v->chunk=chunk;
+	v->image_size=image_size;
+	v->direct=1;
+	v->fd=open(t->path,O_RDONLY|O_DIRECT);
+	if(v->fd<0 && errno==EINVAL){
+		v->direct=0;
+		v->fd=open(t->path,O_RDONLY);
+	}
+	if(v->fd<0 || posix_memalign((void**)&v->buf,BUFFER_ALIGN,chunk)!=0){
+		printf("Error : Unable to set up the read back of %s\n",t->path);
+		if(v->fd>=0){
+			close(v->fd);
+		}
+		return -1;
+	}
+	pthread_mutex_init(&v->lock,NULL);
+	pthread_cond_init(&v->cond,NULL);
+	return 0;
+}
+
+/* Image written to every device, loaded once. */
+struct image {
+	uint8_t* data;				// aligned and zero padded to BUFFER_ALIGN.
+	uint64_t size;
+	size_t chunk;				// bytes per write.
+	uint8_t digest[SHA1HashSize];
+};
+
+enum { STAGE_DATA=0, STAGE_META, STAGE_SYNC, STAGE_DONE };
+
+/* One target of the run with its write progress and verifier. */
+struct device {
+	struct target t;
+	const struct image* img;
+	uint8_t* meta;				// size sector, aligned.
+	uint64_t region;			// image size rounded up to the sector.
+	uint32_t chunks;
+	uint32_t next;				// next chunk to queue.
+	uint32_t contiguous;			// chunks written from the start without a gap.
+	uint8_t* done;				// per chunk, set once written.
+	uint32_t* progress;			// per chunk (and size sector) bytes written, short writes are resumed.
+	struct iovec* iov;			// per chunk (and size sector), kept until the write completes.
+	uint32_t inflight;
+	int stage;
+	int status;
+	double start;
+	double end;
+	int verify;
+	struct verifier v;
+	pthread_t verify_thread;
+};
+
+/* Builds the size sector : image size, magic and SHA1 at the beginning of the last sector. */
+static void build_metadata(uint8_t* buf, uint32_t sector, uint64_t image_size, const uint8_t digest[SHA1HashSize]){
+	memset(buf,0,sector);
+	buf[META_OFF_SIZE]=(uint8_t)image_size;
+	buf[META_OFF_SIZE+1]=(uint8_t)(image_size>>8);
+	buf[META_OFF_SIZE+2]=(uint8_t)(image_size>>16);
+	buf[META_OFF_SIZE+3]=(uint8_t)(image_size>>24);
+	memcpy(buf+META_OFF_MAGIC,META_MAGIC,4);
+	memcpy(buf+META_OFF_SHA1,digest,SHA1HashSize);
+}
+
+/* Length of chunk i on device d, the last one ends at the sector following the image. */
+static size_t chunk_len(const struct device* d, uint32_t i){
+	uint64_t offset=(uint64_t)i*d->img->chunk;
+	return (d->region-offset<d->img->chunk) ? (size_t)(d->region-offset) : d->img->chunk;
+}
+
+/* Records a completed chunk and lets the verifier read everything written from the start without a gap. */
+static void chunk_written(struct device* d, uint32_t i){
+	d->done[i]=1;
+	uint32_t before=d->contiguous;
+	while(d->contiguous<d->chunks && d->done[d->contiguous]){
+		d->contiguous++;
+	}
+	if(d->verify && d->contiguous!=before){
+		uint64_t end=(uint64_t)d->contiguous*d->img->chunk;
+		publish(&d->v,end<d->region ? end : d->region);
+	}
+}
+
+/* Fallback engine : one thread per device writing its chunks in order with pwrite. */
+static void* device_worker(void* arg){
+	struct device* d=(struct device*)arg;
+	d->start=now_sec();
+	for(uint32_t i=0;i<d->chunks && d->status==0;i++){
+		uint64_t offset=(uint64_t)i*d->img->chunk;
+		if(write_at(&d->t,d->img->data+offset,chunk_len(d,i),offset)<0){
+			d->status=-1;
+		}else{
+			chunk_written(d,i);
+		}
+	}
+	if(d->status==0 && write_at(&d->t,d->meta,d->t.sector,d->t.size-d->t.sector)<0){
+		d->status=-1;
+	}
+	if(d->status==0 && fsync(d->t.fd)!=0){
+		printf("Error : Unable to sync %s (%s)\n",d->t.path,strerror(errno));
+		d->status=-1;
+	}
+	d->end=now_sec();
+	return NULL;
+}
+
+static int run_threads(struct device* devs, int count){
+	pthread_t* threads=(pthread_t*)malloc(sizeof(pthread_t)*count);
+	if(threads==NULL){
+		return -1;
+	}
+	int started=0;
+	for(;started<count;started++){
+		if(pthread_create(&threads[started],NULL,device_worker,&devs[started])!=0){
+			break;
+		}
+	}
+	for(int i=started;i<count;i++){
+		device_worker(&devs[i]);	/* no more threads, written on the calling thread */
+	}
+	for(int i=0;i<started;i++){
+		pthread_join(threads[i],NULL);
+	}
+	free(threads);
+	return 0;
+}
+
+/* Minimal io_uring set up through the raw system calls, liburing is not needed. */
+struct uring {
+	int fd;
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	struct io_uring_sqe* sqes;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqes;
+	void* sq_ptr;
+	size_t sq_len;
+	void* cq_ptr;
+	size_t cq_len;
+	size_t sqes_len;
+	unsigned pending;			// queued entries not handed to the kernel yet.
+};
+
+static int uring_init(struct uring* r, unsigned entries){
+	struct io_uring_params p;
+	memset(r,0,sizeof(*r));
+	memset(&p,0,sizeof(p));
+	r->fd=(int)syscall(__NR_io_uring_setup,entries,&p);
+	if(r->fd<0){
+		return -1;
+	}
+	r->sq_len=p.sq_off.array+p.sq_entries*sizeof(unsigned);
+	r->cq_len=p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+	if(p.features&IORING_FEAT_SINGLE_MMAP){
+		r->sq_len=r->cq_len=(r->sq_len>r->cq_len) ? r->sq_len : r->cq_len;
+	}
+	r->sq_ptr=mmap(NULL,r->sq_len,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,r->fd,IORING_OFF_SQ_RING);
+	r->cq_ptr=(p.features&IORING_FEAT_SINGLE_MMAP) ? r->sq_ptr : mmap(NULL,r->cq_len,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,r->fd,IORING_OFF_CQ_RING);
+	r->sqes_len=p.sq_entries*sizeof(struct io_uring_sqe);
+	r->sqes=(struct io_uring_sqe*)mmap(NULL,r->sqes_len,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,r->fd,IORING_OFF_SQES);
+	if(r->sq_ptr==MAP_FAILED || r->cq_ptr==MAP_FAILED || r->sqes==MAP_FAILED){
+		close(r->fd);
+		return -1;
+	}
+	r->sq_head=(unsigned*)((uint8_t*)r->sq_ptr+p.sq_off.head);
+	r->sq_tail=(unsigned*)((uint8_t*)r->sq_ptr+p.sq_off.tail);
+	r->sq_mask=(unsigned*)((uint8_t*)r->sq_ptr+p.sq_off.ring_mask);
+	r->sq_array=(unsigned*)((uint8_t*)r->sq_ptr+p.sq_off.array);
+	r->cq_head=(unsigned*)((uint8_t*)r->cq_ptr+p.cq_off.head);
+	r->cq_tail=(unsigned*)((uint8_t*)r->cq_ptr+p.cq_off.tail);
+	r->cq_mask=(unsigned*)((uint8_t*)r->cq_ptr+p.cq_off.ring_mask);
+	r->cqes=(struct io_uring_cqe*)((uint8_t*)r->cq_ptr+p.cq_off.cqes);
+	return 0;
+}
+
+static void uring_exit(struct uring* r){
+	munmap(r->sqes,r->sqes_len);
+	if(r->cq_ptr!=r->sq_ptr){
+		munmap(r->cq_ptr,r->cq_len);
+	}
+	munmap(r->sq_ptr,r->sq_len);
+	close(r->fd);
+}
+
+/* Queues a vectored write (or an fsync when iov is NULL), the ring is sized so it never overflows. */
+static void uring_queue(struct uring* r, int fd, const struct iovec* iov, uint64_t offset, uint64_t user_data){
+	unsigned tail=*r->sq_tail;
+	unsigned index=tail&*r->sq_mask;
+	struct io_uring_sqe* sqe=&r->sqes[index];
+	memset(sqe,0,sizeof(*sqe));
+	sqe->opcode=(iov!=NULL) ? IORING_OP_WRITEV : IORING_OP_FSYNC;
+	sqe->fd=fd;
+	sqe->addr=(uint64_t)(uintptr_t)iov;
+	sqe->len=(iov!=NULL) ? 1 : 0;
+	sqe->off=offset;
+	sqe->user_data=user_data;
+	r->sq_array[index]=index;
+	__atomic_store_n(r->sq_tail,tail+1,__ATOMIC_RELEASE);
+	r->pending++;
+}
+
+/* Hands the queued entries to the kernel and waits for at least one completion. */
+static int uring_submit_wait(struct uring* r){
+	for(;;){
+		int n=(int)syscall(__NR_io_uring_enter,r->fd,r->pending,1,IORING_ENTER_GETEVENTS,NULL,0);
+		if(n>=0){
+			r->pending-=(unsigned)n;
+			return 0;
+		}
+		if(errno!=EINTR && errno!=EAGAIN && errno!=EBUSY){
+			return -1;
+		}
+	}
+}
+
+#define TAG_META 0xFFFFFFFEu
+#define TAG_SYNC 0xFFFFFFFFu
+
+/* Queues the rest of chunk tag (or of the size sector) of device number index. */
+static void queue_write(struct uring* r, struct device* d, uint32_t index, uint32_t tag){
+	struct iovec* iov=&d->iov[(tag==TAG_META) ? d->chunks : tag];
+	uint64_t offset;
+	if(tag==TAG_META){
+		iov->iov_base=d->meta+d->progress[d->chunks];
+		iov->iov_len=d->t.sector-d->progress[d->chunks];
+		offset=d->t.size-d->t.sector+d->progress[d->chunks];
+	}else{
+		offset=(uint64_t)tag*d->img->chunk;
+		iov->iov_base=d->img->data+offset+d->progress[tag];
+		iov->iov_len=chunk_len(d,tag)-d->progress[tag];
+		offset+=d->progress[tag];
+	}
+	uring_queue(r,d->t.fd,iov,offset,(uint64_t)index<<32 | tag);
+	d->inflight++;
+}
+
+/* Handles one completion of device d : resumes short writes, moves to the size sector and sync stages, records failures. */
+static void complete(struct uring* r, struct device* d, uint32_t index, uint32_t tag, int res){
+	d->inflight--;
+	if(d->status<0){
+		return;
+	}
+	if(res==-EINVAL && d->t.direct && tag!=TAG_SYNC){
+		/* Same fallback as write_at, the file system does not take O_DIRECT writes of this size */
+		d->t.direct=0;
+		if(fcntl(d->t.fd,F_SETFL,fcntl(d->t.fd,F_GETFL)&~O_DIRECT)==0){
+			queue_write(r,d,index,tag);
+			return;
+		}
+	}
+	if(res<0 || (res==0 && tag!=TAG_SYNC)){
+		printf("Error : Unable to %s %s (%s)\n",tag==TAG_SYNC ? "sync" : "write",d->t.path,res<0 ? strerror(-res) : "no space");
+		d->status=-1;
+		return;
+	}
+	if(tag==TAG_SYNC){
+		d->stage=STAGE_DONE;
+		d->end=now_sec();
+		return;
+	}
+	uint32_t slot=(tag==TAG_META) ? d->chunks : tag;
+	size_t len=(tag==TAG_META) ? d->t.sector : chunk_len(d,tag);
+	d->progress[slot]+=(uint32_t)res;
+	if(d->progress[slot]<len){
+		queue_write(r,d,index,tag);	/* short write, the rest is queued */
+	}else if(tag==TAG_META){
+		d->stage=STAGE_SYNC;
+		uring_queue(r,d->t.fd,NULL,0,(uint64_t)index<<32 | TAG_SYNC);
+		d->inflight++;
+	}else{
+		chunk_written(d,tag);
+	}
+}
+
+/* io_uring engine : every device keeps up to depth chunk writes in flight from the shared image buffer, then writes its size
+ * sector and syncs, all devices progress concurrently from this single thread. Returns -1 if io_uring is not available. */
+static int run_uring(struct device* devs, int count, unsigned depth){
+	struct uring r;
+	unsigned entries=1;
+	while(entries<(unsigned)count*depth){
+		entries<<=1;
+	}
+	if(uring_init(&r,entries)<0){
+		return -1;
+	}
+	for(int i=0;i<count;i++){
+		devs[i].start=now_sec();
+	}
+	int active=count;
+	while(active>0){
+		/* Refills the queues and moves the devices whose data is all written to their size sector */
+		for(int i=0;i<count;i++){
+			struct device* d=&devs[i];
+			if(d->status<0 || d->stage!=STAGE_DATA){
+				continue;
+			}
+			while(d->inflight<depth && d->next<d->chunks){
+				queue_write(&r,d,(uint32_t)i,d->next++);
+			}
+			if(d->next==d->chunks && d->inflight==0){
+				d->stage=STAGE_META;
+				queue_write(&r,d,(uint32_t)i,TAG_META);
+			}
+		}
+		if(uring_submit_wait(&r)<0){
+			printf("Error : io_uring submission failed (%s)\n",strerror(errno));
+			for(int i=0;i<count;i++){
+				if(devs[i].stage!=STAGE_DONE){
+					devs[i].status=-1;
+				}
+			}
+			break;
+		}
+		unsigned head=*r.cq_head;
+		unsigned tail=__atomic_load_n(r.cq_tail,__ATOMIC_ACQUIRE);
+		for(;head!=tail;head++){
+			struct io_uring_cqe* cqe=&r.cqes[head&*r.cq_mask];
+			uint32_t index=(uint32_t)(cqe->user_data>>32);
+			complete(&r,&devs[index],index,(uint32_t)cqe->user_data,cqe->res);
+		}
+		__atomic_store_n(r.cq_head,head,__ATOMIC_RELEASE);
+
+		active=0;
+		for(int i=0;i<count;i++){
+			struct device* d=&devs[i];
+			if(d->status<0 && d->inflight==0 && d->end==0){
+				d->end=now_sec();
+			}
+			if(!(d->stage==STAGE_DONE || (d->status<0 && d->inflight==0))){
+				active++;
+			}
+		}
+	}
+	uring_exit(&r);
+	return 0;
+}
+
+/* Loads the image once into an aligned, zero padded buffer shared by all devices, and hashes it for the size sector. */
+static int load_image(struct image* img, const char* path, size_t chunk){
+	FILE* fptr=fopen(path,"rb");
+	if(fptr==NULL){
+		printf("Error : Unable to open %s\n",path);
+		return -1;
+	}
+	fseek(fptr,0,SEEK_END);
+	long size=ftell(fptr);
+	rewind(fptr);
+	if(size<=0 || size>UINT32_MAX){
+		printf("Error : %s is empty or too large\n",path);
+		fclose(fptr);
+		return -1;
+	}
+	size_t padded=((size_t)size+BUFFER_ALIGN-1)/BUFFER_ALIGN*BUFFER_ALIGN;
+	if(posix_memalign((void**)&img->data,BUFFER_ALIGN,padded)!=0){
+		printf("Error : Unable to allocate %zu bytes\n",padded);
+		fclose(fptr);
+		return -1;
+	}
+	memset(img->data+size,0,padded-(size_t)size);
+	if(fread(img->data,sizeof(uint8_t),(size_t)size,fptr)!=(size_t)size){
+		printf("Error : Unable to read %s\n",path);
+		fclose(fptr);
+		free(img->data);
+		return -1;
+	}
+	fclose(fptr);
+	img->size=(uint64_t)size;
+	img->chunk=chunk;
+	struct sha1 ctx;
+	sha1_reset(&ctx);
+	sha1_input(&ctx,img->data,(unsigned)size);
+	sha1_result(&ctx,img->digest);
+	return 0;
+}
+
+/* Opens a device, checks it can hold the image and the size sector, and starts its verifier. */
+static int device_init(struct device* d, const struct image* img, const char* path, uint32_t file_sector, int verify){
+	memset(d,0,sizeof(*d));
+	d->img=img;
+	d->verify=verify;
+	if(open_target(&d->t,path,file_sector)<0){
+		return -1;
+	}
+	d->region=(img->size+d->t.sector-1)/d->t.sector*d->t.sector;
+	if(d->t.sector>BUFFER_ALIGN || img->chunk%d->t.sector!=0 || d->t.size<d->region+d->t.sector || d->t.size%d->t.sector!=0){
+		printf("Error : %s holds %llu bytes in %u byte sectors, %llu are needed\n",path,(unsigned long long)d->t.size,d->t.sector,(unsigned long long)(d->region+d->t.sector));
+		close(d->t.fd);
+		return -1;
+	}
+	d->chunks=(uint32_t)((d->region+img->chunk-1)/img->chunk);
+	d->done=(uint8_t*)calloc(d->chunks,sizeof(uint8_t));
+	d->progress=(uint32_t*)calloc(d->chunks+1,sizeof(uint32_t));	// +1 for the size sector.
+	d->iov=(struct iovec*)calloc(d->chunks+1,sizeof(struct iovec));
+	if(d->done==NULL || d->progress==NULL || d->iov==NULL || posix_memalign((void**)&d->meta,BUFFER_ALIGN,d->t.sector)!=0){
+		printf("Error : Out of memory for %s\n",path);
+		close(d->t.fd);
+		return -1;
+	}
+	build_metadata(d->meta,d->t.sector,img->size,img->digest);
+	if(verify && (verifier_init(&d->v,&d->t,img->size,img->chunk)<0 || pthread_create(&d->verify_thread,NULL,verify_worker,&d->v)!=0)){
+		printf("Error : Unable to start the read back verification of %s, use -n to write without it.\n",path);
+		close(d->t.fd);
+		return -1;
+	}
+	return 0;
+}
+
+/* Lets the verifier check the size sector (or stop when the write failed), waits for its verdict and releases the device. */
+static void device_finish(struct device* d){
+	if(d->verify){
+		if(d->status==0 && !d->t.direct){
+			posix_fadvise(d->t.fd,(off_t)(d->t.size-d->t.sector),d->t.sector,POSIX_FADV_DONTNEED);
+		}
+		pthread_mutex_lock(&d->v.lock);
+		memcpy(d->v.expected,d->img->digest,SHA1HashSize);
+		d->v.meta_ready=(d->status==0);
+		d->v.aborted=(d->status!=0);
+		pthread_cond_signal(&d->v.cond);
+		pthread_mutex_unlock(&d->v.lock);
+		pthread_join(d->verify_thread,NULL);
+		if(d->status==0){
+			d->status=d->v.status;
+		}
+		close(d->v.fd);
+		free(d->v.buf);
+		pthread_mutex_destroy(&d->v.lock);
+		pthread_cond_destroy(&d->v.cond);
+	}
+	if(close(d->t.fd)!=0 && d->status==0){
+		printf("Error : Unable to close %s (%s)\n",d->t.path,strerror(errno));
+		d->status=-1;
+	}
+	free(d->done);
+	free(d->progress);
+	free(d->iov);
+	free(d->meta);
+}
+
+static void usage(const char* prog){
+	printf("Usage : %s [-c <chunk size>] [-s <sector size>] [-q <depth>] [-t] [-y] [-n] <secured firmware> <device or image file> ...\n",prog);
+	printf("  -c  bytes per write, a multiple of %d, defaults to %d (erase block sized writes are the fastest on SD cards).\n",BUFFER_ALIGN,DEFAULT_CHUNK_SIZE);
+	printf("  -s  sector size used for plain image files, defaults to %d, block devices report their own.\n",DEFAULT_SECTOR_SIZE);
+	printf("  -q  writes kept in flight per device with io_uring, defaults to %d.\n",DEFAULT_QUEUE_DEPTH);
+	printf("  -t  uses one writer thread per device instead of io_uring.\n");
+	printf("  -y  does not ask for confirmation before overwriting the targets.\n");
+	printf("  -n  skips the read back verification.\n");
+}
+
+int main(int argc, char** argv){
+	long chunk=DEFAULT_CHUNK_SIZE;
+	long file_sector=DEFAULT_SECTOR_SIZE;
+	long depth=DEFAULT_QUEUE_DEPTH;
+	int use_threads=0;
+	int confirmed=0;
+	int verify=1;
+	int opt;
+
+	while((opt=getopt(argc,argv,"c:s:q:tyn"))!=-1){
+		switch(opt){
+		case 'c':
+			chunk=strtol(optarg,NULL,0);
+			break;
+		case 's':
+			file_sector=strtol(optarg,NULL,0);
+			break;
+		case 'q':
+			depth=strtol(optarg,NULL,0);
+			break;
+		case 't':
+			use_threads=1;
+			break;
+		case 'y':
+			confirmed=1;
+			break;
+		case 'n':
+			verify=0;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(argc-optind<2 || chunk<BUFFER_ALIGN || chunk%BUFFER_ALIGN!=0 || chunk>UINT32_MAX || depth<1 || depth>MAX_QUEUE_DEPTH
+	   || file_sector<META_SIZE || file_sector>BUFFER_ALIGN || (file_sector&(file_sector-1))!=0){
+		usage(argv[0]);
+		return 1;
+	}
+	int count=argc-optind-1;
+
+	struct image img;
+	if(load_image(&img,argv[optind],(size_t)chunk)<0){
+		return 1;
+	}
+
+	if(!confirmed){
+		char answer[8]={0};
+		printf("This will overwrite");
+		for(int i=0;i<count;i++){
+			printf(" %s",argv[optind+1+i]);
+		}
+		printf(". Are you sure? (y/N): ");
+		if(scanf("%7s",answer)!=1 || (answer[0]!='y' && answer[0]!='Y')){
+			printf("Operation canceled.\n");
+			free(img.data);
+			return 1;
+		}
+	}
+
+	struct device* devs=(struct device*)calloc(count,sizeof(struct device));
+	if(devs==NULL){
+		printf("Error : Out of memory\n");
+		free(img.data);
+		return 1;
+	}
+	int opened=0;
+	for(;opened<count;opened++){
+		if(device_init(&devs[opened],&img,argv[optind+1+opened],(uint32_t)file_sector,verify)<0){
+			break;
+		}
+	}
+	if(opened<count){
+		for(int i=0;i<opened;i++){
+			devs[i].status=-1;
+			device_finish(&devs[i]);
+		}
+		free(devs);
+		free(img.data);
+		return 1;
+	}
+
+	printf("Writing %llu bytes to %d target%s in %ld byte chunks%s...\n",(unsigned long long)img.size,count,count>1 ? "s" : "",chunk,verify ? ", verifying on the fly" : "");
+	double start=now_sec();
+	const char* engine="io_uring";
+	if(use_threads || run_uring(devs,count,(unsigned)depth)<0){
+		engine="threads";
+		run_threads(devs,count);
+	}
+	double written=now_sec()-start;
+
+	int failed=0;
+	for(int i=0;i<count;i++){
+		struct device* d=&devs[i];
+		device_finish(d);
+		if(d->status<0){
+			failed++;
+			printf("%s : FAILED\n",d->t.path);
+			continue;
+		}
+		double elapsed=d->end-d->start;
+		printf("%s : %.3f s, %.2f MB/s%s, size recorded in sector %llu%s\n",d->t.path,elapsed,elapsed>0 ? img.size/elapsed/1e6 : 0.0,
+			d->t.direct ? " (O_DIRECT)" : "",(unsigned long long)(d->t.size/d->t.sector-1),verify ? ", read back verified" : "");
+	}
+	double elapsed=now_sec()-start;
+	printf("Provisioned %d of %d targets with %s, %.3f s, %.2f MB/s aggregate",count-failed,count,engine,written,written>0 ? (double)img.size*(count-failed)/written/1e6 : 0.0);
+	if(verify){
+		printf(", %.3f s added by the read back",elapsed-written);
+	}
+	printf(".\n");
+	free(devs);
+	free(img.data);
+	return failed==0 ? 0 : 1;
+}
@@ -39,9 +39,15 @@ if [[ "$confirm" != "y" && "$confirm" != "Y" ]]; then
     exit 1
 fi
 
-# Write the firmware to the device using dd
+# Write the firmware to the device with flash2SD (large aligned writes, size sector, single fsync)
+flash2sd="$(dirname "$0")/flash2SD"
+if [ ! -x "$flash2sd" ]; then
+    echo "Error: $flash2sd not found, build it with:"
+    echo "    gcc -O2 flash2SD.c \"../AES and HMAC processing/sha1.c\" -o flash2SD -lpthread"
+    exit 1
+fi
 echo "Writing firmware to $device_file..."
-sudo dd if="$firmware_file" of="$device_file" bs=512 status=progress
+sudo "$flash2sd" -y "$firmware_file" "$device_file"
 if [ $? -eq 0 ]; then
     echo "Firmware successfully written to $device_file."
 else
@@ -49,10 +55,5 @@ else
     exit 1
 fi
 
-# Sync to ensure all data is written
-echo "Syncing data to $device_file..."
-sync
-
 # Completion message
 echo "Operation completed successfully."
-
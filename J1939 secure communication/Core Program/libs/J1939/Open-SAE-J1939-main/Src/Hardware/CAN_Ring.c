@@ -0,0 +1,66 @@
+/*
+ * CAN_Ring.c
+ *
+ *  Created on: 18 okt. 2026
+ */
+
+#include "CAN_Ring.h"
+
+/* The mask below only works for a power of two - This array gets a negative size otherwise */
+typedef char CAN_RING_SIZE_must_be_a_power_of_two[(CAN_RING_SIZE & (CAN_RING_SIZE - 1)) == 0 ? 1 : -1];
+
+void CAN_Ring_Init(CAN_Ring *ring) {
+	memset(ring, 0, sizeof(CAN_Ring));
+}
+
+/* Producer side, e.g the CAN RX interrupt. Returning false and counting an overflow if the ring is full */
+bool CAN_Ring_Push(CAN_Ring *ring, uint32_t ID, uint8_t DLC, uint8_t data[]) {
+	uint32_t head = ring->head;									/* Only this side writes head */
+	uint32_t waiting = head - CAN_RING_LOAD_ACQUIRE(ring->tail);
+	CAN_Frame *frame;
+	uint8_t i;
+	if (waiting >= CAN_RING_SIZE) {
+		ring->overflows++;
+		return false;
+	}
+
+	frame = &ring->frames[head & (CAN_RING_SIZE - 1)];
+	if (DLC > 8) {
+		DLC = 8;
+	}
+	frame->ID = ID;
+	frame->DLC = DLC;
+	for (i = 0; i < 8; i++) {
+		frame->data[i] = i < DLC ? data[i] : 0x0;
+	}
+
+	/* The frame must be complete before the consumer can see the new head */
+	CAN_RING_STORE_RELEASE(ring->head, head + 1);
+	if (waiting + 1 > ring->high_water) {
+		ring->high_water = waiting + 1;
+	}
+	return true;
+}
+
+/* Consumer side, e.g the J1939 loop. Frame i is ID[i], DLC[i] and data[i * 8] to data[i * 8 + 7], DLC may be NULL. Returning the number of frames popped */
+uint8_t CAN_Ring_Pop(CAN_Ring *ring, uint32_t ID[], uint8_t DLC[], uint8_t data[], uint8_t max_frames) {
+	uint32_t tail = ring->tail;									/* Only this side writes tail */
+	uint32_t waiting = CAN_RING_LOAD_ACQUIRE(ring->head) - tail;
+	uint8_t number_of_frames = waiting < max_frames ? (uint8_t)waiting : max_frames;
+	uint8_t i;
+	if (number_of_frames == 0) {
+		return 0;
+	}
+	for (i = 0; i < number_of_frames; i++) {
+		const CAN_Frame *frame = &ring->frames[(tail + i) & (CAN_RING_SIZE - 1)];
+		ID[i] = frame->ID;
+		if (DLC != NULL) {
+			DLC[i] = frame->DLC;
+		}
+		memcpy(&data[i * 8], frame->data, 8);
+	}
+
+	/* Hand the slots back to the producer once they have been copied out */
+	CAN_RING_STORE_RELEASE(ring->tail, tail + number_of_frames);
+	return number_of_frames;
+}
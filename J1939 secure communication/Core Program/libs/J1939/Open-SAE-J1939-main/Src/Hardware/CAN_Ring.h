@@ -0,0 +1,69 @@
+/*
+ * CAN_Ring.h
+ *
+ *  Created on: 18 okt. 2026
+ */
+
+#ifndef HARDWARE_CAN_RING_H_
+#define HARDWARE_CAN_RING_H_
+
+/* C Standard library */
+#include "../Open_SAE_J1939/C89_Library.h"
+
+/* Number of frames the ring can hold - Must be a power of two */
+#define CAN_RING_SIZE 256U
+
+/* Producer and consumer indexes are kept this many bytes apart so the ISR and the J1939 loop don't share a cache line */
+#define CAN_RING_CACHE_LINE 64U
+
+/* Acquire/release ordering between the producer (ISR or RX thread) and the consumer (J1939 loop) */
+#if defined(__GNUC__) || defined(__clang__)
+#define CAN_RING_LOAD_ACQUIRE(index) __atomic_load_n(&(index), __ATOMIC_ACQUIRE)
+#define CAN_RING_STORE_RELEASE(index, value) __atomic_store_n(&(index), (value), __ATOMIC_RELEASE)
+#define CAN_RING_ALIGNED __attribute__((aligned(CAN_RING_CACHE_LINE)))
+#else
+/* Single core MCU compilers and MSVC (/volatile:ms) keep volatile accesses in program order */
+#define CAN_RING_LOAD_ACQUIRE(index) (*(volatile uint32_t*)&(index))
+#define CAN_RING_STORE_RELEASE(index, value) (*(volatile uint32_t*)&(index) = (value))
+#define CAN_RING_ALIGNED
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One CAN frame, packed into 16 bytes so four frames share a cache line */
+typedef struct {
+	uint32_t ID;									/* Extended or standard CAN ID */
+	uint8_t DLC;									/* Number of data bytes */
+	uint8_t reserved[3];
+	uint8_t data[8];								/* Bytes after DLC are zero */
+} CAN_Frame;
+
+/* Single producer single consumer ring of CAN frames. head and tail run freely, the slot is index & (CAN_RING_SIZE - 1) */
+typedef struct {
+	/* Only written by the producer */
+	uint32_t head;									/* Frames pushed */
+	uint32_t overflows;								/* Frames dropped because the ring was full */
+	uint32_t high_water;							/* Highest number of frames that waited in the ring */
+	uint8_t padding_producer[CAN_RING_CACHE_LINE - 3 * sizeof(uint32_t)];
+
+	/* Only written by the consumer */
+	uint32_t tail;									/* Frames popped */
+	uint8_t padding_consumer[CAN_RING_CACHE_LINE - sizeof(uint32_t)];
+
+	CAN_Frame frames[CAN_RING_SIZE];
+} CAN_Ring;
+
+/* An empty ring, for static initializers */
+#define CAN_RING_EMPTY { 0, 0, 0, { 0 }, 0, { 0 }, { { 0, 0, { 0 }, { 0 } } } }
+
+void CAN_Ring_Init(CAN_Ring *ring);
+bool CAN_Ring_Push(CAN_Ring *ring, uint32_t ID, uint8_t DLC, uint8_t data[]);
+uint8_t CAN_Ring_Pop(CAN_Ring *ring, uint32_t ID[], uint8_t DLC[], uint8_t data[], uint8_t max_frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HARDWARE_CAN_RING_H_ */
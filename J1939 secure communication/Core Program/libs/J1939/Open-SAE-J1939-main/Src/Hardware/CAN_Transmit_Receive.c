@@ -11,7 +11,6 @@
 /* This is a call back function e.g listener, that will be called once SAE J1939 data is going to be sent */
 static void (*Callback_Function_Send)(uint32_t, uint8_t, uint8_t[]) = NULL;
 static void (*Callback_Function_Read)(uint32_t*, uint8_t[], bool*) = NULL;
-static void (*Callback_Function_Traffic)(uint32_t, uint8_t, uint8_t[], bool) = NULL;
 static void (*Callback_Function_Delay_ms)(uint8_t) = NULL;
 
 /* Platform independent library headers for CAN */
@@ -24,60 +23,26 @@ static void (*Callback_Function_Delay_ms)(uint8_t) = NULL;
 #include "CAN_to_USB/can_to_usb.h"
 #elif PROCESSOR_CHOICE == INTERNAL_CALLBACK
 /* Nothing here because else statement should not be running */
+#elif PROCESSOR_CHOICE == SOCKETCAN
+/* SocketCAN_Open gives a CAN_Interface its functions */
 #else
-/* Internal fields */
-static bool internal_new_message[256] = { false };
-static uint8_t internal_data[256 * 8] = { 0 };
-static uint8_t internal_DLC[256] = { 0 };
-static uint32_t internal_ID[256] = { 0 };
-static uint8_t buffer_index_transmit = 0;
-static uint8_t buffer_index_receive = 0;
-
 /* Internal functions */
 static ENUM_J1939_STATUS_CODES Internal_Transmit(uint32_t ID, uint8_t data[], uint8_t DLC) {
-	internal_ID[buffer_index_transmit] = ID;
-	internal_DLC[buffer_index_transmit] = DLC;
-	uint8_t i;
-	for (i = 0; i < 8; i++) {
-		if (i < DLC) {
-			internal_data[buffer_index_transmit * 8 + i] = data[i];
-		}
-		else {
-			internal_data[buffer_index_transmit * 8 + i] = 0x0;
-		}
-	}
-	internal_new_message[buffer_index_transmit] = true;
-	buffer_index_transmit++;									/* When this is 256, then it will be come 0 again */
-	return STATUS_SEND_OK;
-}
-
-static void Internal_Receive(uint32_t* ID, uint8_t data[], bool* is_new_message) {
-	/* Do a quick check if we are going to read message that have no data */
-	if (internal_new_message[buffer_index_receive] == false) {
-		*is_new_message = false;
-		return;
-	}
-
-	*ID = internal_ID[buffer_index_receive];
-	uint8_t i;
-	for (i = 0; i < 8; i++) {
-		if (i < internal_DLC[buffer_index_receive]) {
-			data[i] = internal_data[buffer_index_receive * 8 + i];
-		}
-	}
-	*is_new_message = internal_new_message[buffer_index_receive];
-	/* Reset */
-	internal_new_message[buffer_index_receive] = false;
-	internal_DLC[buffer_index_receive] = 0;
-	buffer_index_receive++;										/* When this is 256, then it will be come 0 again */
+	/* Feed the message back as if it was received */
+	return CAN_Store_Received_Message(NULL, ID, DLC, data) ? STATUS_SEND_OK : STATUS_SEND_BUSY;
 }
 #endif
 
-ENUM_J1939_STATUS_CODES CAN_Send_Message(uint32_t ID, uint8_t data[]) {
+/* The PROCESSOR_CHOICE functions of the default interface */
+static ENUM_J1939_STATUS_CODES Default_Transmit(void *context, uint32_t ID, uint8_t DLC, uint8_t data[]) {
 	ENUM_J1939_STATUS_CODES status = STATUS_SEND_BUSY;
+	(void)context;
+	(void)ID;
+	(void)DLC;
+	(void)data;
 #if PROCESSOR_CHOICE == STM32
 	CAN_TxHeaderTypeDef TxHeader;
-	TxHeader.DLC = 8;											/* Here we are sending 8 bytes */
+	TxHeader.DLC = DLC;											/* 8 bytes, or 3 bytes for a PGN request */
 	TxHeader.RTR = CAN_RTR_DATA;								/* Data frame */
 	TxHeader.IDE = CAN_ID_EXT;									/* We want to send an extended ID */
 	TxHeader.TransmitGlobalTime = DISABLE;
@@ -85,97 +50,221 @@ ENUM_J1939_STATUS_CODES CAN_Send_Message(uint32_t ID, uint8_t data[]) {
 	TxHeader.StdId = 0x00; 										/* Not used */
 	status = STM32_PLC_CAN_Transmit(data, &TxHeader);
 #elif PROCESSOR_CHOICE == ARDUINO
-	/* Implement your CAN send 8 bytes message function for the Arduino platform */
+	/* Implement your CAN send message function for the Arduino platform */
 #elif PROCESSOR_CHOICE == PIC
-	/* Implement your CAN send 8 bytes message function for the PIC platform */
+	/* Implement your CAN send message function for the PIC platform */
 #elif PROCESSOR_CHOICE == AVR
-	/* Implement your CAN send 8 bytes message function for the AVR platform */
+	/* Implement your CAN send message function for the AVR platform */
 #elif PROCESSOR_CHOICE == QT_USB
-	status = QT_USB_Transmit(ID, data, 8);
+	status = QT_USB_Transmit(ID, data, DLC);
 #elif PROCESSOR_CHOICE == INTERNAL_CALLBACK
 	/* Call our callback function */
-	Callback_Function_Send(ID, 8, data);
+	Callback_Function_Send(ID, DLC, data);
 	status = STATUS_SEND_OK;
+#elif PROCESSOR_CHOICE == SOCKETCAN
+	/* Open a SocketCAN channel on a CAN_Interface and give it to the J1939 struct */
 #else
 	/* If no processor are used, use internal feedback for debugging */
-	status = Internal_Transmit(ID, data, 8);
+	status = Internal_Transmit(ID, data, DLC);
 #endif
+	return status;
+}
 
-	/* Display traffic */
-	if (Callback_Function_Traffic != NULL) {
-		Callback_Function_Traffic(ID, 8, data, true); /* ID, 8 bytes of data, data array, TX = true */
+/* Called when the receive ring of the default interface is empty */
+static uint8_t Default_Poll(void *context) {
+	uint8_t number_of_messages = 0;
+	(void)context;
+#if PROCESSOR_CHOICE == QT_USB || PROCESSOR_CHOICE == INTERNAL_CALLBACK
+	/* These platforms hand over one message at the time */
+	uint32_t ID = 0;
+	uint8_t data[8] = {0};
+	bool is_new_message = false;
+#if PROCESSOR_CHOICE == QT_USB
+	QT_USB_Get_ID_Data(&ID, data, &is_new_message);
+#else
+	Callback_Function_Read(&ID, data, &is_new_message);
+#endif
+	if (is_new_message && CAN_Store_Received_Message(NULL, ID, 8, data)) {
+		number_of_messages = 1;
 	}
-
-	return status;
+#else
+	/* STM32, Arduino, PIC and AVR call CAN_Store_Received_Message from the CAN receive interrupt */
+#endif
+	return number_of_messages;
 }
 
-/* Send a PGN request
- * PGN: 0x00EA00 (59904)
- */
-ENUM_J1939_STATUS_CODES CAN_Send_Request(uint32_t ID, uint8_t PGN[]) {
-	ENUM_J1939_STATUS_CODES status = STATUS_SEND_BUSY;
+static bool Default_Set_Filters(void *context, uint32_t ID[], uint32_t mask[], uint8_t number_of_filters) {
+	bool is_set = false;
+	(void)context;
+	(void)ID;
+	(void)mask;
+	(void)number_of_filters;
 #if PROCESSOR_CHOICE == STM32
-	CAN_TxHeaderTypeDef TxHeader;
-	TxHeader.DLC = 3;											/* Here we are only sending 3 bytes */
-	TxHeader.RTR = CAN_RTR_DATA;								/* Data frame */
-	TxHeader.IDE = CAN_ID_EXT;									/* We want to send an extended ID */
-	TxHeader.TransmitGlobalTime = DISABLE;
-	TxHeader.ExtId = ID;
-	TxHeader.StdId = 0x00; 										/* Not used */
-	status = STM32_PLC_CAN_Transmit(PGN, &TxHeader);
+	is_set = STM32_PLC_CAN_Set_Filters(ID, mask, number_of_filters);
 #elif PROCESSOR_CHOICE == ARDUINO
-	/* Implement your CAN send 3 bytes message function for the Arduino platform */
+	/* Implement your CAN acceptance filters for the Arduino platform */
 #elif PROCESSOR_CHOICE == PIC
-	/* Implement your CAN send 3 bytes message function for the PIC platform */
+	/* Implement your CAN acceptance filters for the PIC platform */
 #elif PROCESSOR_CHOICE == AVR
-	/* Implement your CAN send 3 bytes message function for the AVR platform */
-#elif PROCESSOR_CHOICE == QT_USB
-	status = QT_USB_Transmit(ID, PGN, 3);                       /* PGN is always 3 bytes */
-#elif PROCESSOR_CHOICE == INTERNAL_CALLBACK
-	/* Call our callback function */
-	Callback_Function_Send(ID, 3, PGN);
-	status = STATUS_SEND_OK;
+	/* Implement your CAN acceptance filters for the AVR platform */
 #else
-	/* If no processor are used, use internal feedback for debugging */
-	status = Internal_Transmit(ID, PGN, 3);
+	/* No hardware filters here. Every frame reaches Open_SAE_J1939_Listen_For_Messages */
 #endif
-
-	/* Display traffic */
-	if (Callback_Function_Traffic != NULL) {
-		Callback_Function_Traffic(ID, 3, PGN, true); /* ID, 3 bytes of data, PGN array, TX = true */
-	}
-
-	return status;
+	return is_set;
 }
 
-/* Read the current CAN-bus message. Returning false if the message has been read before, else true */
-bool CAN_Read_Message(uint32_t* ID, uint8_t data[]) {
-	bool is_new_message = false;
+static void Default_Delay(void *context, uint8_t milliseconds) {
+	(void)context;
+	(void)milliseconds;
 #if PROCESSOR_CHOICE == STM32
-	STM32_PLC_CAN_Get_ID_Data(ID, data, &is_new_message);
+
 #elif PROCESSOR_CHOICE == ARDUINO
-	/* Implement your CAN function to get ID, data[] and the flag is_new_message here for the Arduino platform */
+
 #elif PROCESSOR_CHOICE == PIC
-	/* Implement your CAN function to get ID, data[] and the flag is_new_message here for the PIC platform */
+
 #elif PROCESSOR_CHOICE == AVR
-	/* Implement your CAN function to get ID, data[] and the flag is_new_message here for the AVR platform */
+
 #elif PROCESSOR_CHOICE == QT_USB
-	QT_USB_Get_ID_Data(ID, data, &is_new_message);
+
 #elif PROCESSOR_CHOICE == INTERNAL_CALLBACK
-	Callback_Function_Read(ID, data, &is_new_message);
+	Callback_Function_Delay_ms(milliseconds);
 #else
-	/* If no processor are used, use internal feedback for debugging */
-	Internal_Receive(ID, data, &is_new_message);
+	/* Nothing */
 #endif
+}
+
+/* Every J1939 with can = NULL shares this interface. The CAN receive interrupt or RX thread is the only producer of its receive ring */
+static CAN_Interface default_interface CAN_RING_ALIGNED = { Default_Transmit, NULL, Default_Poll, Default_Set_Filters, Default_Delay, NULL, NULL, CAN_MAX_ACCEPTANCE_FILTERS, CAN_RING_EMPTY };
+
+static CAN_Interface *Get_Interface(CAN_Interface *can) {
+	return can != NULL ? can : &default_interface;
+}
+
+/* An interface without functions. Fill in Transmit and the optional functions, or let a driver such as SocketCAN_Open do it */
+void CAN_Interface_Init(CAN_Interface *can) {
+	memset(can, 0, sizeof(CAN_Interface));
+	CAN_Ring_Init(&can->receive_ring);
+}
+
+/* Send one frame with 1 to 8 bytes of data */
+static ENUM_J1939_STATUS_CODES Transmit(CAN_Interface *can, uint32_t ID, uint8_t DLC, uint8_t data[]) {
+	ENUM_J1939_STATUS_CODES status = STATUS_SEND_ERROR;
+	can = Get_Interface(can);
+	if (can->Transmit != NULL) {
+		status = can->Transmit(can->context, ID, DLC, data);
+	}
 
 	/* Display traffic */
-	if (Callback_Function_Traffic != NULL && is_new_message) {
-		Callback_Function_Traffic(*ID, 8, data, false); /* ID, 8 bytes of data, data array, TX = false */
+	if (can->Traffic != NULL) {
+		can->Traffic(ID, DLC, data, true); /* ID, DLC bytes of data, data array, TX = true */
 	}
 
-	return is_new_message;
+	return status;
+}
+
+ENUM_J1939_STATUS_CODES CAN_Send_Message(CAN_Interface *can, uint32_t ID, uint8_t data[]) {
+	return Transmit(can, ID, 8, data);
 }
 
+/* Send a PGN request
+ * PGN: 0x00EA00 (59904)
+ */
+ENUM_J1939_STATUS_CODES CAN_Send_Request(CAN_Interface *can, uint32_t ID, uint8_t PGN[]) {
+	return Transmit(can, ID, 3, PGN);												/* PGN is always 3 bytes */
+}
+
+/*
+ * Send 8 bytes messages, message i is ID[i] and data[i * 8] to data[i * 8 + 7]. Stops at the first message that could not be sent.
+ * number_of_messages_sent tells how many went out, so the caller can send the rest from message number_of_messages_sent later
+ */
+ENUM_J1939_STATUS_CODES CAN_Send_Messages(CAN_Interface *can, uint32_t ID[], uint8_t data[], uint8_t number_of_messages, uint8_t *number_of_messages_sent) {
+	ENUM_J1939_STATUS_CODES status = STATUS_SEND_OK;
+	uint8_t sent = 0;
+	uint8_t i;
+	can = Get_Interface(can);
+	if (can->Transmit_Batch != NULL) {
+		/* One call for the whole batch */
+		status = can->Transmit_Batch(can->context, ID, data, number_of_messages, &sent);
+		if (sent > number_of_messages) {
+			sent = number_of_messages;
+		}
+
+		/* Display traffic - Only the messages that went out */
+		if (can->Traffic != NULL) {
+			for (i = 0; i < sent; i++) {
+				can->Traffic(ID[i], 8, &data[i * 8], true); /* ID, 8 bytes of data, data array, TX = true */
+			}
+		}
+	} else {
+		while (sent < number_of_messages && status == STATUS_SEND_OK) {
+			status = Transmit(can, ID[sent], 8, &data[sent * 8]);
+			if (status == STATUS_SEND_OK) {
+				sent++;
+			}
+		}
+	}
+	*number_of_messages_sent = sent;
+	return status;
+}
+
+/* Read the current CAN-bus message. Returning false if the message has been read before, else true */
+bool CAN_Read_Message(CAN_Interface *can, uint32_t *ID, uint8_t data[]) {
+	return CAN_Read_Messages(can, ID, data, 1) == 1;
+}
+
+/* Read all new CAN-bus messages, at most max_messages. Message i is ID[i] and data[i * 8] to data[i * 8 + 7]. Returning the number of messages read */
+uint8_t CAN_Read_Messages(CAN_Interface *can, uint32_t ID[], uint8_t data[], uint8_t max_messages) {
+	uint8_t number_of_messages = 0;
+	uint8_t DLC[CAN_READ_BATCH];
+	uint8_t popped;
+	uint8_t i;
+	can = Get_Interface(can);
+	while (number_of_messages < max_messages) {
+		popped = CAN_Ring_Pop(&can->receive_ring, &ID[number_of_messages], DLC, &data[number_of_messages * 8], max_messages - number_of_messages < (int)CAN_READ_BATCH ? (uint8_t)(max_messages - number_of_messages) : CAN_READ_BATCH);
+
+		/* The receive ring is empty, ask the hardware for more */
+		if (popped == 0 && (can->Poll == NULL || can->Poll(can->context) == 0)) {
+			break;
+		}
+
+		/* Display traffic */
+		if (can->Traffic != NULL) {
+			for (i = 0; i < popped; i++) {
+				can->Traffic(ID[number_of_messages + i], DLC[i], &data[(number_of_messages + i) * 8], false); /* ID, DLC, data array, TX = false */
+			}
+		}
+		number_of_messages += popped;
+	}
+	return number_of_messages;
+}
+
+/* Store a received CAN-bus message until the J1939 loop reads it. Call this from the CAN receive interrupt or RX thread. Returning false if the message was dropped */
+bool CAN_Store_Received_Message(CAN_Interface *can, uint32_t ID, uint8_t DLC, uint8_t data[]) {
+	return CAN_Ring_Push(&Get_Interface(can)->receive_ring, ID, DLC, data);
+}
+
+/* How many received messages have been dropped because the J1939 loop was too slow, and how many have waited at the most */
+void CAN_Get_Receive_Statistics(CAN_Interface *can, uint32_t *overflows, uint32_t *high_water) {
+	can = Get_Interface(can);
+	*overflows = can->receive_ring.overflows;
+	*high_water = can->receive_ring.high_water;
+}
+
+/* Let the CAN hardware drop every frame that matches none of the (frame ID & mask[i]) == ID[i] pairs. Returning false if the hardware cannot do it */
+bool CAN_Set_Acceptance_Filters(CAN_Interface *can, uint32_t ID[], uint32_t mask[], uint8_t number_of_filters) {
+	can = Get_Interface(can);
+	if (can->Set_Filters == NULL || number_of_filters > can->max_filters) {
+		return false;
+	}
+	return can->Set_Filters(can->context, ID, mask, number_of_filters);
+}
+
+/* How many ID/mask pairs CAN_Set_Acceptance_Filters can take, 0 = none */
+uint8_t CAN_Get_Max_Acceptance_Filters(CAN_Interface *can) {
+	return Get_Interface(can)->Set_Filters != NULL ? Get_Interface(can)->max_filters : 0;
+}
+
+/* Set the functions of the default interface for INTERNAL_CALLBACK, and the traffic display of the default interface */
 void CAN_Set_Callback_Functions(void (*Callback_Function_Send_)(uint32_t, uint8_t, uint8_t[]),
 	void (*Callback_Function_Read_)(uint32_t*, uint8_t[], bool*),
 	void (*Callback_Function_Traffic_)(uint32_t, uint8_t, uint8_t[], bool),
@@ -183,24 +272,13 @@ void CAN_Set_Callback_Functions(void (*Callback_Function_Send_)(uint32_t, uint8_
 ) {
 	Callback_Function_Send = Callback_Function_Send_;
 	Callback_Function_Read = Callback_Function_Read_;
-	Callback_Function_Traffic = Callback_Function_Traffic_;
+	default_interface.Traffic = Callback_Function_Traffic_;
 	Callback_Function_Delay_ms = Callback_Function_Delay_ms_;
 }
 
-void CAN_Delay(uint8_t milliseconds) {
-#if PROCESSOR_CHOICE == STM32
-
-#elif PROCESSOR_CHOICE == ARDUINO
-
-#elif PROCESSOR_CHOICE == PIC
-
-#elif PROCESSOR_CHOICE == AVR
-
-#elif PROCESSOR_CHOICE == QT_USB
-
-#elif PROCESSOR_CHOICE == INTERNAL_CALLBACK
-	Callback_Function_Delay_ms(milliseconds);
-#else
-	/* Nothing */
-#endif
+void CAN_Delay(CAN_Interface *can, uint8_t milliseconds) {
+	can = Get_Interface(can);
+	if (can->Delay_ms != NULL) {
+		can->Delay_ms(can->context, milliseconds);
+	}
 }
@@ -0,0 +1,263 @@
+/*
+ * Gateway.c
+ *
+ *  Created on: 18 okt. 2026
+ */
+
+/* pthread_setaffinity_np */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+ /* Layer */
+#include "Hardware.h"
+
+#if PROCESSOR_CHOICE == SOCKETCAN
+#include "Gateway.h"
+
+#include <sched.h>
+#include <time.h>
+
+/* Send on this channel what the other channels have routed to it */
+static uint32_t Forward_Frames(Gateway_Channel *channel) {
+	Gateway *gateway = channel->gateway;
+	uint32_t ID[GATEWAY_BATCH];
+	uint8_t data[GATEWAY_BATCH * 8];
+	uint32_t forwarded = 0;
+	uint8_t number_of_frames, number_of_frames_sent;
+	uint8_t from;
+	for (from = 0; from < gateway->number_of_channels; from++) {
+		if (from == channel->number) {
+			continue;
+		}
+		number_of_frames = CAN_Ring_Pop(&gateway->routes[from][channel->number], ID, NULL, data, GATEWAY_BATCH);
+		if (number_of_frames == 0) {
+			continue;
+		}
+		CAN_Send_Messages(channel->j1939->can, ID, data, number_of_frames, &number_of_frames_sent);
+		channel->frames_sent += number_of_frames_sent;
+		channel->frames_dropped += number_of_frames - number_of_frames_sent;
+		forwarded += number_of_frames;
+	}
+	return forwarded;
+}
+
+/* Read the bus, then route every frame to the queues of the other channels and/or to the J1939 of this channel */
+static uint32_t Receive_Frames(Gateway_Channel *channel) {
+	Gateway *gateway = channel->gateway;
+	uint32_t ID[GATEWAY_BATCH];
+	uint8_t data[GATEWAY_BATCH * 8];
+	uint32_t routes;
+	uint8_t number_of_frames = CAN_Read_Messages(channel->j1939->can, ID, data, GATEWAY_BATCH);
+	uint8_t i, to;
+	for (i = 0; i < number_of_frames; i++) {
+		routes = gateway->Route != NULL ? gateway->Route(gateway->route_data, channel->number, ID[i], &data[i * 8]) : 1UL << channel->number;
+		if (routes & (1UL << channel->number)) {
+			Open_SAE_J1939_Process_Message(channel->j1939, ID[i], &data[i * 8]);
+		}
+		for (to = 0; to < gateway->number_of_channels; to++) {
+			if (to == channel->number || !(routes & (1UL << to))) {
+				continue;
+			}
+			if (CAN_Ring_Push(&gateway->routes[channel->number][to], ID[i], 8, &data[i * 8])) {
+				channel->frames_forwarded++;
+			} else {
+				channel->frames_dropped++;
+			}
+		}
+	}
+	channel->frames_received += number_of_frames;
+	return number_of_frames;
+}
+
+/* Call Done of the finished jobs of this channel, on this thread, so they can use the J1939 of the channel */
+static uint32_t Finish_Jobs(Gateway_Channel *channel) {
+	Gateway *gateway = channel->gateway;
+	Gateway_Job job;
+	uint32_t finished = 0;
+	if (CAN_RING_LOAD_ACQUIRE(channel->done_head) == channel->done_tail) {
+		return 0;
+	}
+	pthread_mutex_lock(&gateway->job_lock);
+	while (channel->done_tail != channel->done_head) {
+		job = channel->done[channel->done_tail & (GATEWAY_JOB_QUEUE_SIZE - 1)];
+		channel->done_tail++;
+		pthread_mutex_unlock(&gateway->job_lock);
+		if (job.Done != NULL) {
+			job.Done(channel->j1939, job.argument);
+		}
+		finished++;
+		pthread_mutex_lock(&gateway->job_lock);
+	}
+	pthread_mutex_unlock(&gateway->job_lock);
+	return finished;
+}
+
+/* Give the measured time to SAE_J1939_Transport_Protocol_Tick in whole milliseconds. The rest is kept for the next pass */
+static void Tick(Gateway_Channel *channel, struct timespec *last, int64_t *elapsed_ns) {
+	struct timespec now;
+	uint64_t elapsed_ms;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	*elapsed_ns += (int64_t)(now.tv_sec - last->tv_sec) * 1000000000LL + (now.tv_nsec - last->tv_nsec);
+	*last = now;
+	if (*elapsed_ns < 1000000LL) {
+		return;
+	}
+	elapsed_ms = (uint64_t)(*elapsed_ns / 1000000LL);
+	*elapsed_ns %= 1000000LL;
+	SAE_J1939_Transport_Protocol_Tick(channel->j1939, elapsed_ms > 0xFFFFU ? 0xFFFFU : (uint16_t)elapsed_ms);
+}
+
+static void *Channel_Thread(void *argument) {
+	Gateway_Channel *channel = (Gateway_Channel*)argument;
+	struct timespec idle, last;
+	int64_t elapsed_ns = 0;
+	uint32_t work;
+#ifdef CPU_SET
+	cpu_set_t cpus;
+	if (channel->cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(channel->cpu, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+#endif
+	idle.tv_sec = 0;
+	idle.tv_nsec = GATEWAY_IDLE_MICROSECONDS * 1000L;
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	while (channel->gateway->is_running) {
+		work = Receive_Frames(channel);
+		work += Forward_Frames(channel);
+		work += Finish_Jobs(channel);
+		Tick(channel, &last, &elapsed_ns);
+		if (work == 0) {
+			nanosleep(&idle, NULL);
+		}
+	}
+	return NULL;
+}
+
+static void *Worker_Thread(void *argument) {
+	Gateway *gateway = (Gateway*)argument;
+	Gateway_Channel *channel;
+	Gateway_Job job;
+	pthread_mutex_lock(&gateway->job_lock);
+	for (;;) {
+		while (gateway->job_tail == gateway->job_head && gateway->is_running) {
+			pthread_cond_wait(&gateway->job_ready, &gateway->job_lock);
+		}
+		if (gateway->job_tail == gateway->job_head) {
+			break;										/* Stopped and no jobs left */
+		}
+		job = gateway->jobs[gateway->job_tail & (GATEWAY_JOB_QUEUE_SIZE - 1)];
+		gateway->job_tail++;
+		pthread_mutex_unlock(&gateway->job_lock);
+
+		job.Work(job.argument);
+
+		/* Hand the job back to its channel. If the done queue is full, wait for the channel to empty it */
+		channel = &gateway->channels[job.channel];
+		pthread_mutex_lock(&gateway->job_lock);
+		while (channel->done_head - channel->done_tail >= GATEWAY_JOB_QUEUE_SIZE && gateway->is_running) {
+			pthread_mutex_unlock(&gateway->job_lock);
+			sched_yield();
+			pthread_mutex_lock(&gateway->job_lock);
+		}
+		if (channel->done_head - channel->done_tail >= GATEWAY_JOB_QUEUE_SIZE) {
+			channel->jobs_dropped++;					/* Stopped, the channel will not empty its done queue again */
+		} else {
+			channel->done[channel->done_head & (GATEWAY_JOB_QUEUE_SIZE - 1)] = job;
+			CAN_RING_STORE_RELEASE(channel->done_head, channel->done_head + 1);
+		}
+	}
+	pthread_mutex_unlock(&gateway->job_lock);
+	return NULL;
+}
+
+void Gateway_Init(Gateway *gateway, Gateway_Route_Function Route, void *route_data) {
+	memset(gateway, 0, sizeof(Gateway));
+	gateway->Route = Route;
+	gateway->route_data = route_data;
+	pthread_mutex_init(&gateway->job_lock, NULL);
+	pthread_cond_init(&gateway->job_ready, NULL);
+}
+
+/* j1939->can must be the interface of the bus. Returning the channel number, or GATEWAY_MAX_CHANNELS if there is no room */
+uint8_t Gateway_Add_Channel(Gateway *gateway, J1939 *j1939, int cpu) {
+	Gateway_Channel *channel;
+	if (gateway->number_of_channels >= GATEWAY_MAX_CHANNELS || gateway->is_running) {
+		return GATEWAY_MAX_CHANNELS;
+	}
+	channel = &gateway->channels[gateway->number_of_channels];
+	channel->gateway = gateway;
+	channel->number = gateway->number_of_channels;
+	channel->j1939 = j1939;
+	channel->cpu = cpu;
+	return gateway->number_of_channels++;
+}
+
+/* Start one thread for every channel and number_of_workers worker threads */
+bool Gateway_Start(Gateway *gateway, uint8_t number_of_workers) {
+	uint8_t i;
+	if (number_of_workers > GATEWAY_MAX_WORKERS) {
+		number_of_workers = GATEWAY_MAX_WORKERS;
+	}
+	gateway->is_running = true;
+	for (i = 0; i < number_of_workers; i++) {
+		if (pthread_create(&gateway->workers[i], NULL, Worker_Thread, gateway) != 0) {
+			break;
+		}
+		gateway->number_of_workers++;
+	}
+	for (i = 0; i < gateway->number_of_channels; i++) {
+		if (pthread_create(&gateway->channels[i].thread, NULL, Channel_Thread, &gateway->channels[i]) != 0) {
+			gateway->number_of_channels = i;
+			Gateway_Stop(gateway);
+			return false;
+		}
+	}
+	return gateway->number_of_workers == number_of_workers;
+}
+
+/*
+ * The workers finish the jobs that are queued. Done is not called for jobs that finish after their channel has stopped,
+ * those jobs are counted in jobs_dropped of their channel instead
+ */
+void Gateway_Stop(Gateway *gateway) {
+	uint8_t i;
+	pthread_mutex_lock(&gateway->job_lock);
+	gateway->is_running = false;
+	pthread_cond_broadcast(&gateway->job_ready);
+	pthread_mutex_unlock(&gateway->job_lock);
+	for (i = 0; i < gateway->number_of_channels; i++) {
+		pthread_join(gateway->channels[i].thread, NULL);
+	}
+	for (i = 0; i < gateway->number_of_workers; i++) {
+		pthread_join(gateway->workers[i], NULL);
+	}
+	gateway->number_of_workers = 0;
+	for (i = 0; i < gateway->number_of_channels; i++) {
+		gateway->channels[i].jobs_dropped += gateway->channels[i].done_head - gateway->channels[i].done_tail;
+		gateway->channels[i].done_tail = gateway->channels[i].done_head;
+	}
+}
+
+/* Run Work on a worker thread, then Done on the thread of channel. Can be called from any thread. Returning false if the job queue is full */
+bool Gateway_Submit(Gateway *gateway, uint8_t channel, void (*Work)(void *argument), void (*Done)(J1939 *j1939, void *argument), void *argument) {
+	Gateway_Job *job;
+	bool is_queued = false;
+	pthread_mutex_lock(&gateway->job_lock);
+	if (gateway->job_head - gateway->job_tail < GATEWAY_JOB_QUEUE_SIZE && channel < gateway->number_of_channels) {
+		job = &gateway->jobs[gateway->job_head & (GATEWAY_JOB_QUEUE_SIZE - 1)];
+		job->Work = Work;
+		job->Done = Done;
+		job->argument = argument;
+		job->channel = channel;
+		gateway->job_head++;
+		pthread_cond_signal(&gateway->job_ready);
+		is_queued = true;
+	}
+	pthread_mutex_unlock(&gateway->job_lock);
+	return is_queued;
+}
+
+#endif
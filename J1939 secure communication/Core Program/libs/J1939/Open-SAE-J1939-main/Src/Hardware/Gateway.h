@@ -0,0 +1,99 @@
+/*
+ * Gateway.h
+ *
+ *  Created on: 18 okt. 2026
+ */
+
+#ifndef HARDWARE_GATEWAY_H_
+#define HARDWARE_GATEWAY_H_
+
+/* Layers */
+#include "Hardware.h"
+#include "../Open_SAE_J1939/Open_SAE_J1939.h"
+
+#include <pthread.h>
+
+/* Most CAN-bus channels of one gateway. Route masks are 32-bit */
+#define GATEWAY_MAX_CHANNELS 8U
+
+/* Most worker threads for the jobs, e.g HMAC and AES of firmware chunks */
+#define GATEWAY_MAX_WORKERS 8U
+
+/* Most jobs that wait for a worker, and most finished jobs that wait for their channel. Must be a power of two */
+#define GATEWAY_JOB_QUEUE_SIZE 64U
+
+/* Frames a channel thread reads, or forwards from one other channel, in one pass */
+#define GATEWAY_BATCH 32U
+
+/* How long a channel thread sleeps when a pass found nothing to do */
+#define GATEWAY_IDLE_MICROSECONDS 50U
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Where a frame received on from_channel goes. Bit i set = send it on channel i, bit from_channel set = the J1939 of from_channel reads it */
+typedef uint32_t (*Gateway_Route_Function)(void *route_data, uint8_t from_channel, uint32_t ID, uint8_t data[]);
+
+typedef struct {
+	void (*Work)(void *argument);					/* Runs on a worker thread */
+	void (*Done)(J1939 *j1939, void *argument);		/* Optional - Runs on the thread of the channel that gave the job */
+	void *argument;
+	uint8_t channel;
+} Gateway_Job;
+
+struct Gateway;
+
+/* One CAN-bus. Only its own thread touches j1939 and the CAN_Interface of j1939, and it calls SAE_J1939_Transport_Protocol_Tick for j1939 */
+typedef struct {
+	struct Gateway *gateway;
+	uint8_t number;
+	J1939 *j1939;
+	int cpu;										/* The thread is pinned to this CPU, -1 = not pinned */
+	pthread_t thread;
+
+	/* Finished jobs, written by the workers under job_lock */
+	Gateway_Job done[GATEWAY_JOB_QUEUE_SIZE];
+	uint32_t done_head;
+	uint32_t done_tail;
+	uint32_t jobs_dropped;							/* Finished jobs whose Done never ran because the gateway stopped */
+
+	/* Only written by the thread of the channel */
+	uint32_t frames_received;
+	uint32_t frames_forwarded;						/* Received frames put on the queue of another channel */
+	uint32_t frames_sent;							/* Frames from other channels sent on this bus */
+	uint32_t frames_dropped;						/* A queue was full or the bus was busy */
+} Gateway_Channel;
+
+typedef struct Gateway {
+	Gateway_Channel channels[GATEWAY_MAX_CHANNELS];
+	uint8_t number_of_channels;
+
+	/* routes[from][to] - One single producer single consumer ring for every pair of channels, so forwarding takes no lock */
+	CAN_Ring routes[GATEWAY_MAX_CHANNELS][GATEWAY_MAX_CHANNELS];
+	Gateway_Route_Function Route;					/* NULL = every frame stays on its own channel */
+	void *route_data;
+
+	/* Worker pool */
+	pthread_t workers[GATEWAY_MAX_WORKERS];
+	uint8_t number_of_workers;
+	pthread_mutex_t job_lock;
+	pthread_cond_t job_ready;
+	Gateway_Job jobs[GATEWAY_JOB_QUEUE_SIZE];
+	uint32_t job_head;
+	uint32_t job_tail;
+
+	volatile bool is_running;
+} Gateway;
+
+void Gateway_Init(Gateway *gateway, Gateway_Route_Function Route, void *route_data);
+uint8_t Gateway_Add_Channel(Gateway *gateway, J1939 *j1939, int cpu);
+bool Gateway_Start(Gateway *gateway, uint8_t number_of_workers);
+void Gateway_Stop(Gateway *gateway);
+bool Gateway_Submit(Gateway *gateway, uint8_t channel, void (*Work)(void *argument), void (*Done)(J1939 *j1939, void *argument), void *argument);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HARDWARE_GATEWAY_H_ */
@@ -16,11 +16,25 @@
 #define AVR 4
 #define QT_USB 5
 #define INTERNAL_CALLBACK 6
+#define SOCKETCAN 7
 #define PROCESSOR_CHOICE NO_PROCESSOR
 
+/* How many ID/mask acceptance filters the CAN hardware of the default interface has. 0 = every frame is read */
+#if PROCESSOR_CHOICE == STM32
+#define CAN_MAX_ACCEPTANCE_FILTERS 14U						/* bxCAN filter banks in 32-bit mask mode for CAN1 */
+#else
+#define CAN_MAX_ACCEPTANCE_FILTERS 0U
+#endif
+
+/* Most frames CAN_Read_Messages takes from the receive ring at a time, it keeps their DLC on the stack for Traffic */
+#define CAN_READ_BATCH 32U
+
 /* C Standard library */
 #include "../Open_SAE_J1939/C89_Library.h"
 
+/* Receive ring */
+#include "CAN_Ring.h"
+
 /* Enums */
 #include "../SAE_J1939/SAE_J1939_Enums/Enum_DM14_DM15.h"
 #include "../SAE_J1939/SAE_J1939_Enums/Enum_Send_Status.h"
@@ -29,10 +43,33 @@
 extern "C" {
 #endif
 
-ENUM_J1939_STATUS_CODES CAN_Send_Message(uint32_t ID, uint8_t data[]);
-ENUM_J1939_STATUS_CODES CAN_Send_Request(uint32_t ID, uint8_t PGN[]);
-bool CAN_Read_Message(uint32_t *ID, uint8_t data[]);
-void CAN_Delay(uint8_t milliseconds);
+/*
+ * One CAN-bus channel with its own functions and receive ring. Every J1939 struct with can = NULL shares the default interface,
+ * which has the functions of PROCESSOR_CHOICE. Give each J1939 its own interface to run independent buses in one program
+ */
+typedef struct CAN_Interface {
+	ENUM_J1939_STATUS_CODES (*Transmit)(void *context, uint32_t ID, uint8_t DLC, uint8_t data[]);
+	ENUM_J1939_STATUS_CODES (*Transmit_Batch)(void *context, uint32_t ID[], uint8_t data[], uint8_t number_of_messages, uint8_t *number_of_messages_sent);	/* Optional - 8 bytes messages */
+	uint8_t (*Poll)(void *context);									/* Optional - Called when the receive ring is empty. Stores new messages with CAN_Store_Received_Message */
+	bool (*Set_Filters)(void *context, uint32_t ID[], uint32_t mask[], uint8_t number_of_filters);	/* Optional */
+	void (*Delay_ms)(void *context, uint8_t milliseconds);			/* Optional */
+	void (*Traffic)(uint32_t ID, uint8_t DLC, uint8_t data[], bool is_TX);	/* Optional - Display traffic */
+	void *context;													/* Given to the functions above, e.g a socket or a simulated bus */
+	uint8_t max_filters;											/* Most ID/mask pairs Set_Filters takes */
+	CAN_Ring receive_ring;											/* Received messages waiting for the J1939 loop */
+} CAN_Interface;
+
+void CAN_Interface_Init(CAN_Interface *can);
+ENUM_J1939_STATUS_CODES CAN_Send_Message(CAN_Interface *can, uint32_t ID, uint8_t data[]);
+ENUM_J1939_STATUS_CODES CAN_Send_Request(CAN_Interface *can, uint32_t ID, uint8_t PGN[]);
+ENUM_J1939_STATUS_CODES CAN_Send_Messages(CAN_Interface *can, uint32_t ID[], uint8_t data[], uint8_t number_of_messages, uint8_t *number_of_messages_sent);
+bool CAN_Read_Message(CAN_Interface *can, uint32_t *ID, uint8_t data[]);
+uint8_t CAN_Read_Messages(CAN_Interface *can, uint32_t ID[], uint8_t data[], uint8_t max_messages);
+bool CAN_Store_Received_Message(CAN_Interface *can, uint32_t ID, uint8_t DLC, uint8_t data[]);
+void CAN_Get_Receive_Statistics(CAN_Interface *can, uint32_t *overflows, uint32_t *high_water);
+bool CAN_Set_Acceptance_Filters(CAN_Interface *can, uint32_t ID[], uint32_t mask[], uint8_t number_of_filters);
+uint8_t CAN_Get_Max_Acceptance_Filters(CAN_Interface *can);
+void CAN_Delay(CAN_Interface *can, uint8_t milliseconds);
 void CAN_Set_Callback_Functions(void (*Callback_Function_Send_)(uint32_t, uint8_t, uint8_t[]), void (*Callback_Function_Read_)(uint32_t*, uint8_t[], bool*), void (*Callback_Function_Traffic_)(uint32_t, uint8_t, uint8_t[], bool), void (*Callback_Function_Delay_ms_)(uint8_t));
 void FLASH_EEPROM_RAM_Memory(uint16_t *number_of_requested_bytes, uint8_t pointer_type, uint8_t *command, uint32_t *pointer, uint8_t *pointer_extension, uint16_t *key, uint8_t raw_binary_data[]);
 bool Save_Struct(uint8_t data[], uint32_t data_length, char file_name[]);
@@ -0,0 +1,290 @@
+/*
+ * SocketCAN.c
+ *
+ *  Created on: 18 okt. 2026
+ */
+
+/* recvmmsg and sendmmsg */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+ /* Layer */
+#include "Hardware.h"
+
+#if PROCESSOR_CHOICE == SOCKETCAN
+#include "SocketCAN.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+/* Read one burst of frames from the socket into the receive ring without blocking. Returns the number of frames, or -1 with errno set */
+static int SocketCAN_Receive(SocketCAN_Channel *channel) {
+	struct can_frame frames[SOCKETCAN_BATCH];
+	struct iovec iov[SOCKETCAN_BATCH];
+	uint8_t control[SOCKETCAN_BATCH][CMSG_SPACE(sizeof(struct timeval))];	/* Holds the SO_TIMESTAMP of the frame */
+	struct mmsghdr headers[SOCKETCAN_BATCH];
+	struct cmsghdr *cmsg;
+	struct timeval timestamp;
+	int number_of_frames;
+	uint8_t i;
+	for (i = 0; i < SOCKETCAN_BATCH; i++) {
+		iov[i].iov_base = &frames[i];
+		iov[i].iov_len = sizeof(struct can_frame);
+		memset(&headers[i], 0, sizeof(struct mmsghdr));
+		headers[i].msg_hdr.msg_iov = &iov[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+		headers[i].msg_hdr.msg_control = control[i];
+		headers[i].msg_hdr.msg_controllen = sizeof(control[i]);
+	}
+	number_of_frames = recvmmsg(channel->socket, headers, SOCKETCAN_BATCH, MSG_DONTWAIT, NULL);
+	if (number_of_frames <= 0) {
+		return number_of_frames;
+	}
+
+	for (i = 0; i < number_of_frames; i++) {
+		struct can_frame *frame = &frames[i];
+		if (headers[i].msg_len < sizeof(struct can_frame) || (frame->can_id & (CAN_ERR_FLAG | CAN_RTR_FLAG))) {
+			continue;
+		}
+		for (cmsg = CMSG_FIRSTHDR(&headers[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&headers[i].msg_hdr, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMP) {
+				memcpy(&timestamp, CMSG_DATA(cmsg), sizeof(struct timeval));
+				channel->last_timestamp_seconds = (uint32_t)timestamp.tv_sec;
+				channel->last_timestamp_microseconds = (uint32_t)timestamp.tv_usec;
+			}
+		}
+		if (frame->can_id & CAN_EFF_FLAG) {
+			CAN_Store_Received_Message(channel->can, frame->can_id & CAN_EFF_MASK, frame->can_dlc, frame->data);
+		} else {
+			CAN_Store_Received_Message(channel->can, frame->can_id & CAN_SFF_MASK, frame->can_dlc, frame->data);
+		}
+	}
+	return number_of_frames;
+}
+
+/*
+ * The receive thread is then the only producer of the receive ring. It sleeps in poll on the socket and the wake event, a raw CAN socket
+ * ignores shutdown so SocketCAN_Close wakes it with the event. A read that fails for another reason than EINTR, or a socket that polls
+ * readable but gives nothing, is counted and followed by a growing pause instead of a busy loop
+ */
+static void *SocketCAN_Receive_Thread(void *argument) {
+	SocketCAN_Channel *channel = (SocketCAN_Channel*)argument;
+	struct pollfd fds[2];
+	int backoff_ms = 0;									/* Grows with every failed read in a row, back to 0 when a frame arrives */
+	int pause_ms = 0;
+	int result;
+	fds[0].fd = channel->socket;
+	fds[0].events = POLLIN;
+	fds[1].fd = channel->wake_event;
+	fds[1].events = POLLIN;
+	while (channel->is_running) {
+		if (pause_ms > 0) {
+			/* Pause after a failed read, the wake event still ends it at once */
+			if (poll(&fds[1], 1, pause_ms) > 0) {
+				break;
+			}
+			pause_ms = 0;
+			continue;
+		}
+		result = poll(fds, 2, -1);
+		if (result > 0 && fds[1].revents != 0) {
+			break;
+		}
+		if (result > 0) {
+			result = SocketCAN_Receive(channel);		/* EAGAIN here means the socket polled readable but gave nothing */
+		}
+		if (result > 0) {
+			backoff_ms = 0;
+		} else if (result == 0 || errno != EINTR) {
+			channel->receive_errors++;
+			backoff_ms = backoff_ms == 0 ? 1 : backoff_ms * 2;
+			if (backoff_ms > (int)SOCKETCAN_MAX_BACKOFF_MS) {
+				backoff_ms = (int)SOCKETCAN_MAX_BACKOFF_MS;
+			}
+			pause_ms = backoff_ms;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Open a raw CAN socket on interface_name e.g "can0" or "vcan0" and give its functions to can. Only extended data frames pass the kernel filter
+ * until Open_SAE_J1939_Update_Acceptance_Filters is called. With receive_thread = true, a thread reads the socket all the time,
+ * else CAN_Read_Message reads it when the receive ring is empty
+ */
+bool SocketCAN_Open(SocketCAN_Channel *channel, CAN_Interface *can, const char *interface_name, bool receive_thread) {
+	struct sockaddr_can address;
+	struct ifreq interface_request;
+	struct can_filter filter;
+	int enable = 1;
+
+	memset(channel, 0, sizeof(SocketCAN_Channel));
+	channel->can = can;
+	channel->wake_event = -1;
+	channel->socket = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+	if (channel->socket < 0) {
+		return false;
+	}
+	memset(&interface_request, 0, sizeof(interface_request));
+	strncpy(interface_request.ifr_name, interface_name, IFNAMSIZ - 1);
+	if (ioctl(channel->socket, SIOCGIFINDEX, &interface_request) < 0) {
+		SocketCAN_Close(channel);
+		return false;
+	}
+
+	/* J1939 only uses 29-bit data frames */
+	filter.can_id = CAN_EFF_FLAG;
+	filter.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG;
+	setsockopt(channel->socket, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter));
+	setsockopt(channel->socket, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+
+	memset(&address, 0, sizeof(address));
+	address.can_family = AF_CAN;
+	address.can_ifindex = interface_request.ifr_ifindex;
+	if (bind(channel->socket, (struct sockaddr *)&address, sizeof(address)) < 0) {
+		SocketCAN_Close(channel);
+		return false;
+	}
+
+	/* The J1939 struct with this interface now sends and reads on the socket */
+	can->Transmit = SocketCAN_Transmit;
+	can->Transmit_Batch = SocketCAN_Transmit_Batch;
+	can->Poll = SocketCAN_Poll;
+	can->Set_Filters = SocketCAN_Set_Filters;
+	can->Delay_ms = SocketCAN_Delay;
+	can->context = channel;
+	can->max_filters = SOCKETCAN_MAX_FILTERS;
+
+	channel->has_receive_thread = receive_thread;
+	if (channel->has_receive_thread) {
+		channel->wake_event = eventfd(0, EFD_NONBLOCK);
+		channel->is_running = channel->wake_event >= 0;
+		if (!channel->is_running || pthread_create(&channel->receive_thread, NULL, SocketCAN_Receive_Thread, channel) != 0) {
+			channel->is_running = false;
+			SocketCAN_Close(channel);
+			return false;
+		}
+	}
+	return true;
+}
+
+void SocketCAN_Close(SocketCAN_Channel *channel) {
+	if (channel->socket < 0) {
+		return;
+	}
+	if (channel->has_receive_thread && channel->is_running) {
+		uint64_t wake = 1;
+		channel->is_running = false;
+		if (write(channel->wake_event, &wake, sizeof(wake)) != sizeof(wake)) {
+			/* The counter is already non zero, the thread is woken anyway */
+		}
+		pthread_join(channel->receive_thread, NULL);
+	}
+	if (channel->wake_event >= 0) {
+		close(channel->wake_event);
+		channel->wake_event = -1;
+	}
+	channel->has_receive_thread = false;
+	close(channel->socket);
+	channel->socket = -1;
+}
+
+ENUM_J1939_STATUS_CODES SocketCAN_Transmit(void *context, uint32_t ID, uint8_t DLC, uint8_t data[]) {
+	SocketCAN_Channel *channel = (SocketCAN_Channel*)context;
+	struct can_frame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.can_id = (ID & CAN_EFF_MASK) | CAN_EFF_FLAG;
+	frame.can_dlc = DLC > 8 ? 8 : DLC;
+	memcpy(frame.data, data, frame.can_dlc);
+	if (write(channel->socket, &frame, sizeof(frame)) == sizeof(frame)) {
+		return STATUS_SEND_OK;
+	}
+	return errno == ENOBUFS || errno == EAGAIN ? STATUS_SEND_BUSY : STATUS_SEND_ERROR;
+}
+
+/*
+ * Send 8 byte messages, message i is ID[i] and data[i * 8] to data[i * 8 + 7]. One sendmmsg call for every SOCKETCAN_BATCH messages.
+ * number_of_messages_sent tells how many went out before a full transmit queue (STATUS_SEND_BUSY) or an error stopped the batch
+ */
+ENUM_J1939_STATUS_CODES SocketCAN_Transmit_Batch(void *context, uint32_t ID[], uint8_t data[], uint8_t number_of_messages, uint8_t *number_of_messages_sent) {
+	SocketCAN_Channel *channel = (SocketCAN_Channel*)context;
+	struct can_frame frames[SOCKETCAN_BATCH];
+	struct iovec iov[SOCKETCAN_BATCH];
+	struct mmsghdr headers[SOCKETCAN_BATCH];
+	uint8_t sent = 0, batch, i;
+	int result;
+	*number_of_messages_sent = 0;
+	while (sent < number_of_messages) {
+		batch = number_of_messages - sent < (int)SOCKETCAN_BATCH ? (uint8_t)(number_of_messages - sent) : SOCKETCAN_BATCH;
+		for (i = 0; i < batch; i++) {
+			memset(&frames[i], 0, sizeof(struct can_frame));
+			frames[i].can_id = (ID[sent + i] & CAN_EFF_MASK) | CAN_EFF_FLAG;
+			frames[i].can_dlc = 8;
+			memcpy(frames[i].data, &data[(sent + i) * 8], 8);
+			iov[i].iov_base = &frames[i];
+			iov[i].iov_len = sizeof(struct can_frame);
+			memset(&headers[i], 0, sizeof(struct mmsghdr));
+			headers[i].msg_hdr.msg_iov = &iov[i];
+			headers[i].msg_hdr.msg_iovlen = 1;
+		}
+		result = sendmmsg(channel->socket, headers, batch, 0);
+		if (result <= 0) {
+			return errno == ENOBUFS || errno == EAGAIN ? STATUS_SEND_BUSY : STATUS_SEND_ERROR;
+		}
+		sent += (uint8_t)result;
+		*number_of_messages_sent = sent;
+	}
+	return STATUS_SEND_OK;
+}
+
+/* Called by CAN_Read_Message and CAN_Read_Messages when the receive ring is empty. Does nothing if the receive thread reads the socket */
+uint8_t SocketCAN_Poll(void *context) {
+	SocketCAN_Channel *channel = (SocketCAN_Channel*)context;
+	int number_of_frames;
+	if (channel->has_receive_thread || channel->socket < 0) {
+		return 0;
+	}
+	number_of_frames = SocketCAN_Receive(channel);
+	return number_of_frames > 0 ? (uint8_t)number_of_frames : 0;
+}
+
+/* Let the kernel drop every frame that matches none of the (received ID & mask[i]) == (ID[i] & mask[i]) pairs. IDs are 29-bit */
+bool SocketCAN_Set_Filters(void *context, uint32_t ID[], uint32_t mask[], uint8_t number_of_filters) {
+	SocketCAN_Channel *channel = (SocketCAN_Channel*)context;
+	struct can_filter filters[SOCKETCAN_MAX_FILTERS];
+	uint8_t i;
+	if (channel->socket < 0 || number_of_filters > SOCKETCAN_MAX_FILTERS) {
+		return false;
+	}
+	for (i = 0; i < number_of_filters; i++) {
+		filters[i].can_id = (ID[i] & CAN_EFF_MASK) | CAN_EFF_FLAG;
+		filters[i].can_mask = (mask[i] & CAN_EFF_MASK) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+	}
+	return setsockopt(channel->socket, SOL_CAN_RAW, CAN_RAW_FILTER, filters, number_of_filters * sizeof(struct can_filter)) == 0;
+}
+
+void SocketCAN_Delay(void *context, uint8_t milliseconds) {
+	struct timespec delay;
+	(void)context;
+	delay.tv_sec = 0;
+	delay.tv_nsec = (long)milliseconds * 1000000L;
+	nanosleep(&delay, NULL);
+}
+
+/* Kernel receive time of the newest frame read from the socket, since 1970 */
+void SocketCAN_Get_Last_Timestamp(SocketCAN_Channel *channel, uint32_t *seconds, uint32_t *microseconds) {
+	*seconds = channel->last_timestamp_seconds;
+	*microseconds = channel->last_timestamp_microseconds;
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * SocketCAN.h
+ *
+ *  Created on: 18 okt. 2026
+ */
+
+#ifndef HARDWARE_SOCKETCAN_H_
+#define HARDWARE_SOCKETCAN_H_
+
+/* Layer */
+#include "Hardware.h"
+
+#include <pthread.h>
+
+/* Most frames moved by one recvmmsg or sendmmsg call */
+#define SOCKETCAN_BATCH 32U
+
+/* Most ID/mask pairs that SocketCAN_Set_Filters can give to the kernel */
+#define SOCKETCAN_MAX_FILTERS 64U
+
+/* The receive thread waits 1, 2, 4... up to this many milliseconds after each failed read in a row, e.g when the interface is down */
+#define SOCKETCAN_MAX_BACKOFF_MS 100U
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One raw CAN socket. The received frames go into the receive ring of can */
+typedef struct {
+	int socket;
+	CAN_Interface *can;
+	bool has_receive_thread;
+	volatile bool is_running;
+	pthread_t receive_thread;
+	int wake_event;									/* eventfd, SocketCAN_Close writes it to wake the receive thread */
+	uint32_t receive_errors;						/* Failed reads of the receive thread, EINTR and EAGAIN not counted */
+	uint32_t last_timestamp_seconds;				/* Kernel receive time of the newest frame */
+	uint32_t last_timestamp_microseconds;
+} SocketCAN_Channel;
+
+bool SocketCAN_Open(SocketCAN_Channel *channel, CAN_Interface *can, const char *interface_name, bool receive_thread);
+void SocketCAN_Close(SocketCAN_Channel *channel);
+ENUM_J1939_STATUS_CODES SocketCAN_Transmit(void *context, uint32_t ID, uint8_t DLC, uint8_t data[]);
+ENUM_J1939_STATUS_CODES SocketCAN_Transmit_Batch(void *context, uint32_t ID[], uint8_t data[], uint8_t number_of_messages, uint8_t *number_of_messages_sent);
+uint8_t SocketCAN_Poll(void *context);
+bool SocketCAN_Set_Filters(void *context, uint32_t ID[], uint32_t mask[], uint8_t number_of_filters);
+void SocketCAN_Delay(void *context, uint8_t milliseconds);
+void SocketCAN_Get_Last_Timestamp(SocketCAN_Channel *channel, uint32_t *seconds, uint32_t *microseconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HARDWARE_SOCKETCAN_H_ */
@@ -22,7 +22,7 @@ ENUM_J1939_STATUS_CODES ISO_11783_Send_Auxiliary_Valve_Command(J1939 *j1939, uin
 	data[1] = 0xFF; 												/* Reserved */
 	data[2] = (fail_safe_mode << 6) | (0b11 << 4) | valve_state; 	/* Bit 5 and 6 are reserved */
 	data[3] = data[4] = data[5] = data[6] = data[7] = 0xFF;			/* All reserved */
-	return CAN_Send_Message(ID, data);
+	return CAN_Send_Message(j1939->can, ID, data);
 }
 
 /*
@@ -11,115 +11,593 @@
 #include "../ISO_11783/ISO_11783-7_Application_Layer/Application_Layer.h"
 #include "../Hardware/Hardware.h"
 
+/* How many frames Open_SAE_J1939_Process_Pending reads from the hardware in one call */
+#define PROCESS_PENDING_BATCH 16U
+
+/* Most ID/mask pairs that Open_SAE_J1939_Update_Acceptance_Filters makes, the hardware limit is CAN_Get_Max_Acceptance_Filters */
+#define ACCEPTANCE_FILTERS_BUFFER 64U
+
+/* How the PDU Specific (PS) and the source address of a frame are tested by a dispatch rule, next to the DA_low to DA_high range */
+#define MATCH_THIS_ECU 0x1U								/* DA equal to the address of this ECU matches too */
+#define MATCH_SA_CLAIMED 0x2U							/* Only from an ECU that has an address, e.g SA != 0xFE */
+#define MATCH_SA_NULL 0x4U								/* Only from the null address 0xFE */
+
+/* One supported message. PF (id1), and PS for PDU2 formats, select a group of rules, the first rule that matches calls its reader */
+typedef struct {
+	uint8_t id0;									/* Priority, EDP and DP bits the frame must have after masking with id0_mask */
+	uint8_t id0_mask;
+	uint8_t DA_low;									/* DA_low > DA_high is an empty range */
+	uint8_t DA_high;
+	uint8_t match;									/* MATCH_ flags */
+	void (*Read)(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]);
+	ENUM_J1939_RX_MSG rx_msg;						/* RX_MSG_UNKNOWN ends the group */
+} Dispatch_Rule;
+
+/* The readers have different arguments, these give them the same signature for the table */
+static void Read_Request(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Request(j1939, SA, data);
+}
+
+static void Read_Request_DM14(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Request_DM14(j1939, SA, data);
+}
+
+static void Read_Acknowledgement(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Acknowledgement(j1939, SA, data);
+}
+
+static void Read_Response_DM15(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Response_DM15(j1939, SA, data);
+}
+
+static void Read_Binary_Data_Transfer_DM16(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Binary_Data_Transfer_DM16(j1939, SA, data, 8);
+}
+
+static void Read_Transport_Protocol_Connection_Management(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)PGN;
+	SAE_J1939_Read_Transport_Protocol_Connection_Management(j1939, SA, DA, data);
+}
+
+static void Read_Transport_Protocol_Data_Transfer(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)PGN;
+	SAE_J1939_Read_Transport_Protocol_Data_Transfer(j1939, SA, DA, data);
+}
+
+static void Read_Extended_Transport_Protocol_Connection_Management(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Extended_Transport_Protocol_Connection_Management(j1939, SA, data);
+}
+
+static void Read_Extended_Transport_Protocol_Data_Transfer(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Extended_Transport_Protocol_Data_Transfer(j1939, SA, data);
+}
+
+static void Read_Response_Request_Proprietary_A(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Response_Request_Proprietary_A(j1939, SA, data, 8);										/* Manufacturer specific data */
+}
+
+static void Read_Response_Request_Proprietary_B(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	SAE_J1939_Read_Response_Request_Proprietary_B(j1939, SA, PGN, data, 8);								/* Manufacturer specific data (B) */
+}
+
+static void Read_Response_Request_Address_Claimed(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Response_Request_Address_Claimed(j1939, SA, data);									/* This is a broadcast response request */
+}
+
+static void Read_Address_Not_Claimed(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Address_Not_Claimed(j1939, SA, data);												/* This is error */
+}
+
+static void Read_Response_Request_DM1(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Response_Request_DM1(j1939, SA, data, 1); 											/* Assume that errors_dm1_active = 1 */
+}
+
+static void Read_Response_Request_DM2(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Response_Request_DM2(j1939, SA, data, 1); 											/* Assume that errors_dm2_active = 1 */
+}
+
+static void Read_Response_Request_Software_Identification(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Response_Request_Software_Identification(j1939, SA, data, 8);
+}
+
+static void Read_Response_Request_ECU_Identification(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Response_Request_ECU_Identification(j1939, SA, data, 8);
+}
+
+static void Read_Response_Request_Component_Identification(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Response_Request_Component_Identification(j1939, SA, data, 8);
+}
+
+static void Read_Response_Request_Auxiliary_Estimated_Flow(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)PGN;
+	ISO_11783_Read_Response_Request_Auxiliary_Estimated_Flow(j1939, SA, DA & 0xF, data);				/* DA & 0xF = Valve number. Total 16 valves from 0 to 15 */
+}
+
+static void Read_Response_Request_General_Purpose_Valve_Estimated_Flow(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	ISO_11783_Read_Response_Request_General_Purpose_Valve_Estimated_Flow(j1939, SA, data);
+}
+
+static void Read_Response_Request_Auxiliary_Valve_Measured_Position(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)PGN;
+	ISO_11783_Read_Response_Request_Auxiliary_Valve_Measured_Position(j1939, SA, DA & 0xF, data); 		/* DA & 0xF = Valve number. Total 16 valves from 0 to 15 */
+}
+
+static void Read_Auxiliary_Valve_Command(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)PGN;
+	ISO_11783_Read_Auxiliary_Valve_Command(j1939, SA, DA & 0xF, data); 									/* DA & 0xF = Valve number. Total 16 valves from 0 to 15 */
+}
+
+static void Read_General_Purpose_Valve_Command(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)DA;
+	(void)PGN;
+	ISO_11783_Read_General_Purpose_Valve_Command(j1939, SA, data);										/* General Purpose Valve Command have only one valve */
+}
+
+static void Read_Address_Delete(J1939* j1939, uint8_t SA, uint8_t DA, uint32_t PGN, uint8_t data[]) {
+	(void)SA;
+	(void)DA;
+	(void)PGN;
+	SAE_J1939_Read_Address_Delete(j1939, data);															/* Not a SAE J1939 standard */
+}
+
+/* Rule groups. Inside a group the rules are tested in the same order as the old else if chain did */
+#define END_OF_GROUP { 0x00, 0x00, 0x01, 0x00, 0, NULL, RX_MSG_UNKNOWN }		/* The message was not meant for this ECU */
+
+static const Dispatch_Rule Group_Unknown[] = {
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Address_Delete[] = {										/* PF 0x02 */
+	{ 0x00, 0xFF, 0xFF, 0xFF, MATCH_THIS_ECU, Read_Address_Delete, RX_MSG_NOT_SAE_J1939 },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_General_Purpose_Valve_Command[] = {						/* PF 0xC4 */
+	{ 0x0C, 0xFF, 0x01, 0x00, MATCH_THIS_ECU, Read_General_Purpose_Valve_Command, RX_MSG_GP_VALVE_CMD },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_General_Purpose_Valve_Estimated_Flow[] = {				/* PF 0xC6 */
+	{ 0x0C, 0xFF, 0x01, 0x00, MATCH_THIS_ECU, Read_Response_Request_General_Purpose_Valve_Estimated_Flow, RX_MSG_RESP_REQ_GP_VALVE_ESTIMATED_FLOW },
+	END_OF_GROUP
+};
+
+/* ETP is only sent to one ECU, never broadcast */
+static const Dispatch_Rule Group_Extended_Transport_Protocol_Data_Transfer[] = {			/* PF 0xC7 */
+	{ 0x1C, 0xFF, 0x01, 0x00, MATCH_THIS_ECU, Read_Extended_Transport_Protocol_Data_Transfer, RX_MSG_ETP_CONN_DATA_TRANSFER },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Extended_Transport_Protocol_Connection_Management[] = {	/* PF 0xC8 */
+	{ 0x1C, 0xFF, 0x01, 0x00, MATCH_THIS_ECU, Read_Extended_Transport_Protocol_Connection_Management, RX_MSG_ETP_CONN_MANAGEMENT },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_DM16[] = {												/* PF 0xD7 */
+	{ 0x18, 0xFF, 0x01, 0x00, MATCH_THIS_ECU, Read_Binary_Data_Transfer_DM16, RX_MSG_DM16 },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_DM15[] = {												/* PF 0xD8 */
+	{ 0x18, 0xFF, 0x01, 0x00, MATCH_THIS_ECU, Read_Response_DM15, RX_MSG_DM15 },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_DM14[] = {												/* PF 0xD9 */
+	{ 0x18, 0xFF, 0x01, 0x00, MATCH_THIS_ECU, Read_Request_DM14, RX_MSG_REQ_DM14 },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Acknowledgement[] = {										/* PF 0xE8 */
+	{ 0x18, 0xFF, 0x01, 0x00, MATCH_THIS_ECU, Read_Acknowledgement, RX_MSG_ACK },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Request[] = {												/* PF 0xEA */
+	{ 0x18, 0xFF, 0xFF, 0xFF, MATCH_THIS_ECU, Read_Request, RX_MSG_REQ },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Transport_Protocol_Data_Transfer[] = {					/* PF 0xEB */
+	{ 0x1C, 0xFF, 0xFF, 0xFF, MATCH_THIS_ECU, Read_Transport_Protocol_Data_Transfer, RX_MSG_TP_CONN_DATA_TRANSFER },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Transport_Protocol_Connection_Management[] = {			/* PF 0xEC */
+	{ 0x1C, 0xFF, 0xFF, 0xFF, MATCH_THIS_ECU, Read_Transport_Protocol_Connection_Management, RX_MSG_TP_CONN_MANAGEMENT },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Address_Claimed[] = {										/* PF 0xEE */
+	{ 0x18, 0xFF, 0xFF, 0xFF, MATCH_SA_CLAIMED, Read_Response_Request_Address_Claimed, RX_MSG_RESP_REQ_ADDR_CLAIMED },
+	{ 0x18, 0xFF, 0xFF, 0xFF, MATCH_SA_NULL, Read_Address_Not_Claimed, RX_MSG_ADDR_NOT_CLAIMED },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Proprietary_A[] = {										/* PF 0xEF */
+	{ 0x14, 0xFF, 0x23, 0x23, 0, Read_Response_Request_Proprietary_A, RX_MSG_RESP_REQ_PROPRIETARY_A },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_ECU_Identification[] = {									/* PF 0xFD, PS 0xCx */
+	{ 0x18, 0xFF, 0xC5, 0xC5, 0, Read_Response_Request_ECU_Identification, RX_MSG_RESP_REQ_ECU_IDENTIFICATION },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Auxiliary_Estimated_Flow[] = {							/* PF 0xFE, PS 0x1x */
+	{ 0x0C, 0xFF, 0x10, 0x1F, 0, Read_Response_Request_Auxiliary_Estimated_Flow, RX_MSG_RESP_REQ_AUX_ESTIMATED_FLOW },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Auxiliary_Valve_Command[] = {								/* PF 0xFE, PS 0x3x */
+	{ 0x0C, 0xFF, 0x30, 0x3F, 0, Read_Auxiliary_Valve_Command, RX_MSG_AUX_VALVE_CMD },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_DM1_DM2[] = {												/* PF 0xFE, PS 0xCx */
+	{ 0x18, 0xFF, 0xCA, 0xCA, 0, Read_Response_Request_DM1, RX_MSG_RESP_REQ_DM1 },
+	{ 0x18, 0xFF, 0xCB, 0xCB, 0, Read_Response_Request_DM2, RX_MSG_RESP_REQ_DM2 },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Software_Identification[] = {								/* PF 0xFE, PS 0xDx */
+	{ 0x18, 0xFF, 0xDA, 0xDA, 0, Read_Response_Request_Software_Identification, RX_MSG_RESP_REQ_SOFTWARE_IDENTIFICATION },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule Group_Component_Identification[] = {							/* PF 0xFE, PS 0xEx */
+	{ 0x18, 0xFF, 0xEB, 0xEB, 0, Read_Response_Request_Component_Identification, RX_MSG_RESP_REQ_COMPONENT_IDENTIFICATION },
+	END_OF_GROUP
+};
+
+/* PGN_PROPRIETARY_B_START to PGN_PROPRIETARY_B2_END is PF 0xFF with EDP = 0, any priority, DP and PS */
+static const Dispatch_Rule Group_Proprietary_B[] = {										/* PF 0xFF */
+	{ 0x00, 0x02, 0x00, 0xFF, 0, Read_Response_Request_Proprietary_B, RX_MSG_RESP_REQ_PROPRIETARY_B },
+	END_OF_GROUP
+};
+
+/*
+ * Auxiliary Valve Measured Position is tested after Proprietary B, as in the old chain. Its ID byte 0x0C has EDP = 0, so Proprietary B
+ * always takes the frame first and this rule never matches - The same as before the table
+ */
+static const Dispatch_Rule Group_Proprietary_B_Auxiliary_Valve_Measured_Position[] = {		/* PF 0xFF, PS 0x2x */
+	{ 0x00, 0x02, 0x00, 0xFF, 0, Read_Response_Request_Proprietary_B, RX_MSG_RESP_REQ_PROPRIETARY_B },
+	{ 0x0C, 0xFF, 0x20, 0x2F, 0, Read_Response_Request_Auxiliary_Valve_Measured_Position, RX_MSG_RESP_REQ_AUX_VALVE_MEASURED_POSITION },
+	END_OF_GROUP
+};
+
+static const Dispatch_Rule* const Groups[] = {
+	Group_Unknown,											/* 0 */
+	Group_Address_Delete,									/* 1 */
+	Group_General_Purpose_Valve_Command,					/* 2 */
+	Group_General_Purpose_Valve_Estimated_Flow,				/* 3 */
+	Group_DM16,												/* 4 */
+	Group_DM15,												/* 5 */
+	Group_DM14,												/* 6 */
+	Group_Acknowledgement,									/* 7 */
+	Group_Request,											/* 8 */
+	Group_Transport_Protocol_Data_Transfer,					/* 9 */
+	Group_Transport_Protocol_Connection_Management,			/* 10 */
+	Group_Address_Claimed,									/* 11 */
+	Group_Proprietary_A,									/* 12 */
+	Group_ECU_Identification,								/* 13 */
+	Group_Auxiliary_Estimated_Flow,							/* 14 */
+	Group_Auxiliary_Valve_Command,							/* 15 */
+	Group_DM1_DM2,											/* 16 */
+	Group_Software_Identification,							/* 17 */
+	Group_Component_Identification,							/* 18 */
+	Group_Proprietary_B,									/* 19 */
+	Group_Proprietary_B_Auxiliary_Valve_Measured_Position,	/* 20 */
+	Group_Extended_Transport_Protocol_Data_Transfer,		/* 21 */
+	Group_Extended_Transport_Protocol_Connection_Management	/* 22 */
+};
+
+/* Group index of every PDU1 format PF (id1) 0x00 to 0xEF. PS is the destination address here, so it is tested by the rules */
+static const uint8_t PDU1_Group[240] = {
+/*	 x0  x1  x2  x3  x4  x5  x6  x7  x8  x9  xA  xB  xC  xD  xE  xF */
+	  0,  0,  1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 0x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 1x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 2x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 3x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 4x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 5x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 6x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 7x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 8x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* 9x */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* Ax */
+	  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,		/* Bx */
+	  0,  0,  0,  0,  2,  0,  3, 21, 22,  0,  0,  0,  0,  0,  0,  0,		/* Cx */
+	  0,  0,  0,  0,  0,  0,  0,  4,  5,  6,  0,  0,  0,  0,  0,  0,		/* Dx */
+	  0,  0,  0,  0,  0,  0,  0,  0,  7,  0,  8,  9, 10,  0, 11, 12		/* Ex */
+};
+
+/* Group index of every PDU2 format PF (id1) 0xF0 to 0xFF, by the high nibble of PS. PS is the group extension, part of the PGN */
+static const uint8_t PDU2_Group[16][16] = {
+/*	  PS 0x  1x  2x  3x  4x  5x  6x  7x  8x  9x  Ax  Bx  Cx  Dx  Ex  Fx */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F0 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F1 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F2 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F3 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F4 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F5 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F6 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F7 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F8 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF F9 */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF FA */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF FB */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },	/* PF FC */
+	{ 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 13,  0,  0,  0 },	/* PF FD */
+	{ 0, 14,  0, 15,  0,  0,  0,  0,  0,  0,  0,  0, 16, 17, 18,  0 },	/* PF FE */
+	{ 19, 19, 20, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19 }	/* PF FF */
+};
+
+/* Decode one frame and call the reader of the message. The PF (id1) table lookup replaces the else if chain over id0, id1 and DA */
+static ENUM_J1939_RX_MSG Dispatch_Message(J1939* j1939, uint32_t ID, uint8_t data[]) {
+	uint8_t id0 = ID >> 24;
+	uint8_t id1 = ID >> 16; /* PDU Format (PF) */
+	uint8_t DA = ID >> 8; 	/* PDU Specific (PS) or destination address which is this ECU. if DA = 0xFF = broadcast to all ECU. Sometimes DA can be an ID number too */
+	uint8_t SA = ID; 	/* Source address of the ECU that we got the message from */
+	uint8_t this_ECU_address = j1939->information_this_ECU.this_ECU_address;
+	const Dispatch_Rule* rule;
+	uint32_t PGN;
+
+	/* Properly calculate PGN based on PF (id1) */
+	if (id1 >= 240){
+		PGN = (ID >> 8) & 0x3FFFFUL; /* Mask for including EDP, DP, PF, and PS in the PGN */
+		rule = Groups[PDU2_Group[id1 - 240][DA >> 4]];
+	}else{
+		PGN = (ID >> 8) & 0x3FF00UL; /* Mask for including EDP, DP, and PF only (exclude PS) */
+		rule = Groups[PDU1_Group[id1]];
+	}
+
+	/* At most two rules share a group */
+	for (; rule->rx_msg != RX_MSG_UNKNOWN; rule++) {
+		if ((id0 & rule->id0_mask) == rule->id0
+			&& ((DA >= rule->DA_low && DA <= rule->DA_high) || ((rule->match & MATCH_THIS_ECU) && DA == this_ECU_address))
+			&& (!(rule->match & MATCH_SA_CLAIMED) || SA != 0xFE)
+			&& (!(rule->match & MATCH_SA_NULL) || SA == 0xFE)) {
+			rule->Read(j1939, SA, DA, PGN, data);
+			return rule->rx_msg;
+		}
+	}
+	return RX_MSG_UNKNOWN;																				/* The message was not meant for this ECU */
+}
+
+/* Number of bits that are 1 */
+static uint8_t Count_Bits(uint32_t value) {
+	uint8_t bits = 0;
+	while (value != 0) {
+		value &= value - 1;
+		bits++;
+	}
+	return bits;
+}
+
+/*
+ * Insert the pair new_ID/new_mask. Pairs that the new pair accepts are removed and pairs with the same mask that differ in one ID bit are merged.
+ * When all max_filters pairs are in use, the new pair is merged with the pair that keeps the most mask bits. Then a few more frames pass, none are lost
+ */
+static uint8_t Add_Acceptance_Filter(uint32_t ID[], uint32_t mask[], uint8_t number_of_filters, uint8_t max_filters, uint32_t new_ID, uint32_t new_mask) {
+	uint8_t i, merge_with, bits, best_bits;
+	uint32_t merged_mask;
+	if (max_filters == 0) {
+		return 0;
+	}
+	new_ID &= new_mask;
+	for (;;) {
+		/* Does a pair already accept all frames of the new pair */
+		for (i = 0; i < number_of_filters; i++) {
+			if ((mask[i] & ~new_mask) == 0 && (new_ID & mask[i]) == ID[i]) {
+				return number_of_filters;
+			}
+		}
+
+		/* Remove the pairs inside the new pair and look for a pair that merges without accepting more frames */
+		merge_with = number_of_filters;
+		i = 0;
+		while (i < number_of_filters) {
+			if ((new_mask & ~mask[i]) == 0 && (ID[i] & new_mask) == new_ID) {
+				number_of_filters--;
+				ID[i] = ID[number_of_filters];
+				mask[i] = mask[number_of_filters];
+				continue;
+			}
+			if (mask[i] == new_mask && Count_Bits(ID[i] ^ new_ID) == 1) {
+				merge_with = i;
+				break;
+			}
+			i++;
+		}
+		if (merge_with == number_of_filters) {
+			if (number_of_filters < max_filters) {
+				ID[number_of_filters] = new_ID;
+				mask[number_of_filters] = new_mask;
+				return number_of_filters + 1;
+			}
+
+			/* Out of pairs */
+			best_bits = 0;
+			merge_with = 0;
+			for (i = 0; i < number_of_filters; i++) {
+				bits = Count_Bits(mask[i] & new_mask & ~(ID[i] ^ new_ID));
+				if (bits > best_bits) {
+					best_bits = bits;
+					merge_with = i;
+				}
+			}
+		}
+
+		/* Insert the merged pair instead */
+		merged_mask = mask[merge_with] & new_mask & ~(ID[merge_with] ^ new_ID);
+		new_mask = merged_mask;
+		new_ID &= merged_mask;
+		number_of_filters--;
+		ID[merge_with] = ID[number_of_filters];
+		mask[merge_with] = mask[number_of_filters];
+	}
+}
+
+/* Insert the pairs that accept every frame of rule with PF (id1) and PS from PS_low to PS_high. SA is not filtered */
+static uint8_t Add_Rule_Filters(const Dispatch_Rule* rule, uint8_t id1, uint16_t PS_low, uint16_t PS_high, uint8_t this_ECU_address, uint32_t ID[], uint32_t mask[], uint8_t number_of_filters, uint8_t max_filters) {
+	uint32_t rule_ID = ((uint32_t)(rule->id0 & rule->id0_mask & 0x1F) << 24) | ((uint32_t)id1 << 16);
+	uint32_t rule_mask = ((uint32_t)(rule->id0_mask & 0x1F) << 24) | 0xFF0000UL;
+	uint16_t DA_low = rule->DA_low > PS_low ? rule->DA_low : PS_low;
+	uint16_t DA_high = rule->DA_high < PS_high ? rule->DA_high : PS_high;
+	uint16_t size;
+
+	/* Split the DA range into aligned blocks, one pair each */
+	while (DA_low <= DA_high) {
+		size = 1;
+		while (size < 256 && (DA_low & (2 * size - 1)) == 0 && DA_low + 2 * size - 1 <= DA_high) {
+			size *= 2;
+		}
+		number_of_filters = Add_Acceptance_Filter(ID, mask, number_of_filters, max_filters, rule_ID | ((uint32_t)DA_low << 8), rule_mask | ((uint32_t)(~(size - 1) & 0xFF) << 8));
+		DA_low += size;
+	}
+	if ((rule->match & MATCH_THIS_ECU) && this_ECU_address >= PS_low && this_ECU_address <= PS_high) {
+		number_of_filters = Add_Acceptance_Filter(ID, mask, number_of_filters, max_filters, rule_ID | ((uint32_t)this_ECU_address << 8), rule_mask | 0xFF00UL);
+	}
+	return number_of_filters;
+}
+
+/* The pairs are made from the same rule tables as Dispatch_Message uses, so a frame that a reader would get always passes */
+uint8_t Open_SAE_J1939_Get_Acceptance_Filters(J1939* j1939, uint32_t ID[], uint32_t mask[], uint8_t max_filters) {
+	uint8_t this_ECU_address = j1939->information_this_ECU.this_ECU_address;
+	uint8_t number_of_filters = 0;
+	uint16_t PF, PS;
+	const Dispatch_Rule* rule;
+	for (PF = 0; PF < 240; PF++) {
+		for (rule = Groups[PDU1_Group[PF]]; rule->rx_msg != RX_MSG_UNKNOWN; rule++) {
+			number_of_filters = Add_Rule_Filters(rule, (uint8_t)PF, 0x00, 0xFF, this_ECU_address, ID, mask, number_of_filters, max_filters);
+		}
+	}
+	for (PF = 240; PF < 256; PF++) {
+		for (PS = 0x00; PS < 0x100; PS += 0x10) {
+			for (rule = Groups[PDU2_Group[PF - 240][PS >> 4]]; rule->rx_msg != RX_MSG_UNKNOWN; rule++) {
+				number_of_filters = Add_Rule_Filters(rule, (uint8_t)PF, PS, PS | 0x0F, this_ECU_address, ID, mask, number_of_filters, max_filters);
+			}
+		}
+	}
+	return number_of_filters;
+}
+
+bool Open_SAE_J1939_Update_Acceptance_Filters(J1939* j1939) {
+	uint32_t ID[ACCEPTANCE_FILTERS_BUFFER];
+	uint32_t mask[ACCEPTANCE_FILTERS_BUFFER];
+	uint8_t max_filters = CAN_Get_Max_Acceptance_Filters(j1939->can);
+	uint8_t number_of_filters;
+	if (max_filters > ACCEPTANCE_FILTERS_BUFFER) {
+		max_filters = ACCEPTANCE_FILTERS_BUFFER;
+	}
+	number_of_filters = Open_SAE_J1939_Get_Acceptance_Filters(j1939, ID, mask, max_filters);
+	j1939->acceptance_filters_address = j1939->information_this_ECU.this_ECU_address;
+	j1939->acceptance_filters_installed = number_of_filters > 0 && CAN_Set_Acceptance_Filters(j1939->can, ID, mask, number_of_filters);
+	if (!j1939->acceptance_filters_installed && number_of_filters > 0) {
+		/* Better to read every frame than to miss the frames for a new address */
+		ID[0] = 0;
+		mask[0] = 0;
+		CAN_Set_Acceptance_Filters(j1939->can, ID, mask, 1);
+	}
+	return j1939->acceptance_filters_installed;
+}
+
+/* The filters accept the DA of the old address until they are made again */
+static void Follow_ECU_Address(J1939* j1939) {
+	if (j1939->acceptance_filters_installed && j1939->acceptance_filters_address != j1939->information_this_ECU.this_ECU_address) {
+		Open_SAE_J1939_Update_Acceptance_Filters(j1939);
+	}
+}
+
 /* This function should be called all the time, or be placed inside an interrupt listener */
 ENUM_J1939_RX_MSG Open_SAE_J1939_Listen_For_Messages(J1939* j1939) {
 	uint32_t ID = 0;
 	uint8_t data[8] = {0};
 	ENUM_J1939_RX_MSG rx_msg = RX_MSG_NONE;
-	bool is_new_message = CAN_Read_Message(&ID, data);
+	bool is_new_message = CAN_Read_Message(j1939->can, &ID, data);
 	if(is_new_message) {
-		/* Save latest */
-		j1939->ID = ID;
-		memcpy(j1939->data, data, 8);
-		j1939->ID_and_data_is_updated = true;
-
-		uint8_t id0 = ID >> 24;
-		uint8_t id1 = ID >> 16; /* PDU Format (PF) */
-		uint8_t DA = ID >> 8; 	/* PDU Specific (PS) or destination address which is this ECU. if DA = 0xFF = broadcast to all ECU. Sometimes DA can be an ID number too */
-		uint8_t SA = ID; 	/* Source address of the ECU that we got the message from */
-
-		uint32_t PGN;
-
-		/* Properly calculate PGN based on PF (id1) */
-		if (id1 >= 240){
-    			PGN = (ID >> 8) & 0x3FFFFUL; /* Mask for including EDP, DP, PF, and PS in the PGN */
-		}else{
-    			PGN = (ID >> 8) & 0x3FF00UL; /* Mask for including EDP, DP, and PF only (exclude PS) */
+		rx_msg = Open_SAE_J1939_Process_Message(j1939, ID, data);
+	}
+	return rx_msg;
+}
+
+/* Handle one frame that has already been read from the CAN-bus, e.g by a gateway that routes some frames to other buses */
+ENUM_J1939_RX_MSG Open_SAE_J1939_Process_Message(J1939* j1939, uint32_t ID, uint8_t data[]) {
+	ENUM_J1939_RX_MSG rx_msg;
+
+	/* Save latest */
+	j1939->ID = ID;
+	memcpy(j1939->data, data, 8);
+	j1939->ID_and_data_is_updated = true;
+
+	/* Add more messages to the rule groups and the PDU1_Group or PDU2_Group tables above */
+	rx_msg = Dispatch_Message(j1939, ID, data);
+	Follow_ECU_Address(j1939);
+	return rx_msg;
+}
+
+/*
+ * Read every frame that is waiting in the hardware, in batches of PROCESS_PENDING_BATCH, and dispatch them in one pass.
+ * Stops after max_frames frames so a busy bus cannot keep the caller here. A TP.DT burst during a firmware transfer
+ * is then handled in one call instead of one Open_SAE_J1939_Listen_For_Messages call per frame
+ */
+J1939_RX_Counts Open_SAE_J1939_Process_Pending(J1939* j1939, uint16_t max_frames) {
+	J1939_RX_Counts counts;
+	uint32_t ID[PROCESS_PENDING_BATCH];
+	uint8_t data[PROCESS_PENDING_BATCH * 8];
+	uint8_t number_of_requested_frames;
+	uint8_t number_of_frames;
+	uint8_t i;
+	ENUM_J1939_RX_MSG rx_msg;
+
+	memset(&counts, 0, sizeof(counts));
+	while (counts.total < max_frames) {
+		number_of_requested_frames = max_frames - counts.total < (int)PROCESS_PENDING_BATCH ? (uint8_t)(max_frames - counts.total) : PROCESS_PENDING_BATCH;
+		number_of_frames = CAN_Read_Messages(j1939->can, ID, data, number_of_requested_frames);
+		for (i = 0; i < number_of_frames; i++) {
+			rx_msg = Open_SAE_J1939_Process_Message(j1939, ID[i], &data[i * 8]);
+			counts.rx_msg[rx_msg]++;
 		}
+		counts.total += number_of_frames;
 
-		rx_msg = RX_MSG_NOT_SUPPORTED;
-
-		/* Read request from other ECU */
-		if (id0 == 0x18 && id1 == 0xEA && (DA == j1939->information_this_ECU.this_ECU_address || DA == 0xFF)){
-			SAE_J1939_Read_Request(j1939, SA, data);
-			rx_msg = RX_MSG_REQ;
-		}else if (id0 == 0x18 && id1 == 0xD9 && DA == j1939->information_this_ECU.this_ECU_address){
-			SAE_J1939_Read_Request_DM14(j1939, SA, data);
-			rx_msg = RX_MSG_REQ_DM14;
-
-		/* Read status from other ECU */
-		}else if(id0 == 0x18 && id1 == 0xE8 && DA == j1939->information_this_ECU.this_ECU_address){
-			SAE_J1939_Read_Acknowledgement(j1939, SA, data);
-			rx_msg = RX_MSG_ACK;
-		}else if (id0 == 0x18 && id1 == 0xD8 && DA == j1939->information_this_ECU.this_ECU_address){
-			SAE_J1939_Read_Response_DM15(j1939, SA, data);
-			rx_msg = RX_MSG_DM15;
-		}else if(id0 == 0x18 && id1 == 0xD7 && DA == j1939->information_this_ECU.this_ECU_address){
-			SAE_J1939_Read_Binary_Data_Transfer_DM16(j1939, SA, data);
-			rx_msg = RX_MSG_DM16;
-
-		/* Read Transport Protocol information from other ECU */
-		}else if(id0 == 0x1C && id1 == 0xEC && (DA == j1939->information_this_ECU.this_ECU_address || DA == 0xFF)){
-			SAE_J1939_Read_Transport_Protocol_Connection_Management(j1939, SA, data);
-			rx_msg = RX_MSG_TP_CONN_MANAGEMENT;
-		}else if (id0 == 0x1C && id1 == 0xEB && (DA == j1939->information_this_ECU.this_ECU_address || DA == 0xFF)){
-			SAE_J1939_Read_Transport_Protocol_Data_Transfer(j1939, SA, data);
-			rx_msg = RX_MSG_TP_CONN_DATA_TRANSFER;
-
-		/* Read response request from other ECU - This are response request. They are responses from other ECU about request from this ECU */
-		}else if (id0 == 0x14 && id1 == 0xEF && DA == 0x23) {
-			SAE_J1939_Read_Response_Request_Proprietary_A(j1939, SA, data);										/* Manufacturer specific data */
-			rx_msg = RX_MSG_RESP_REQ_PROPRIETARY_A;
-		}else if (((PGN >= PGN_PROPRIETARY_B_START) && (PGN <= PGN_PROPRIETARY_B_END)) || 
-				  ((PGN >= PGN_PROPRIETARY_B2_START) && (PGN <= PGN_PROPRIETARY_B2_END))) {
-			SAE_J1939_Read_Response_Request_Proprietary_B(j1939, SA, PGN, data);								/* Manufacturer specific data (B) */
-			rx_msg = RX_MSG_RESP_REQ_PROPRIETARY_B;
-		}else if (id0 == 0x18 && id1 == 0xEE && DA == 0xFF && SA != 0xFE){
-			SAE_J1939_Read_Response_Request_Address_Claimed(j1939, SA, data);									/* This is a broadcast response request */
-			rx_msg = RX_MSG_RESP_REQ_ADDR_CLAIMED;
-		}else if (id0 == 0x18 && id1 == 0xEE && DA == 0xFF && SA == 0xFE) {
-			SAE_J1939_Read_Address_Not_Claimed(j1939, SA, data);												/* This is error */
-			rx_msg = RX_MSG_ADDR_NOT_CLAIMED;
-
-		}else if (id0 == 0x18 && id1 == 0xFE && DA == 0xCA){
-			SAE_J1939_Read_Response_Request_DM1(j1939, SA, data, 1); 											/* Assume that errors_dm1_active = 1 */
-			rx_msg = RX_MSG_RESP_REQ_DM1;
-		}else if (id0 == 0x18 && id1 == 0xFE && DA == 0xCB){
-			SAE_J1939_Read_Response_Request_DM2(j1939, SA, data, 1); 											/* Assume that errors_dm2_active = 1 */
-			rx_msg = RX_MSG_RESP_REQ_DM2;
-		}else if (id0 == 0x18 && id1 == 0xFE && DA == 0xDA){
-			SAE_J1939_Read_Response_Request_Software_Identification(j1939, SA, data);
-			rx_msg = RX_MSG_RESP_REQ_SOFTWARE_IDENTIFICATION;
-		}else if (id0 == 0x18 && id1 == 0xFD && DA == 0xC5){
-			SAE_J1939_Read_Response_Request_ECU_Identification(j1939, SA, data);
-			rx_msg = RX_MSG_RESP_REQ_ECU_IDENTIFICATION;
-		}else if (id0 == 0x18 && id1 == 0xFE && DA == 0xEB){
-			SAE_J1939_Read_Response_Request_Component_Identification(j1939, SA, data);
-			rx_msg = RX_MSG_RESP_REQ_COMPONENT_IDENTIFICATION;
-		}else if (id0 == 0x0C && id1 == 0xFE && DA >= 0x10 && DA <= 0x1F){
-			ISO_11783_Read_Response_Request_Auxiliary_Estimated_Flow(j1939, SA, DA & 0xF, data);				/* DA & 0xF = Valve number. Total 16 valves from 0 to 15 */
-			rx_msg = RX_MSG_RESP_REQ_AUX_ESTIMATED_FLOW;
-		}else if (id0 == 0x0C && id1 == 0xC6 && DA == j1939->information_this_ECU.this_ECU_address){
-			ISO_11783_Read_Response_Request_General_Purpose_Valve_Estimated_Flow(j1939, SA, data);
-			rx_msg = RX_MSG_RESP_REQ_GP_VALVE_ESTIMATED_FLOW;
-		}else if (id0 == 0x0C && id1 == 0xFF && DA >= 0x20 && DA <= 0x2F) {
-			ISO_11783_Read_Response_Request_Auxiliary_Valve_Measured_Position(j1939, SA, DA & 0xF, data); 		/* DA & 0xF = Valve number. Total 16 valves from 0 to 15 */
-			rx_msg = RX_MSG_RESP_REQ_AUX_VALVE_MEASURED_POSITION;
-
-		/* Read command from other ECU */
-		}else if (id0 == 0x0C && id1 == 0xFE && DA >= 0x30 && DA <= 0x3F){
-			ISO_11783_Read_Auxiliary_Valve_Command(j1939, SA, DA & 0xF, data); 									/* DA & 0xF = Valve number. Total 16 valves from 0 to 15 */
-			rx_msg = RX_MSG_AUX_VALVE_CMD;
-		}else if (id0 == 0x0C && id1 == 0xC4 && DA == j1939->information_this_ECU.this_ECU_address){
-			ISO_11783_Read_General_Purpose_Valve_Command(j1939, SA, data);										/* General Purpose Valve Command have only one valve */
-			rx_msg = RX_MSG_GP_VALVE_CMD;
-		}else if (id0 == 0x0 && id1 == 0x2 && (DA == j1939->information_this_ECU.this_ECU_address || DA == 0xFF)){
-			SAE_J1939_Read_Address_Delete(j1939, data);															/* Not a SAE J1939 standard */
-			rx_msg = RX_MSG_NOT_SAE_J1939;
-		}else{
-			rx_msg = RX_MSG_UNKNOWN;																			/* The message was not meant for this ECU */
+		/* The hardware has no more frames */
+		if (number_of_frames < number_of_requested_frames) {
+			break;
 		}
-		/* Add more else if statement here */
 	}
-	return rx_msg;
+	return counts;
 }
@@ -32,6 +32,8 @@ typedef enum {
     RX_MSG_DM16,
     RX_MSG_TP_CONN_MANAGEMENT,
     RX_MSG_TP_CONN_DATA_TRANSFER,
+    RX_MSG_ETP_CONN_MANAGEMENT,
+    RX_MSG_ETP_CONN_DATA_TRANSFER,
     RX_MSG_RESP_REQ_PROPRIETARY_A,
     RX_MSG_RESP_REQ_PROPRIETARY_B,
     RX_MSG_RESP_REQ_ADDR_CLAIMED,
@@ -51,9 +53,27 @@ typedef enum {
     RX_MSG_UNKNOWN
 } ENUM_J1939_RX_MSG;
 
+/* How many frames Open_SAE_J1939_Process_Pending handled, for each type of message */
+typedef struct {
+	uint16_t total;									/* Frames read from the CAN-bus */
+	uint16_t rx_msg[RX_MSG_UNKNOWN + 1];			/* Frames of each ENUM_J1939_RX_MSG type, e.g rx_msg[RX_MSG_TP_CONN_DATA_TRANSFER] */
+} J1939_RX_Counts;
+
 /* This functions must be called all the time, or be placed inside an interrupt listener */
 ENUM_J1939_RX_MSG Open_SAE_J1939_Listen_For_Messages(J1939 *j1939);
 
+/* Same as Open_SAE_J1939_Listen_For_Messages, but for all frames that are waiting, at most max_frames */
+J1939_RX_Counts Open_SAE_J1939_Process_Pending(J1939 *j1939, uint16_t max_frames);
+
+/* Same as Open_SAE_J1939_Listen_For_Messages, but for a frame that the caller has read */
+ENUM_J1939_RX_MSG Open_SAE_J1939_Process_Message(J1939 *j1939, uint32_t ID, uint8_t data[]);
+
+/* The CAN ID/mask pairs, at most max_filters, that accept every frame the stack reads. A frame passes if (frame ID & mask[i]) == ID[i] for any i */
+uint8_t Open_SAE_J1939_Get_Acceptance_Filters(J1939 *j1939, uint32_t ID[], uint32_t mask[], uint8_t max_filters);
+
+/* Program the acceptance filters into the CAN hardware. They are programmed again when this_ECU_address changes, e.g by Commanded Address */
+bool Open_SAE_J1939_Update_Acceptance_Filters(J1939 *j1939);
+
 /* This function should ONLY be called at your ECU startup */
 bool Open_SAE_J1939_Startup_ECU(J1939* j1939);
 
@@ -21,6 +21,10 @@
 
 /* This is the maximum size for transferring data and these can be changed on your own interest */
 #define MAX_TP_DT 1785U
+#define MAX_ETP_DT 117440505UL						/* 16777215 packages of 7 bytes */
+#define MAX_TP_SESSIONS 8U							/* TP messages that can be sent and read at the same time */
+#define TP_BUFFER_BLOCK_SIZE 112U					/* Bytes in one block of the TP buffer pool - 16 packages */
+#define TP_BUFFER_BLOCKS 24U						/* Blocks in the TP buffer pool, at most 32. A message of MAX_TP_DT bytes takes 16 blocks */
 #define MAX_IDENTIFICATION 30U
 #define MAX_DM_FIELD 10U
 #define MAX_PROPRIETARY_A 15U
@@ -45,10 +49,11 @@ struct TP_CM {
 	/* RTS */
 	uint16_t total_message_size_being_transmitted;	/* Total bytes our complete message includes - 9 to 1785 */
 	uint8_t number_of_packages_being_transmitted;	/* How many times we are going to send packages via TP_DT - 2 to 224 because 1785/8 is 224 rounded up */
+	uint8_t maximum_packages_per_CTS;				/* Most packages the transmitter wants to send for one CTS - 0xFF = no limit */
 	
 	/* CTS */
-	uint8_t total_number_of_packages_transmitted;	/* Total packages we have received */
-	uint8_t next_packet_number_transmitted;			/* Next packet number we want to have from the transmitter */
+	uint8_t total_number_of_packages_transmitted;	/* How many packages the transmitter can send now - 0 = wait for the next CTS */
+	uint8_t next_packet_number_transmitted;			/* Next packet number we want to have from the transmitter - 1 to 255 */
 
 	/* EOM */
 	uint16_t total_number_of_bytes_received;		/* Total bytes we are have got */
@@ -69,6 +74,47 @@ struct TP_DT {
 	uint8_t from_ecu_address;						/* From which ECU came this message */
 };
 
+/* One TP message that this ECU is sending or reading. The data is in the blocks first_block to first_block + number_of_blocks - 1 of tp_buffer */
+struct TP_Session {
+	bool in_use;
+	bool is_sending;								/* true = this ECU sends the message, false = this ECU reads it */
+	uint8_t control_byte;							/* CONTROL_BYTE_TP_CM_RTS or CONTROL_BYTE_TP_CM_BAM */
+	uint8_t SA;										/* The session is found by SA and DA - DA is 0xFF for BAM */
+	uint8_t DA;
+	uint32_t PGN_of_the_packeted_message;
+	uint16_t total_message_size;					/* 1 to 1785 bytes */
+	uint8_t number_of_packages;						/* (total_message_size + 6) / 7 */
+	uint8_t maximum_packages_per_CTS;				/* From the RTS - 0xFF = no limit */
+	uint8_t next_packet_number;						/* Next package to send or read - 1 to number_of_packages */
+	uint8_t number_of_packets_left;					/* Packages of the current CTS that are not sent or read yet */
+	uint8_t gap_ms;									/* BAM that this ECU sends - Milliseconds between the packages */
+	uint16_t elapsed_ms;							/* Milliseconds since the last package or CTS, for the BAM gap and the timeouts */
+	uint8_t first_block;
+	uint8_t number_of_blocks;
+};
+
+/* PGN: 0x00C800 and 0x00C700 - One Extended Transport Protocol message. The data is not stored here, it goes through the callbacks */
+struct ETP {
+	bool is_active;
+	uint8_t address;								/* The ECU at the other end of the connection */
+	uint32_t PGN_of_the_packeted_message;
+	uint32_t total_message_size;					/* 1786 to 117440505 bytes */
+	uint32_t next_packet_number;					/* Next package to send or read - 1 to 16777215 */
+	uint32_t data_packet_offset;					/* DPO - The package number is data_packet_offset + the sequence number of the package */
+	uint8_t number_of_packets_left;					/* Packages of the current CTS that are not sent or read yet */
+	bool is_DPO_sent;								/* Sending - The DPO of the current CTS has been sent */
+	uint16_t elapsed_ms;							/* Milliseconds since the last package or connection management message */
+	uint16_t timeout_ms;							/* ETP_TIMEOUT_T1_MS to ETP_TIMEOUT_T4_MS - How long this ECU waits for the next one */
+
+	/* Sending - Fill data with length bytes of the message, from byte offset */
+	void (*Source)(void *context, uint32_t offset, uint8_t data[], uint8_t length);
+
+	/* Reading - data holds length bytes of the message from byte offset. Done is called when the last byte has arrived */
+	void (*Sink)(void *context, uint8_t SA, uint32_t PGN, uint32_t offset, uint8_t data[], uint8_t length);
+	void (*Done)(void *context, uint8_t SA, uint32_t PGN, uint32_t total_message_size);
+	void *context;
+};
+
 /* PGN: 0x00EE00 - Storing the Address claimed from the reading process */
 struct Name {
 	uint32_t identity_number;						/* Specify the ECU serial ID - 0 to 2097151 */
@@ -242,11 +288,18 @@ typedef struct{
 
 /* This struct is used for handling J1939 information */
 typedef struct {
+	/* CAN-bus channel of this ECU. NULL = the default interface of PROCESSOR_CHOICE, shared with every other J1939 that has NULL */
+	struct CAN_Interface *can;
+
 	/* Latest CAN message */
 	uint32_t ID;									/* This is the CAN bus ID */
 	uint8_t data[8];								/* This is the CAN bus data */
 	bool ID_and_data_is_updated;					/* This is a flag that going to be set to true for every time ID and data updates - Very useful in higher applications such as C++ */
 
+	/* Hardware acceptance filters - Set by Open_SAE_J1939_Update_Acceptance_Filters */
+	bool acceptance_filters_installed;				/* The filters follow this_ECU_address when this is true */
+	uint8_t acceptance_filters_address;				/* The this_ECU_address that the installed filters accept */
+
 	/* Store addresses of ECU */
 	uint8_t number_of_other_ECU;				 	/* How many other ECU are connected */
 	uint8_t number_of_cannot_claim_address;			/* How many ECU addresses could not claim their address */
@@ -255,8 +308,8 @@ typedef struct {
 	/* Temporary store the information from the reading process - SAE J1939 */
 	struct Name from_other_ecu_name;
 	struct Acknowledgement from_other_ecu_acknowledgement;
-	struct TP_CM from_other_ecu_tp_cm;
-	struct TP_DT from_other_ecu_tp_dt;
+	struct TP_CM from_other_ecu_tp_cm;				/* The last TP CM message from other ECU */
+	struct ETP from_other_ecu_etp;					/* Set Sink, Done and context to let other ECU send ETP messages to this ECU */
 	struct DM from_other_ecu_dm;
 	struct Identifications from_other_ecu_identifications;
 	struct Proprietary from_other_ecu_proprietary;
@@ -264,6 +317,14 @@ typedef struct {
 	/* Temporary hold this values for this ECU when we are going to send data */
 	struct TP_CM this_ecu_tp_cm;
 	struct TP_DT this_ecu_tp_dt;
+	uint8_t this_ecu_tp_bam_gap_ms;					/* Milliseconds between the packages of a BAM - 10 to 200, 0 = TP_BAM_DEFAULT_GAP_MS */
+	uint8_t this_ecu_tp_cts_window;					/* How many packages this ECU lets the transmitter send for each CTS - 1 to 255, 0 = TP_CTS_DEFAULT_WINDOW */
+	struct ETP this_ecu_etp;						/* Set Source and context before SAE_J1939_Send_Extended_Transport_Protocol */
+
+	/* TP messages that are being sent and read, and the pool of buffers they use */
+	struct TP_Session tp_sessions[MAX_TP_SESSIONS];
+	uint32_t tp_used_blocks;						/* Bit i set = block i of tp_buffer belongs to a session */
+	uint8_t tp_buffer[TP_BUFFER_BLOCKS * TP_BUFFER_BLOCK_SIZE];
 
 	/* Temporary store the valve information from the reading process - ISO 11783-7 */
 	struct Auxiliary_valve_estimated_flow from_other_ecu_auxiliary_valve_estimated_flow[16];
@@ -34,5 +34,5 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Send_Acknowledgement(J1939 *j1939, uint8_t DA,
 	data[5] = PGN_of_requested_info;
 	data[6] = PGN_of_requested_info >> 8;
 	data[7] = PGN_of_requested_info >> 16;
-	return CAN_Send_Message(ID, data);
+	return CAN_Send_Message(j1939->can, ID, data);
 }
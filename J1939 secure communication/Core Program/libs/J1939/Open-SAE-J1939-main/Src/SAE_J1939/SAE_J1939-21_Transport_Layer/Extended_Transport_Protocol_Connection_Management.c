@@ -0,0 +1,159 @@
+/*
+ * Extended_Transport_Protocol_Connection_Management.c
+ *
+ *  Created on: 18 okt. 2026
+ */
+
+#include "Transport_Layer.h"
+
+/*
+ * Store information about the extended sequence data packages that other ECU is going to send to this ECU,
+ * and the answers from the ECU that this ECU is sending to
+ * PGN: 0x00C800 (51200)
+ */
+void SAE_J1939_Read_Extended_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t SA, uint8_t data[]) {
+	struct ETP *from_other_ecu_etp = &j1939->from_other_ecu_etp;
+	struct ETP *this_ecu_etp = &j1939->this_ecu_etp;
+	uint32_t PGN = ((uint32_t)data[7] << 16) | ((uint32_t)data[6] << 8) | data[5];
+	uint32_t packet_number = ((uint32_t)data[4] << 16) | ((uint32_t)data[3] << 8) | data[2];	/* CTS and DPO */
+	uint32_t total_message_size = ((uint32_t)data[4] << 24) | ((uint32_t)data[3] << 16) | ((uint32_t)data[2] << 8) | data[1];	/* RTS */
+
+	/* Check the control byte */
+	switch (data[0]) {
+	case CONTROL_BYTE_ETP_CM_RTS:
+		/* One message at the time from other ECU. Without a sink, or with a size that is not for ETP, this ECU cannot take it */
+		if (from_other_ecu_etp->is_active && from_other_ecu_etp->address != SA) {
+			SAE_J1939_Send_Extended_Transport_Protocol_Connection_Management(j1939, SA, CONTROL_BYTE_TP_CM_ABORT, 0xFFFFFF00UL | TP_ABORT_ALREADY_IN_SESSION, PGN);
+			break;
+		}
+		if (from_other_ecu_etp->Sink == NULL || total_message_size <= MAX_TP_DT || total_message_size > MAX_ETP_DT) {
+			SAE_J1939_Send_Extended_Transport_Protocol_Connection_Management(j1939, SA, CONTROL_BYTE_TP_CM_ABORT, 0xFFFFFF00UL | TP_ABORT_NO_RESOURCES, PGN);
+			break;
+		}
+
+		/* Set the RTS values and send CTS for the first window */
+		from_other_ecu_etp->is_active = true;
+		from_other_ecu_etp->address = SA;
+		from_other_ecu_etp->PGN_of_the_packeted_message = PGN;
+		from_other_ecu_etp->total_message_size = total_message_size;
+		from_other_ecu_etp->next_packet_number = 1;
+		from_other_ecu_etp->data_packet_offset = 0;
+		from_other_ecu_etp->number_of_packets_left = 0;
+		SAE_J1939_Send_Extended_Transport_Protocol_Clear_To_Send(j1939, SA);
+		break;
+	case CONTROL_BYTE_ETP_CM_CTS:
+		if (this_ecu_etp->is_active && this_ecu_etp->address == SA) {
+			this_ecu_etp->number_of_packets_left = data[1];
+			this_ecu_etp->next_packet_number = packet_number;
+			this_ecu_etp->is_DPO_sent = false;
+			this_ecu_etp->elapsed_ms = 0;
+			this_ecu_etp->timeout_ms = data[1] == 0 ? ETP_TIMEOUT_T4_MS : ETP_TIMEOUT_T3_MS;		/* 0 = Wait for the next CTS */
+			SAE_J1939_Send_Extended_Transport_Protocol_Data_Transfer(j1939, SA);
+		}
+		break;
+	case CONTROL_BYTE_ETP_CM_DPO:
+		if (from_other_ecu_etp->is_active && from_other_ecu_etp->address == SA) {
+			from_other_ecu_etp->number_of_packets_left = data[1];
+			from_other_ecu_etp->data_packet_offset = packet_number;
+			from_other_ecu_etp->elapsed_ms = 0;
+			from_other_ecu_etp->timeout_ms = ETP_TIMEOUT_T1_MS;
+		}
+		break;
+	case CONTROL_BYTE_ETP_CM_EndOfMsgACK:
+		if (this_ecu_etp->address == SA) {
+			this_ecu_etp->is_active = false;
+		}
+		break;
+	case CONTROL_BYTE_TP_CM_ABORT:
+		if (this_ecu_etp->address == SA) {
+			this_ecu_etp->is_active = false;
+		}
+		if (from_other_ecu_etp->address == SA) {
+			from_other_ecu_etp->is_active = false;
+		}
+	}
+}
+
+/*
+ * Send one extended connection management message. bytes_1_to_4 is the message size for RTS and EOM ACK,
+ * else the number of packages in byte 1 and the package number in byte 2 to 4
+ * PGN: 0x00C800 (51200)
+ */
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Extended_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t DA, uint8_t control_byte, uint32_t bytes_1_to_4, uint32_t PGN) {
+	uint32_t ID = (0x1CC8 << 16) | (DA << 8) | j1939->information_this_ECU.this_ECU_address;
+	uint8_t data[8];
+	data[0] = control_byte;
+	data[1] = bytes_1_to_4;
+	data[2] = bytes_1_to_4 >> 8;
+	data[3] = bytes_1_to_4 >> 16;
+	data[4] = bytes_1_to_4 >> 24;
+	data[5] = PGN;
+	data[6] = PGN >> 8;
+	data[7] = PGN >> 16;
+	return CAN_Send_Message(j1939->can, ID, data);
+}
+
+/*
+ * Let the other ECU send its packages from next_packet_number and onwards. At most this_ecu_tp_cts_window packages
+ * PGN: 0x00C800 (51200)
+ * The DPO must come within ETP_TIMEOUT_T2_MS
+ */
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Extended_Transport_Protocol_Clear_To_Send(J1939 *j1939, uint8_t DA) {
+	struct ETP *from_other_ecu_etp = &j1939->from_other_ecu_etp;
+	uint32_t number_of_packages = (from_other_ecu_etp->total_message_size + 6) / 7;
+	uint32_t window = j1939->this_ecu_tp_cts_window == 0 ? ETP_CTS_DEFAULT_WINDOW : j1939->this_ecu_tp_cts_window;
+	if (window > number_of_packages - from_other_ecu_etp->next_packet_number + 1) {
+		window = number_of_packages - from_other_ecu_etp->next_packet_number + 1;
+	}
+	from_other_ecu_etp->elapsed_ms = 0;
+	from_other_ecu_etp->timeout_ms = ETP_TIMEOUT_T2_MS;
+	return SAE_J1939_Send_Extended_Transport_Protocol_Connection_Management(j1939, DA, CONTROL_BYTE_ETP_CM_CTS, (from_other_ecu_etp->next_packet_number << 8) | window, from_other_ecu_etp->PGN_of_the_packeted_message);
+}
+
+/*
+ * Start sending total_message_size bytes to DA with the Extended Transport Protocol. The bytes are read from this_ecu_etp.Source
+ * when the CTS messages arrive, so the message is never stored in the J1939 struct. Returning STATUS_SEND_BUSY while the last message is being sent
+ * PGN: 0x00C800 (51200)
+ */
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Extended_Transport_Protocol(J1939 *j1939, uint8_t DA, uint32_t PGN, uint32_t total_message_size) {
+	struct ETP *this_ecu_etp = &j1939->this_ecu_etp;
+	ENUM_J1939_STATUS_CODES status;
+
+	/* ETP is for one ECU and for messages that TP cannot send */
+	if (this_ecu_etp->is_active) {
+		return STATUS_SEND_BUSY;
+	}
+	if (this_ecu_etp->Source == NULL || DA == 0xFF || total_message_size <= MAX_TP_DT || total_message_size > MAX_ETP_DT) {
+		return STATUS_SEND_ERROR;
+	}
+
+	/* Send RTS */
+	this_ecu_etp->address = DA;
+	this_ecu_etp->PGN_of_the_packeted_message = PGN;
+	this_ecu_etp->total_message_size = total_message_size;
+	this_ecu_etp->next_packet_number = 1;
+	this_ecu_etp->data_packet_offset = 0;
+	this_ecu_etp->number_of_packets_left = 0;
+	this_ecu_etp->is_DPO_sent = false;
+	this_ecu_etp->elapsed_ms = 0;
+	this_ecu_etp->timeout_ms = ETP_TIMEOUT_T3_MS;
+	this_ecu_etp->is_active = true;
+	status = SAE_J1939_Send_Extended_Transport_Protocol_Connection_Management(j1939, DA, CONTROL_BYTE_ETP_CM_RTS, total_message_size, PGN);
+	if (status != STATUS_SEND_OK) {
+		this_ecu_etp->is_active = false;
+	}
+	return status;
+}
+
+/*
+ * Stop the ETP message of etp, &j1939->this_ecu_etp or &j1939->from_other_ecu_etp, and tell the ECU at the other end why.
+ * SAE_J1939_Transport_Protocol_Tick calls this with TP_ABORT_TIMEOUT when that ECU has stopped answering
+ * PGN: 0x00C800 (51200)
+ */
+ENUM_J1939_STATUS_CODES SAE_J1939_Abort_Extended_Transport_Protocol(J1939 *j1939, struct ETP *etp, uint8_t reason) {
+	if (!etp->is_active) {
+		return STATUS_SEND_OK;
+	}
+	etp->is_active = false;
+	return SAE_J1939_Send_Extended_Transport_Protocol_Connection_Management(j1939, etp->address, CONTROL_BYTE_TP_CM_ABORT, 0xFFFFFF00UL | reason, etp->PGN_of_the_packeted_message);
+}
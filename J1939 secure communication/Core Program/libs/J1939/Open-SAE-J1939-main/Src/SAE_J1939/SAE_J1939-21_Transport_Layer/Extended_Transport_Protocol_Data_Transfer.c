@@ -0,0 +1,100 @@
+/*
+ * Extended_Transport_Protocol_Data_Transfer.c
+ *
+ *  Created on: 18 okt. 2026
+ */
+
+#include "Transport_Layer.h"
+
+/*
+ * Give the extended sequence data packages from other ECU to from_other_ecu_etp.Sink
+ * PGN: 0x00C700 (50944)
+ */
+void SAE_J1939_Read_Extended_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t SA, uint8_t data[]) {
+	struct ETP *from_other_ecu_etp = &j1939->from_other_ecu_etp;
+	uint32_t packet_number = from_other_ecu_etp->data_packet_offset + data[0];
+	uint32_t offset = (packet_number - 1) * 7;
+	uint8_t length = 7;
+	if (!from_other_ecu_etp->is_active || from_other_ecu_etp->address != SA || from_other_ecu_etp->number_of_packets_left == 0) {
+		return;
+	}
+
+	/* The packages must come in order - A lost package ends the message */
+	if (data[0] == 0 || packet_number != from_other_ecu_etp->next_packet_number) {
+		SAE_J1939_Abort_Extended_Transport_Protocol(j1939, from_other_ecu_etp, TP_ABORT_BAD_SEQUENCE_NUMBER);
+		return;
+	}
+	if (from_other_ecu_etp->total_message_size - offset < 7) {
+		length = from_other_ecu_etp->total_message_size - offset;
+	}
+	from_other_ecu_etp->Sink(from_other_ecu_etp->context, SA, from_other_ecu_etp->PGN_of_the_packeted_message, offset, &data[1], length);
+	from_other_ecu_etp->next_packet_number++;
+	from_other_ecu_etp->number_of_packets_left--;
+	from_other_ecu_etp->elapsed_ms = 0;
+
+	/* Send an end of message ACK back, or a new CTS when the last package of the window has arrived */
+	if (offset + length >= from_other_ecu_etp->total_message_size) {
+		from_other_ecu_etp->is_active = false;
+		SAE_J1939_Send_Extended_Transport_Protocol_Connection_Management(j1939, SA, CONTROL_BYTE_ETP_CM_EndOfMsgACK, from_other_ecu_etp->total_message_size, from_other_ecu_etp->PGN_of_the_packeted_message);
+		if (from_other_ecu_etp->Done != NULL) {
+			from_other_ecu_etp->Done(from_other_ecu_etp->context, SA, from_other_ecu_etp->PGN_of_the_packeted_message, from_other_ecu_etp->total_message_size);
+		}
+	} else if (from_other_ecu_etp->number_of_packets_left == 0) {
+		SAE_J1939_Send_Extended_Transport_Protocol_Clear_To_Send(j1939, SA);
+	}
+}
+
+/*
+ * Send the DPO and then the packages that the CTS asks for. The data is read from this_ecu_etp.Source, TP_DT_BURST packages for each CAN_Send_Messages call
+ * PGN: 0x00C700 (50944)
+ * If the bus is busy, next_packet_number and number_of_packets_left keep what is left of the window and SAE_J1939_Transport_Protocol_Tick sends it later
+ */
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Extended_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t DA) {
+	struct ETP *this_ecu_etp = &j1939->this_ecu_etp;
+	uint32_t ID[TP_DT_BURST];
+	uint8_t packages[TP_DT_BURST * 8];
+	uint32_t number_of_packages = (this_ecu_etp->total_message_size + 6) / 7;
+	uint32_t offset, sequence_number;
+	uint8_t i, j, length, sent;
+	ENUM_J1939_STATUS_CODES status = STATUS_SEND_OK;
+
+	/* A CTS with 0 packages means wait. Never more packages than the message has */
+	if (this_ecu_etp->number_of_packets_left == 0 || this_ecu_etp->next_packet_number == 0 || this_ecu_etp->next_packet_number > number_of_packages) {
+		return STATUS_SEND_OK;
+	}
+	if (this_ecu_etp->number_of_packets_left > number_of_packages - this_ecu_etp->next_packet_number + 1) {
+		this_ecu_etp->number_of_packets_left = number_of_packages - this_ecu_etp->next_packet_number + 1;
+	}
+
+	/* The sequence numbers 1 to 255 of the packages count from the DPO, which is sent once for each CTS */
+	if (!this_ecu_etp->is_DPO_sent) {
+		this_ecu_etp->data_packet_offset = this_ecu_etp->next_packet_number - 1;
+		status = SAE_J1939_Send_Extended_Transport_Protocol_Connection_Management(j1939, DA, CONTROL_BYTE_ETP_CM_DPO, (this_ecu_etp->data_packet_offset << 8) | this_ecu_etp->number_of_packets_left, this_ecu_etp->PGN_of_the_packeted_message);
+		if (status != STATUS_SEND_OK) {
+			return status;
+		}
+		this_ecu_etp->is_DPO_sent = true;
+		this_ecu_etp->elapsed_ms = 0;
+	}
+
+	while (status == STATUS_SEND_OK && this_ecu_etp->number_of_packets_left > 0) {
+		sequence_number = this_ecu_etp->next_packet_number - this_ecu_etp->data_packet_offset;
+		for (i = 0; i < TP_DT_BURST && i < this_ecu_etp->number_of_packets_left; i++) {
+			offset = (this_ecu_etp->next_packet_number + i - 1) * 7;
+			length = this_ecu_etp->total_message_size - offset < 7 ? this_ecu_etp->total_message_size - offset : 7;
+			ID[i] = (0x1CC7 << 16) | (DA << 8) | j1939->information_this_ECU.this_ECU_address;
+			packages[i * 8] = (uint8_t)(sequence_number + i);
+			this_ecu_etp->Source(this_ecu_etp->context, offset, &packages[i * 8 + 1], length);
+			for (j = length; j < 7; j++) {
+				packages[i * 8 + 1 + j] = 0xFF;														/* Reserved */
+			}
+		}
+		status = CAN_Send_Messages(j1939->can, ID, packages, i, &sent);
+		this_ecu_etp->next_packet_number += sent;
+		this_ecu_etp->number_of_packets_left -= sent;
+		if (sent > 0) {
+			this_ecu_etp->elapsed_ms = 0;
+		}
+	}
+	return status;
+}
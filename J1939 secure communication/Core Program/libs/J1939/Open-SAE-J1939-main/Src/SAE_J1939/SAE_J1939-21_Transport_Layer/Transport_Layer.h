@@ -21,6 +21,37 @@
 /* Layers */
 #include "../../Hardware/Hardware.h"
 
+/* Milliseconds between the TP DT packages of a BAM - SAE J1939-21 */
+#define TP_BAM_MIN_GAP_MS 10U
+#define TP_BAM_MAX_GAP_MS 200U
+#define TP_BAM_DEFAULT_GAP_MS 50U
+
+/* Packages for each CTS when this_ecu_tp_cts_window is 0. Keep it at 1 when two ECUs read the same receive buffer, as the examples do */
+#define TP_CTS_DEFAULT_WINDOW 1U
+
+/* Most TP DT packages that go to CAN_Send_Messages in one call */
+#define TP_DT_BURST 16U
+
+/* Packages for each ETP CTS when this_ecu_tp_cts_window is 0 */
+#define ETP_CTS_DEFAULT_WINDOW 16U
+
+/* Milliseconds without a package, CTS or EOM ACK before SAE_J1939_Transport_Protocol_Tick closes a session - SAE J1939-21 */
+#define TP_TIMEOUT_T1_MS 750U						/* Reading a BAM */
+#define TP_TIMEOUT_T2_MS 1250U						/* Reading after a CTS */
+#define TP_TIMEOUT_T3_MS 1250U						/* Sending, waiting for CTS or EOM ACK */
+
+/* Milliseconds without a package, CTS, DPO or EOM ACK before SAE_J1939_Transport_Protocol_Tick aborts an ETP message - SAE J1939-21 */
+#define ETP_TIMEOUT_T1_MS 750U						/* Reading, between the DPO and the packages */
+#define ETP_TIMEOUT_T2_MS 1250U						/* Reading after a CTS */
+#define ETP_TIMEOUT_T3_MS 1250U						/* Sending, waiting for CTS or EOM ACK */
+#define ETP_TIMEOUT_T4_MS 1050U						/* Sending, after a CTS with 0 packages */
+
+/* Connection abort reasons - SAE J1939-21 */
+#define TP_ABORT_ALREADY_IN_SESSION 1U
+#define TP_ABORT_NO_RESOURCES 2U
+#define TP_ABORT_TIMEOUT 3U
+#define TP_ABORT_BAD_SEQUENCE_NUMBER 7U
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,13 +65,34 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Send_Acknowledgement(J1939 *j1939, uint8_t DA,
 void SAE_J1939_Read_Request(J1939 *j1939, uint8_t SA, uint8_t data[]);
 ENUM_J1939_STATUS_CODES SAE_J1939_Send_Request(J1939 *j1939, uint8_t DA, uint32_t PGN_code);
 
+/* Transport Protocol Sessions */
+struct TP_Session *SAE_J1939_Open_Transport_Protocol_Session(J1939 *j1939, bool is_sending, uint8_t SA, uint8_t DA, uint32_t PGN, uint16_t total_message_size);
+struct TP_Session *SAE_J1939_Find_Transport_Protocol_Session(J1939 *j1939, uint8_t SA, uint8_t DA);
+uint8_t *SAE_J1939_Get_Transport_Protocol_Session_Data(J1939 *j1939, struct TP_Session *session);
+void SAE_J1939_Close_Transport_Protocol_Session(J1939 *j1939, struct TP_Session *session);
+
 /* Transport Protocol Connection Management */
-void SAE_J1939_Read_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t SA, uint8_t data[]);
+void SAE_J1939_Read_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t SA, uint8_t DA, uint8_t data[]);
 ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t DA);
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_Clear_To_Send(J1939 *j1939, struct TP_Session *session);
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_End_Of_Message_ACK(J1939 *j1939, struct TP_Session *session);
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_Abort(J1939 *j1939, uint8_t DA, uint8_t reason, uint32_t PGN);
 
 /* Transport Protocol Data Transfer */
-void SAE_J1939_Read_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t SA, uint8_t data[]);
+void SAE_J1939_Read_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t SA, uint8_t DA, uint8_t data[]);
 ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t DA);
+void SAE_J1939_Transport_Protocol_Tick(J1939 *j1939, uint16_t elapsed_ms);
+
+/* Extended Transport Protocol Connection Management */
+void SAE_J1939_Read_Extended_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t SA, uint8_t data[]);
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Extended_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t DA, uint8_t control_byte, uint32_t bytes_1_to_4, uint32_t PGN);
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Extended_Transport_Protocol_Clear_To_Send(J1939 *j1939, uint8_t DA);
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Extended_Transport_Protocol(J1939 *j1939, uint8_t DA, uint32_t PGN, uint32_t total_message_size);
+ENUM_J1939_STATUS_CODES SAE_J1939_Abort_Extended_Transport_Protocol(J1939 *j1939, struct ETP *etp, uint8_t reason);
+
+/* Extended Transport Protocol Data Transfer */
+void SAE_J1939_Read_Extended_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t SA, uint8_t data[]);
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Extended_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t DA);
 
 #ifdef __cplusplus
 }
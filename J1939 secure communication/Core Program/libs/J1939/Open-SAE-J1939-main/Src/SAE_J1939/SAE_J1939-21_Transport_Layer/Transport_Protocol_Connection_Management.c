@@ -7,16 +7,36 @@
 
 #include "Transport_Layer.h"
 
+/* Send a TP CM message. bytes_1_to_4 is little endian, like the PGN */
+static ENUM_J1939_STATUS_CODES Send_Connection_Management(J1939 *j1939, uint8_t DA, uint8_t control_byte, uint32_t bytes_1_to_4, uint32_t PGN) {
+	uint32_t ID = (0x1CEC << 16) | (DA << 8) | j1939->information_this_ECU.this_ECU_address;
+	uint8_t data[8];
+	data[0] = control_byte;
+	data[1] = bytes_1_to_4;
+	data[2] = bytes_1_to_4 >> 8;
+	data[3] = bytes_1_to_4 >> 16;
+	data[4] = bytes_1_to_4 >> 24;
+	data[5] = PGN;
+	data[6] = PGN >> 8;
+	data[7] = PGN >> 16;
+	return CAN_Send_Message(j1939->can, ID, data);
+}
+
 /*
  * Store information about sequence data packages from other ECU who are going to send to this ECU
  * PGN: 0x00EC00 (60416)
+ * Every RTS and BAM gets its own session, so messages from several ECUs can be read at the same time
  */
-void SAE_J1939_Read_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t SA, uint8_t data[]) {
+void SAE_J1939_Read_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t SA, uint8_t DA, uint8_t data[]) {
+	uint8_t this_ECU_address = j1939->information_this_ECU.this_ECU_address;
+	uint32_t PGN = (data[7] << 16) | (data[6] << 8) | data[5];
+	struct TP_Session *session;
+
 	/* Read the control byte */
 	j1939->from_other_ecu_tp_cm.control_byte = data[0];
 
 	/* PGN */
-	j1939->from_other_ecu_tp_cm.PGN_of_the_packeted_message = (data[7] << 16) | (data[6] << 8) | data[5];
+	j1939->from_other_ecu_tp_cm.PGN_of_the_packeted_message = PGN;
 
 	/* Source address */
 	j1939->from_other_ecu_tp_cm.from_ecu_address = SA;
@@ -27,72 +47,142 @@ void SAE_J1939_Read_Transport_Protocol_Connection_Management(J1939 *j1939, uint8
 		/* Set the RTS values */
 		j1939->from_other_ecu_tp_cm.total_message_size_being_transmitted = (data[2] << 8) | data[1];
 		j1939->from_other_ecu_tp_cm.number_of_packages_being_transmitted = data[3];
+		j1939->from_other_ecu_tp_cm.maximum_packages_per_CTS = data[4];
+		if (DA == 0xFF) {
+			break;																	/* RTS must be sent to one ECU */
+		}
 
-		/* Send CTS */
-		j1939->this_ecu_tp_cm.control_byte = CONTROL_BYTE_TP_CM_CTS;
-		j1939->this_ecu_tp_cm.total_number_of_packages_transmitted = 0;
-		j1939->this_ecu_tp_cm.next_packet_number_transmitted = 0;
-		j1939->this_ecu_tp_cm.PGN_of_the_packeted_message = (data[7] << 16) | (data[6] << 8) | data[5];
-		SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, SA);
+		/* Send CTS for the first window, or abort if this ECU has no room for the message */
+		session = SAE_J1939_Open_Transport_Protocol_Session(j1939, false, SA, DA, PGN, (data[2] << 8) | data[1]);
+		if (session == NULL) {
+			SAE_J1939_Send_Transport_Protocol_Abort(j1939, SA, TP_ABORT_NO_RESOURCES, PGN);
+			break;
+		}
+		session->maximum_packages_per_CTS = data[4];
+		SAE_J1939_Send_Transport_Protocol_Clear_To_Send(j1939, session);
 		break;
 	case CONTROL_BYTE_TP_CM_CTS:
 		j1939->from_other_ecu_tp_cm.total_number_of_packages_transmitted = data[1];
 		j1939->from_other_ecu_tp_cm.next_packet_number_transmitted = data[2];
+		session = SAE_J1939_Find_Transport_Protocol_Session(j1939, this_ECU_address, SA);
+		if (session == NULL || !session->is_sending || session->PGN_of_the_packeted_message != PGN) {
+			break;
+		}
+		session->number_of_packets_left = data[1];									/* 0 = Wait for the next CTS */
+		session->next_packet_number = data[2];
+		session->elapsed_ms = 0;
 		SAE_J1939_Send_Transport_Protocol_Data_Transfer(j1939, SA);
 		break;
 	case CONTROL_BYTE_TP_CM_BAM:
 		j1939->from_other_ecu_tp_cm.total_message_size_being_transmitted = (data[2] << 8) | data[1];
 		j1939->from_other_ecu_tp_cm.number_of_packages_being_transmitted = data[3];
-		SAE_J1939_Send_Transport_Protocol_Data_Transfer(j1939, SA);
+		SAE_J1939_Open_Transport_Protocol_Session(j1939, false, SA, 0xFF, PGN, (data[2] << 8) | data[1]);	/* No room = The BAM is not read */
 		break;
 	case CONTROL_BYTE_TP_CM_EndOfMsgACK:
 		j1939->from_other_ecu_tp_cm.total_number_of_bytes_received = (data[2] << 8) | data[1];
 		j1939->from_other_ecu_tp_cm.total_number_of_packages_received = data[3];
+		session = SAE_J1939_Find_Transport_Protocol_Session(j1939, this_ECU_address, SA);
+		if (session != NULL && session->is_sending && session->PGN_of_the_packeted_message == PGN) {
+			SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
+		}
+		break;
+	case CONTROL_BYTE_TP_CM_ABORT:
+		/* The abort can come from both sides of the connection */
+		session = SAE_J1939_Find_Transport_Protocol_Session(j1939, this_ECU_address, SA);
+		if (session != NULL && session->PGN_of_the_packeted_message == PGN) {
+			SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
+		}
+		session = SAE_J1939_Find_Transport_Protocol_Session(j1939, SA, this_ECU_address);
+		if (session != NULL && session->PGN_of_the_packeted_message == PGN) {
+			SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
+		}
 	}
 }
 
 /*
  * Send information to other ECU about how much sequence data packages this ECU is going to send to other ECU
  * PGN: 0x00EC00 (60416)
+ * An RTS or BAM copies this_ecu_tp_dt into a session, so this_ecu_tp_dt can be loaded with the next message right away. The number of
+ * packages is counted from total_message_size_being_transmitted.
+ * This is where every TP message that this ECU sends starts, and the only place that checks if it can be sent. Returns STATUS_SEND_BUSY
+ * if this ECU already sends to DA, e.g a BAM that SAE_J1939_Transport_Protocol_Tick has not finished, or if there is no room for the message
  */
 ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_Connection_Management(J1939 *j1939, uint8_t DA) {
-	uint32_t ID = (0x1CEC << 16) | (DA << 8) | j1939->information_this_ECU.this_ECU_address;
-	uint8_t data[8] = { 0 };
-
-	/* Read the control byte */
-	data[0] = j1939->this_ecu_tp_cm.control_byte;
+	uint16_t total_message_size = j1939->this_ecu_tp_cm.total_message_size_being_transmitted;
+	uint32_t PGN = j1939->this_ecu_tp_cm.PGN_of_the_packeted_message;
+	uint8_t control_byte = j1939->this_ecu_tp_cm.control_byte;
+	struct TP_Session *session;
+	ENUM_J1939_STATUS_CODES status;
 
 	/* Check the control byte */
-	switch (data[0]) {
+	switch (control_byte) {
 	case CONTROL_BYTE_TP_CM_RTS:
-		data[1] = j1939->this_ecu_tp_cm.total_message_size_being_transmitted;
-		data[2] = j1939->this_ecu_tp_cm.total_message_size_being_transmitted >> 8;
-		data[3] = j1939->this_ecu_tp_cm.number_of_packages_being_transmitted;
-		data[4] = 0xFF; 															/* Reserved */
-		break;
-	case CONTROL_BYTE_TP_CM_CTS:
-		data[1] = j1939->this_ecu_tp_cm.total_number_of_packages_transmitted;
-		data[2] = j1939->this_ecu_tp_cm.next_packet_number_transmitted;
-		data[3] = 0xFF; 															/* Reserved */
-		data[4] = 0xFF; 															/* Reserved */
-		break;
 	case CONTROL_BYTE_TP_CM_BAM:
-		data[1] = j1939->this_ecu_tp_cm.total_message_size_being_transmitted;
-		data[2] = j1939->this_ecu_tp_cm.total_message_size_being_transmitted >> 8;
-		data[3] = j1939->this_ecu_tp_cm.number_of_packages_being_transmitted;
-		data[4] = 0xFF; 															/* Reserved */
-		break;
+		session = SAE_J1939_Open_Transport_Protocol_Session(j1939, true, j1939->information_this_ECU.this_ECU_address, control_byte == CONTROL_BYTE_TP_CM_BAM ? 0xFF : DA, PGN, total_message_size);
+		if (session == NULL) {
+			return STATUS_SEND_BUSY;
+		}
+		memcpy(SAE_J1939_Get_Transport_Protocol_Session_Data(j1939, session), j1939->this_ecu_tp_dt.data, total_message_size);
+		if (control_byte == CONTROL_BYTE_TP_CM_BAM) {
+			/* Broadcast - The first package goes out one gap after the TP CM */
+			session->gap_ms = j1939->this_ecu_tp_bam_gap_ms;
+			if (session->gap_ms == 0) {
+				session->gap_ms = TP_BAM_DEFAULT_GAP_MS;
+			} else if (session->gap_ms < TP_BAM_MIN_GAP_MS) {
+				session->gap_ms = TP_BAM_MIN_GAP_MS;
+			} else if (session->gap_ms > TP_BAM_MAX_GAP_MS) {
+				session->gap_ms = TP_BAM_MAX_GAP_MS;
+			}
+			DA = 0xFF;
+		}
+		status = Send_Connection_Management(j1939, DA, control_byte, ((uint32_t)0xFF << 24) | ((uint32_t)session->number_of_packages << 16) | total_message_size, PGN);
+		if (status != STATUS_SEND_OK) {
+			SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
+		}
+		return status;
+	case CONTROL_BYTE_TP_CM_CTS:
+		return Send_Connection_Management(j1939, DA, control_byte, 0xFFFF0000UL | (j1939->this_ecu_tp_cm.next_packet_number_transmitted << 8) | j1939->this_ecu_tp_cm.total_number_of_packages_transmitted, PGN);
 	case CONTROL_BYTE_TP_CM_EndOfMsgACK:
-		data[1] = j1939->this_ecu_tp_cm.total_number_of_bytes_received;
-		data[2] = j1939->this_ecu_tp_cm.total_number_of_bytes_received >> 8;
-		data[3] = j1939->this_ecu_tp_cm.total_number_of_packages_received;
-		data[4] = 0xFF; 															/* Reserved */
+		return Send_Connection_Management(j1939, DA, control_byte, 0xFF000000UL | ((uint32_t)j1939->this_ecu_tp_cm.total_number_of_packages_received << 16) | j1939->this_ecu_tp_cm.total_number_of_bytes_received, PGN);
+	default:
+		return Send_Connection_Management(j1939, DA, control_byte, 0xFFFFFFFFUL, PGN);
 	}
-	
-	/* PGN */
-	data[5] = j1939->this_ecu_tp_cm.PGN_of_the_packeted_message;
-	data[6] = j1939->this_ecu_tp_cm.PGN_of_the_packeted_message >> 8;
-	data[7] = j1939->this_ecu_tp_cm.PGN_of_the_packeted_message >> 16;
+}
 
-	return CAN_Send_Message(ID, data);
+/*
+ * Let the other ECU send the packages of the session from next_packet_number and onwards. At most this_ecu_tp_cts_window packages, so
+ * a larger window means fewer CTS round trips for each message
+ * PGN: 0x00EC00 (60416)
+ */
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_Clear_To_Send(J1939 *j1939, struct TP_Session *session) {
+	uint8_t window = j1939->this_ecu_tp_cts_window == 0 ? TP_CTS_DEFAULT_WINDOW : j1939->this_ecu_tp_cts_window;
+
+	/* Not more than the transmitter wants or has left to send */
+	if (session->maximum_packages_per_CTS > 0 && window > session->maximum_packages_per_CTS) {
+		window = session->maximum_packages_per_CTS;
+	}
+	if (session->next_packet_number > session->number_of_packages) {
+		window = 0;
+	} else if (window > session->number_of_packages - session->next_packet_number + 1) {
+		window = session->number_of_packages - session->next_packet_number + 1;
+	}
+	session->number_of_packets_left = window;
+	session->elapsed_ms = 0;
+	return Send_Connection_Management(j1939, session->SA, CONTROL_BYTE_TP_CM_CTS, 0xFFFF0000UL | (session->next_packet_number << 8) | window, session->PGN_of_the_packeted_message);
+}
+
+/*
+ * Tell the other ECU that all packages of the session have been read
+ * PGN: 0x00EC00 (60416)
+ */
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_End_Of_Message_ACK(J1939 *j1939, struct TP_Session *session) {
+	return Send_Connection_Management(j1939, session->SA, CONTROL_BYTE_TP_CM_EndOfMsgACK, 0xFF000000UL | ((uint32_t)session->number_of_packages << 16) | session->total_message_size, session->PGN_of_the_packeted_message);
+}
+
+/*
+ * Close the connection for the message PGN with DA
+ * PGN: 0x00EC00 (60416)
+ */
+ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_Abort(J1939 *j1939, uint8_t DA, uint8_t reason, uint32_t PGN) {
+	return Send_Connection_Management(j1939, DA, CONTROL_BYTE_TP_CM_ABORT, 0xFFFFFF00UL | reason, PGN);
 }
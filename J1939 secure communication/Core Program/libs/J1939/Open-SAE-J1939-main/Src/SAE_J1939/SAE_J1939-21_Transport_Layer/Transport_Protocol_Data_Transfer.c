@@ -15,133 +15,224 @@
 /*
  * Store the sequence data packages from other ECU
  * PGN: 0x00EB00 (60160)
+ * The package goes into the session of SA and DA at byte (sequence number - 1) * 7. The complete message is read from there, it is not copied.
+ * The packages must come in order, so the message is only read when every package has arrived
  */
-void SAE_J1939_Read_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t SA, uint8_t data[]) {
-	/* Save the sequence data */
-	j1939->from_other_ecu_tp_dt.sequence_number = data[0];
-	j1939->from_other_ecu_tp_dt.from_ecu_address = SA;
-	uint8_t i, j, index = data[0] - 1;
-	for (i = 1; i < 8; i++){
-		j1939->from_other_ecu_tp_dt.data[index*7 + i-1] = data[i]; /* For every package, we send 7 bytes of data where the first byte data[0] is the sequence number */
+void SAE_J1939_Read_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t SA, uint8_t DA, uint8_t data[]) {
+	struct TP_Session *session = SAE_J1939_Find_Transport_Protocol_Session(j1939, SA, DA);
+	uint8_t *message;
+	uint16_t index;
+	uint8_t i;
+
+	if (session == NULL || session->is_sending) {
+		return;
 	}
-	/* Check if we have completed our message - Return = Not completed */
-	if (j1939->from_other_ecu_tp_cm.number_of_packages_being_transmitted != j1939->from_other_ecu_tp_dt.sequence_number || j1939->from_other_ecu_tp_cm.number_of_packages_being_transmitted == 0){
-		if (j1939->from_other_ecu_tp_cm.control_byte == CONTROL_BYTE_TP_CM_RTS) {
-			/* Send new CTS */
-			j1939->this_ecu_tp_cm.control_byte = CONTROL_BYTE_TP_CM_CTS;
-			j1939->this_ecu_tp_cm.total_number_of_packages_transmitted++;
-			j1939->this_ecu_tp_cm.next_packet_number_transmitted++;
-			SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, SA);
+
+	/* A lost, repeated or unasked for package ends the session - The sender of an RTS is told, a BAM is just dropped */
+	if (data[0] != session->next_packet_number || (session->control_byte == CONTROL_BYTE_TP_CM_RTS && session->number_of_packets_left == 0)) {
+		if (session->control_byte == CONTROL_BYTE_TP_CM_RTS) {
+			SAE_J1939_Send_Transport_Protocol_Abort(j1939, SA, TP_ABORT_BAD_SEQUENCE_NUMBER, session->PGN_of_the_packeted_message);
 		}
+		SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
 		return;
 	}
 
-	/* Our message are complete - Build it and call it complete_data[total_message_size] */
-	uint32_t PGN = j1939->from_other_ecu_tp_cm.PGN_of_the_packeted_message;
-	uint16_t total_message_size = j1939->from_other_ecu_tp_cm.total_message_size_being_transmitted;
-	uint8_t complete_data[MAX_TP_DT];
-	uint16_t inserted_bytes = 0;
-	for (i = 0; i < j1939->from_other_ecu_tp_dt.sequence_number; i++){
-		for (j = 0; j < 7; j++){
-			if (inserted_bytes < total_message_size){
-				complete_data[inserted_bytes++] = j1939->from_other_ecu_tp_dt.data[i*7 + j];
-			}
+	/* Save the sequence data - For every package, we send 7 bytes of data where the first byte data[0] is the sequence number */
+	message = SAE_J1939_Get_Transport_Protocol_Session_Data(j1939, session);
+	index = (data[0] - 1) * 7;
+	for (i = 1; i < 8 && index < session->total_message_size; i++) {
+		message[index++] = data[i];
+	}
+	session->elapsed_ms = 0;
+
+	/* Check if we have completed our message - Return = Not completed */
+	if (data[0] != session->number_of_packages) {
+		session->next_packet_number++;
+
+		/* Send new CTS when the last package of the window has arrived */
+		if (session->control_byte == CONTROL_BYTE_TP_CM_RTS && --session->number_of_packets_left == 0) {
+			SAE_J1939_Send_Transport_Protocol_Clear_To_Send(j1939, session);
 		}
+		return;
 	}
 
+	/* Our message are complete - message[0] to message[total_message_size - 1] */
+	uint32_t PGN = session->PGN_of_the_packeted_message;
+	uint16_t total_message_size = session->total_message_size;
+
 	/* Send an end of message ACK back */
-	if(j1939->from_other_ecu_tp_cm.control_byte == CONTROL_BYTE_TP_CM_RTS){
-		j1939->this_ecu_tp_cm.control_byte = CONTROL_BYTE_TP_CM_EndOfMsgACK;
-		j1939->this_ecu_tp_cm.total_number_of_bytes_received = j1939->from_other_ecu_tp_cm.total_message_size_being_transmitted;
-		j1939->this_ecu_tp_cm.total_number_of_packages_received = j1939->from_other_ecu_tp_dt.sequence_number;
-		SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, SA);
+	if (session->control_byte == CONTROL_BYTE_TP_CM_RTS) {
+		SAE_J1939_Send_Transport_Protocol_End_Of_Message_ACK(j1939, session);
 	}
+
 	/* Check what type of function that message want this ECU to do */
 	switch (PGN) {
 	case PGN_COMMANDED_ADDRESS:
-		SAE_J1939_Read_Commanded_Address(j1939, complete_data);								/* Insert new name and new address to this ECU */
+		SAE_J1939_Read_Commanded_Address(j1939, message, total_message_size);				/* Insert new name and new address to this ECU */
 		break;
 	case PGN_DM1:
-		SAE_J1939_Read_Response_Request_DM1(j1939, SA, complete_data, (total_message_size-2)/4); 	/* Number of DTCs = 4 bytes per DTC excluding 2 bytes for the lamp */
+		SAE_J1939_Read_Response_Request_DM1(j1939, SA, message, (total_message_size-2)/4); 	/* Number of DTCs = 4 bytes per DTC excluding 2 bytes for the lamp */
 		break;
 	case PGN_DM2:
-		SAE_J1939_Read_Response_Request_DM2(j1939, SA, complete_data, (total_message_size-2)/4); 	/* Number of DTCs = 4 bytes per DTC excluding 2 bytes for the lamp */
+		SAE_J1939_Read_Response_Request_DM2(j1939, SA, message, (total_message_size-2)/4); 	/* Number of DTCs = 4 bytes per DTC excluding 2 bytes for the lamp */
 		break;
 	case PGN_DM16:
-		SAE_J1939_Read_Binary_Data_Transfer_DM16(j1939, SA, complete_data);
+		SAE_J1939_Read_Binary_Data_Transfer_DM16(j1939, SA, message, total_message_size);
 		break;
 	case PGN_SOFTWARE_IDENTIFICATION:
-		SAE_J1939_Read_Response_Request_Software_Identification(j1939, SA, complete_data);
+		SAE_J1939_Read_Response_Request_Software_Identification(j1939, SA, message, total_message_size);
 		break;
 	case PGN_ECU_IDENTIFICATION:
-		SAE_J1939_Read_Response_Request_ECU_Identification(j1939, SA, complete_data);
+		SAE_J1939_Read_Response_Request_ECU_Identification(j1939, SA, message, total_message_size);
 		break;
 	case PGN_COMPONENT_IDENTIFICATION:
-		SAE_J1939_Read_Response_Request_Component_Identification(j1939, SA, complete_data);
+		SAE_J1939_Read_Response_Request_Component_Identification(j1939, SA, message, total_message_size);
 		break;
 	case PGN_PROPRIETARY_A:
-		SAE_J1939_Read_Response_Request_Proprietary_A(j1939, SA, complete_data);
+		SAE_J1939_Read_Response_Request_Proprietary_A(j1939, SA, message, total_message_size);
 		break;
 	/* Add more here */
 	default:
 		if (((PGN >= PGN_PROPRIETARY_B_START) && (PGN <= PGN_PROPRIETARY_B_END)) || 
 		    ((PGN >= PGN_PROPRIETARY_B2_START) && (PGN <= PGN_PROPRIETARY_B2_END))) {
-			SAE_J1939_Read_Response_Request_Proprietary_B(j1939, SA, PGN, complete_data);
+			SAE_J1939_Read_Response_Request_Proprietary_B(j1939, SA, PGN, message, total_message_size);
 			}
 		break;
 	}
 
-	/* Delete TP DT and TP CM */
-	memset(&j1939->from_other_ecu_tp_dt, 0, sizeof(j1939->from_other_ecu_tp_dt));
-	memset(&j1939->from_other_ecu_tp_cm, 0, sizeof(j1939->from_other_ecu_tp_cm));
+	/* The message has been read - Give the blocks back */
+	SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
+}
+
+/* Fill package with the sequence number and the 7 bytes of the session that belong to it. The bytes after the message are 0xFF */
+static void Load_Package(J1939 *j1939, struct TP_Session *session, uint8_t sequence_number, uint8_t package[]) {
+	uint8_t *message = SAE_J1939_Get_Transport_Protocol_Session_Data(j1939, session);
+	uint16_t bytes_sent = (sequence_number - 1) * 7;
+	uint8_t j;
+	package[0] = sequence_number;															/* Number of package */
+	for (j = 0; j < 7; j++) {
+		if (bytes_sent < session->total_message_size) {
+			package[j + 1] = message[bytes_sent++];											/* Data that we have collected */
+		}
+		else {
+			package[j + 1] = 0xFF; 															/* Reserved */
+		}
+	}
 }
 
 /*
- * Send sequence data packages to other ECU that we have loaded
+ * Send the sequence data packages that a CTS from DA asks for
  * PGN: 0x00EB00 (60160)
+ * The packages of a BAM are sent by SAE_J1939_Transport_Protocol_Tick, so the caller is not blocked between them. If the bus is busy,
+ * next_packet_number and number_of_packets_left keep what is left of the window and SAE_J1939_Transport_Protocol_Tick sends it later
  */
 ENUM_J1939_STATUS_CODES SAE_J1939_Send_Transport_Protocol_Data_Transfer(J1939 *j1939, uint8_t DA){
-	uint32_t ID = (0x1CEB << 16) | (DA << 8) | j1939->information_this_ECU.this_ECU_address;
-	uint8_t i, j, package[8];
-	uint16_t bytes_sent = 0;
+	struct TP_Session *session = SAE_J1939_Find_Transport_Protocol_Session(j1939, j1939->information_this_ECU.this_ECU_address, DA);
+	uint32_t ID[TP_DT_BURST];
+	uint8_t packages[TP_DT_BURST * 8];
+	uint8_t number_of_packages, number_of_packages_sent;
 	ENUM_J1939_STATUS_CODES status = STATUS_SEND_OK;
-	switch (j1939->from_other_ecu_tp_cm.control_byte) {
-	case CONTROL_BYTE_TP_CM_BAM:
-		for (i = 1; i <= j1939->this_ecu_tp_cm.number_of_packages_being_transmitted; i++) {
-			package[0] = i; 																	/* Number of package */
-			for (j = 0; j < 7; j++) {
-				if (bytes_sent < j1939->this_ecu_tp_cm.total_message_size_being_transmitted) {
-					package[j + 1] = j1939->this_ecu_tp_dt.data[bytes_sent++];					/* Data that we have collected */
-				}
-				else {
-					package[j + 1] = 0xFF; 														/* Reserved */
-				}
-			}
+	if (session == NULL || !session->is_sending || session->control_byte != CONTROL_BYTE_TP_CM_RTS) {
+		return STATUS_SEND_OK;
+	}
 
-			/* Transmitt message */
-			status = CAN_Send_Message(ID, package);
-			CAN_Delay(100);																		/* Important CAN delay according to standard */
-			if (status != STATUS_SEND_OK) {
-				break;
-			}
+	/* Never more packages than the message has */
+	if (session->next_packet_number == 0 || session->next_packet_number > session->number_of_packages) {
+		session->number_of_packets_left = 0;
+	} else if (session->number_of_packets_left > session->number_of_packages - session->next_packet_number + 1) {
+		session->number_of_packets_left = session->number_of_packages - session->next_packet_number + 1;
+	}
+
+	/* The packages that the CTS asks for, TP_DT_BURST packages for each CAN_Send_Messages call */
+	while (session->number_of_packets_left > 0 && status == STATUS_SEND_OK) {
+		for (number_of_packages = 0; number_of_packages < TP_DT_BURST && number_of_packages < session->number_of_packets_left; number_of_packages++) {
+			ID[number_of_packages] = (0x1CEB << 16) | (DA << 8) | j1939->information_this_ECU.this_ECU_address;
+			Load_Package(j1939, session, (uint8_t)(session->next_packet_number + number_of_packages), &packages[number_of_packages * 8]);
 		}
-		break;
-	case CONTROL_BYTE_TP_CM_CTS:
-		package[0] = j1939->from_other_ecu_tp_cm.next_packet_number_transmitted + 1;				/* Next number of package */
-		bytes_sent = j1939->from_other_ecu_tp_cm.total_number_of_packages_transmitted * 7;
-		for (j = 0; j < 7; j++) {
-			if (bytes_sent < j1939->this_ecu_tp_cm.total_message_size_being_transmitted) {
-				package[j + 1] = j1939->this_ecu_tp_dt.data[bytes_sent++];						/* Data that we have collected */
+		status = CAN_Send_Messages(j1939->can, ID, packages, number_of_packages, &number_of_packages_sent);
+		session->next_packet_number += number_of_packages_sent;
+		session->number_of_packets_left -= number_of_packages_sent;
+		if (number_of_packages_sent > 0) {
+			session->elapsed_ms = 0;
+		}
+	}
+	return status;
+}
+
+/* Abort the ETP message when the other ECU has not answered within timeout_ms */
+static void Tick_Extended_Transport_Protocol(J1939 *j1939, struct ETP *etp, uint16_t elapsed_ms) {
+	if (!etp->is_active) {
+		return;
+	}
+	etp->elapsed_ms = etp->elapsed_ms + elapsed_ms < etp->elapsed_ms ? 0xFFFF : etp->elapsed_ms + elapsed_ms;
+	if (etp->elapsed_ms >= etp->timeout_ms) {
+		SAE_J1939_Abort_Extended_Transport_Protocol(j1939, etp, TP_ABORT_TIMEOUT);
+	}
+}
+
+/*
+ * Send the next package of each BAM when the gap has elapsed, send the rest of the TP and ETP windows that the bus was too busy for, and close
+ * the sessions and ETP messages that have timed out. Call this with the
+ * milliseconds since the last call, e.g every 1 to 10 ms from the main loop or a timer. Only one package of a BAM is sent for each call, so
+ * the gap is never shorter than gap_ms
+ */
+void SAE_J1939_Transport_Protocol_Tick(J1939 *j1939, uint16_t elapsed_ms) {
+	uint32_t ID = (0x1CEBFF << 8) | j1939->information_this_ECU.this_ECU_address;
+	uint8_t package[8];
+	struct TP_Session *session;
+	ENUM_J1939_STATUS_CODES status;
+	uint8_t i;
+	for (i = 0; i < MAX_TP_SESSIONS; i++) {
+		session = &j1939->tp_sessions[i];
+		if (!session->in_use) {
+			continue;
+		}
+		session->elapsed_ms = session->elapsed_ms + elapsed_ms < session->elapsed_ms ? 0xFFFF : session->elapsed_ms + elapsed_ms;
+
+		/* Reading, or sending to one ECU - The other ECU has stopped answering */
+		if (!session->is_sending) {
+			if (session->elapsed_ms >= (session->control_byte == CONTROL_BYTE_TP_CM_BAM ? TP_TIMEOUT_T1_MS : TP_TIMEOUT_T2_MS)) {
+				if (session->control_byte == CONTROL_BYTE_TP_CM_RTS) {
+					SAE_J1939_Send_Transport_Protocol_Abort(j1939, session->SA, TP_ABORT_TIMEOUT, session->PGN_of_the_packeted_message);
+				}
+				SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
 			}
-			else {
-				package[j + 1] = 0xFF; 															/* Reserved */
+			continue;
+		}
+		if (session->control_byte == CONTROL_BYTE_TP_CM_RTS) {
+			if (session->elapsed_ms >= TP_TIMEOUT_T3_MS) {
+				SAE_J1939_Send_Transport_Protocol_Abort(j1939, session->DA, TP_ABORT_TIMEOUT, session->PGN_of_the_packeted_message);
+				SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
+			} else if (session->number_of_packets_left > 0) {
+				SAE_J1939_Send_Transport_Protocol_Data_Transfer(j1939, session->DA);				/* The rest of the window - The bus was busy */
 			}
+			continue;
+		}
+
+		/* Broadcast */
+		if (session->elapsed_ms < session->gap_ms) {
+			continue;
 		}
 
 		/* Transmitt message */
-		status = CAN_Send_Message(ID, package);
-		break;
+		Load_Package(j1939, session, session->next_packet_number, package);
+		status = CAN_Send_Message(j1939->can, ID, package);
+		if (status == STATUS_SEND_BUSY) {
+			continue;																			/* Try again at the next tick */
+		}
+		session->elapsed_ms = 0;
+		if (status != STATUS_SEND_OK || session->next_packet_number >= session->number_of_packages) {
+			SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
+			continue;
+		}
+		session->next_packet_number++;
 	}
-	
-	return status;
+
+	/* Extended Transport Protocol */
+	/* The rest of an ETP window - The bus was busy */
+	if (j1939->this_ecu_etp.is_active && j1939->this_ecu_etp.number_of_packets_left > 0) {
+		SAE_J1939_Send_Extended_Transport_Protocol_Data_Transfer(j1939, j1939->this_ecu_etp.address);
+	}
+	Tick_Extended_Transport_Protocol(j1939, &j1939->this_ecu_etp, elapsed_ms);
+	Tick_Extended_Transport_Protocol(j1939, &j1939->from_other_ecu_etp, elapsed_ms);
 }
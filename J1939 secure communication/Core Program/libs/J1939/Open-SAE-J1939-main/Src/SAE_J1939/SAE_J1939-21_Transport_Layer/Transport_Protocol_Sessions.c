@@ -0,0 +1,104 @@
+/*
+ * Transport_Protocol_Sessions.c
+ *
+ *  Created on: 18 okt. 2026
+ */
+
+#include "Transport_Layer.h"
+
+/* One bit for each block in tp_used_blocks */
+typedef char TP_BUFFER_BLOCKS_must_fit_in_32_bits[TP_BUFFER_BLOCKS <= 32 ? 1 : -1];
+
+/* Take number_of_blocks free blocks in a row from the pool. Returns TP_BUFFER_BLOCKS if there is no room */
+static uint8_t Allocate_Blocks(J1939 *j1939, uint8_t number_of_blocks) {
+	uint32_t blocks = number_of_blocks >= 32 ? 0xFFFFFFFFUL : (1UL << number_of_blocks) - 1;
+	uint8_t first_block;
+	for (first_block = 0; first_block + number_of_blocks <= TP_BUFFER_BLOCKS; first_block++) {
+		if ((j1939->tp_used_blocks & (blocks << first_block)) == 0) {
+			j1939->tp_used_blocks |= blocks << first_block;
+			return first_block;
+		}
+	}
+	return TP_BUFFER_BLOCKS;
+}
+
+/*
+ * Give a message of total_message_size bytes from SA to DA a session and a buffer. A new RTS or BAM that this ECU reads replaces the old session
+ * with the same SA and DA. Returns NULL if this ECU already sends to DA, if all sessions are used or if the pool has no room.
+ * The number of packages comes from total_message_size and not from the RTS or BAM, so the packages always cover the whole message
+ */
+struct TP_Session *SAE_J1939_Open_Transport_Protocol_Session(J1939 *j1939, bool is_sending, uint8_t SA, uint8_t DA, uint32_t PGN, uint16_t total_message_size) {
+	struct TP_Session *session = SAE_J1939_Find_Transport_Protocol_Session(j1939, SA, DA);
+	uint8_t number_of_blocks = (total_message_size + TP_BUFFER_BLOCK_SIZE - 1) / TP_BUFFER_BLOCK_SIZE;
+	uint8_t i;
+	if (total_message_size == 0 || total_message_size > MAX_TP_DT) {
+		return NULL;
+	}
+	if (session != NULL) {
+		if (session->is_sending) {
+			return NULL;
+		}
+		SAE_J1939_Close_Transport_Protocol_Session(j1939, session);
+	}
+
+	/* Free session */
+	session = NULL;
+	for (i = 0; i < MAX_TP_SESSIONS; i++) {
+		if (!j1939->tp_sessions[i].in_use) {
+			session = &j1939->tp_sessions[i];
+			break;
+		}
+	}
+	if (session == NULL) {
+		return NULL;
+	}
+	session->first_block = Allocate_Blocks(j1939, number_of_blocks);
+	if (session->first_block == TP_BUFFER_BLOCKS) {
+		return NULL;
+	}
+
+	session->in_use = true;
+	session->is_sending = is_sending;
+	session->control_byte = DA == 0xFF ? CONTROL_BYTE_TP_CM_BAM : CONTROL_BYTE_TP_CM_RTS;
+	session->SA = SA;
+	session->DA = DA;
+	session->PGN_of_the_packeted_message = PGN;
+	session->total_message_size = total_message_size;
+	session->number_of_packages = (total_message_size + 6) / 7;
+	session->maximum_packages_per_CTS = 0xFF;
+	session->next_packet_number = 1;
+	session->number_of_packets_left = 0;
+	session->gap_ms = 0;
+	session->elapsed_ms = 0;
+	session->number_of_blocks = number_of_blocks;
+	return session;
+}
+
+/*
+ * The session for the packages from SA to DA. Returns NULL if there is none.
+ * The PGN is not part of the key - SAE J1939-21 allows one TP connection for each SA and DA, and a TP DT package does not carry the PGN
+ */
+struct TP_Session *SAE_J1939_Find_Transport_Protocol_Session(J1939 *j1939, uint8_t SA, uint8_t DA) {
+	uint8_t i;
+	for (i = 0; i < MAX_TP_SESSIONS; i++) {
+		if (j1939->tp_sessions[i].in_use && j1939->tp_sessions[i].SA == SA && j1939->tp_sessions[i].DA == DA) {
+			return &j1939->tp_sessions[i];
+		}
+	}
+	return NULL;
+}
+
+/* First byte of the message of the session. Package n is at byte (n - 1) * 7 */
+uint8_t *SAE_J1939_Get_Transport_Protocol_Session_Data(J1939 *j1939, struct TP_Session *session) {
+	return &j1939->tp_buffer[session->first_block * TP_BUFFER_BLOCK_SIZE];
+}
+
+/*
+ * Give the session and its blocks back. The buffer is not cleared, the next session writes over it. A message is only read after all of
+ * its packages have arrived in order, so every byte of it has been written and nothing of an old session is read
+ */
+void SAE_J1939_Close_Transport_Protocol_Session(J1939 *j1939, struct TP_Session *session) {
+	uint32_t blocks = session->number_of_blocks >= 32 ? 0xFFFFFFFFUL : (1UL << session->number_of_blocks) - 1;
+	j1939->tp_used_blocks &= ~(blocks << session->first_block);
+	session->in_use = false;
+}
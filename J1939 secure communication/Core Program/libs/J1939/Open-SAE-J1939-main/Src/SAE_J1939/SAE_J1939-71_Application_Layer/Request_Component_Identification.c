@@ -38,7 +38,7 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Response_Request_Component_Identification(J193
 		data[5] = 0xFF;													 /* Reserved */
 		data[6] = 0xFF;													 /* Reserved */
 		data[7] = 0xFF;													 /* Reserved */
-		return CAN_Send_Message(ID, data);
+		return CAN_Send_Message(j1939->can, ID, data);
 	} else {
 		/* Multiple messages - Load data */
 		j1939->this_ecu_tp_cm.total_message_size_being_transmitted = 0;
@@ -55,17 +55,7 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Response_Request_Component_Identification(J193
 		j1939->this_ecu_tp_cm.number_of_packages_being_transmitted = j1939->this_ecu_tp_cm.total_message_size_being_transmitted % 8 > 0 ? j1939->this_ecu_tp_cm.total_message_size_being_transmitted/8 + 1 : j1939->this_ecu_tp_cm.total_message_size_being_transmitted/8; /* Rounding up */
 		j1939->this_ecu_tp_cm.PGN_of_the_packeted_message = PGN_COMPONENT_IDENTIFICATION;
 		j1939->this_ecu_tp_cm.control_byte = DA == 0xFF ? CONTROL_BYTE_TP_CM_BAM : CONTROL_BYTE_TP_CM_RTS; /* If broadcast, then use BAM control byte */
-		ENUM_J1939_STATUS_CODES status = SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, DA);
-		if(status != STATUS_SEND_OK){
-			return status;
-		}
-
-		/* Check if we are going to send it directly (BAM) */
-		if(j1939->this_ecu_tp_cm.control_byte == CONTROL_BYTE_TP_CM_BAM){
-			j1939->from_other_ecu_tp_cm.control_byte = j1939->this_ecu_tp_cm.control_byte;
-			return SAE_J1939_Send_Transport_Protocol_Data_Transfer(j1939, DA);
-		}
-		return status;
+		return SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, DA);
 	}
 }
 
@@ -73,10 +63,10 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Response_Request_Component_Identification(J193
  * Store the component identification about other ECU
  * PGN: 0x00FEEB (65259)
  */
-void SAE_J1939_Read_Response_Request_Component_Identification(J1939 *j1939, uint8_t SA, uint8_t data[]) {
+void SAE_J1939_Read_Response_Request_Component_Identification(J1939 *j1939, uint8_t SA, uint8_t data[], uint16_t length) {
 	/* Component identification have 4 fixed fields in the J1939 struct */
 	uint8_t i, length_of_each_field = j1939->from_other_ecu_identifications.component_identification.length_of_each_field;
-	for(i = 0; i < length_of_each_field; i++) {
+	for(i = 0; i < length_of_each_field && i + length_of_each_field*3 < length; i++) {
 		j1939->from_other_ecu_identifications.component_identification.component_product_date[i] = data[i];
 		j1939->from_other_ecu_identifications.component_identification.component_model_name[i] = data[i + length_of_each_field];
 		j1939->from_other_ecu_identifications.component_identification.component_serial_number[i] = data[i + length_of_each_field*2];
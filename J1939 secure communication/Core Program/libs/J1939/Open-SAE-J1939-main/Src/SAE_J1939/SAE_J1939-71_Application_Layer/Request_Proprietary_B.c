@@ -52,7 +52,7 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Response_Request_Proprietary_B(J1939* j1939, u
 		uint32_t ID = (PGN << 8) | j1939->information_this_ECU.this_ECU_address;
 		uint8_t data[8];
 		memcpy(data, proprietary_B->data, length_of_each_field);
-		return CAN_Send_Message(ID, data);
+		return CAN_Send_Message(j1939->can, ID, data);
 	}
 	else {
 		/* Multiple messages - Load data */
@@ -63,17 +63,7 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Response_Request_Proprietary_B(J1939* j1939, u
 		j1939->this_ecu_tp_cm.number_of_packages_being_transmitted = j1939->this_ecu_tp_cm.total_message_size_being_transmitted % 8 > 0 ? j1939->this_ecu_tp_cm.total_message_size_being_transmitted / 8 + 1 : j1939->this_ecu_tp_cm.total_message_size_being_transmitted / 8; /* Rounding up */
 		j1939->this_ecu_tp_cm.PGN_of_the_packeted_message = PGN;
 		j1939->this_ecu_tp_cm.control_byte = DA == 0xFF ? CONTROL_BYTE_TP_CM_BAM : CONTROL_BYTE_TP_CM_RTS; /* If broadcast, then use BAM control byte */
-		ENUM_J1939_STATUS_CODES status = SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, DA);
-		if (status != STATUS_SEND_OK) {
-			return status;
-		}
-
-		/* Check if we are going to send it directly (BAM) */
-		if (j1939->this_ecu_tp_cm.control_byte == CONTROL_BYTE_TP_CM_BAM) {
-			j1939->from_other_ecu_tp_cm.control_byte = j1939->this_ecu_tp_cm.control_byte;
-			return SAE_J1939_Send_Transport_Protocol_Data_Transfer(j1939, DA);
-		}
-		return status;
+		return SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, DA);
 	}
 }
 
@@ -81,7 +71,7 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Response_Request_Proprietary_B(J1939* j1939, u
  * Store the Proprietary B about other ECU
  * PGN: 0x00FF00 <-> 0x00FFFF
  */
-void SAE_J1939_Read_Response_Request_Proprietary_B(J1939* j1939, uint8_t SA, uint32_t PGN, uint8_t data[]) {
+void SAE_J1939_Read_Response_Request_Proprietary_B(J1939* j1939, uint8_t SA, uint32_t PGN, uint8_t data[], uint16_t length) {
 	struct Proprietary_B * proprietary_B = Get_Proprietary_B_By_PGN(&j1939->from_other_ecu_proprietary, PGN);
 
 	if (proprietary_B == NULL) /* Proprietary B is not expected, don't fill the data anywhere */
@@ -89,7 +79,7 @@ void SAE_J1939_Read_Response_Request_Proprietary_B(J1939* j1939, uint8_t SA, uin
 		return;
 	}
 
-	uint16_t total_bytes = proprietary_B->total_bytes;
+	uint16_t total_bytes = proprietary_B->total_bytes < length ? proprietary_B->total_bytes : length;
 	memcpy(proprietary_B->data, data, total_bytes);
 	proprietary_B->from_ecu_address = SA;
 }
@@ -32,7 +32,7 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Response_Request_Software_Identification(J1939
 		for(i = 0; i < 7; i++){
 			data[i+1] = j1939->information_this_ECU.this_identifications.software_identification.identifications[i];
 		}
-		return CAN_Send_Message(ID, data);
+		return CAN_Send_Message(j1939->can, ID, data);
 	} else {
 		/* Multiple messages - Load data */
 		j1939->this_ecu_tp_cm.total_message_size_being_transmitted = 0;
@@ -44,17 +44,7 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Response_Request_Software_Identification(J1939
 		j1939->this_ecu_tp_cm.number_of_packages_being_transmitted = j1939->this_ecu_tp_cm.total_message_size_being_transmitted % 8 > 0 ? j1939->this_ecu_tp_cm.total_message_size_being_transmitted /8 + 1 : j1939->this_ecu_tp_cm.total_message_size_being_transmitted/8; /* Rounding up */
 		j1939->this_ecu_tp_cm.PGN_of_the_packeted_message = PGN_SOFTWARE_IDENTIFICATION;
 		j1939->this_ecu_tp_cm.control_byte = DA == 0xFF ? CONTROL_BYTE_TP_CM_BAM : CONTROL_BYTE_TP_CM_RTS; /* If broadcast, then use BAM control byte */
-		ENUM_J1939_STATUS_CODES status = SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, DA);
-		if(status != STATUS_SEND_OK){
-			return status;
-		}
-
-		/* Check if we are going to send it directly (BAM) */
-		if(j1939->this_ecu_tp_cm.control_byte == CONTROL_BYTE_TP_CM_BAM){
-			j1939->from_other_ecu_tp_cm.control_byte = j1939->this_ecu_tp_cm.control_byte;
-			return SAE_J1939_Send_Transport_Protocol_Data_Transfer(j1939, DA);
-		}
-		return status;
+		return SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, DA);
 	}
 }
 
@@ -62,11 +52,17 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Response_Request_Software_Identification(J1939
  * Store the software identification about other ECU
  * PGN: 0x00FEDA (65242)
  */
-void SAE_J1939_Read_Response_Request_Software_Identification(J1939 *j1939, uint8_t SA, uint8_t data[]) {
-	j1939->from_other_ecu_identifications.software_identification.number_of_fields = data[0];			 /* How many fields we have */
+void SAE_J1939_Read_Response_Request_Software_Identification(J1939 *j1939, uint8_t SA, uint8_t data[], uint16_t length) {
+	uint8_t i, number_of_fields = data[0];															 /* How many fields we have */
+	if (number_of_fields > MAX_IDENTIFICATION) {
+		number_of_fields = MAX_IDENTIFICATION;
+	}
+	if (number_of_fields > length - 1) {
+		number_of_fields = length - 1;																 /* Not more fields than the message has */
+	}
+	j1939->from_other_ecu_identifications.software_identification.number_of_fields = number_of_fields;
 	j1939->from_other_ecu_identifications.software_identification.from_ecu_address = SA;
-	uint8_t i;
-	for(i = 0; i < data[0]; i++){
+	for(i = 0; i < number_of_fields; i++){
 		j1939->from_other_ecu_identifications.software_identification.identifications[i] = data[i+1];	 /* 1 for the number of fields */
 	}
 }
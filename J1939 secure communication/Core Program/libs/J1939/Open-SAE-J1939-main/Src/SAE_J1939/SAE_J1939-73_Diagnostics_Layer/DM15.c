@@ -26,7 +26,7 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Send_Response_DM15(J1939 *j1939, uint8_t DA, u
 	response_data[5] = EDCP_extention;
 	response_data[6] = seed;
 	response_data[7] = seed >> 8;
-	return CAN_Send_Message(ID, response_data);
+	return CAN_Send_Message(j1939->can, ID, response_data);
 }
 
 /*
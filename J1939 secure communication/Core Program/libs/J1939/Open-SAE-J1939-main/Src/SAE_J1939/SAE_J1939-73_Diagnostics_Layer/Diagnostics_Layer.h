@@ -49,7 +49,7 @@ void SAE_J1939_Read_Response_DM15(J1939 *j1939, uint8_t SA, uint8_t data[]);
 
 /* DM16 */
 ENUM_J1939_STATUS_CODES SAE_J1939_Send_Binary_Data_Transfer_DM16(J1939 *j1939, uint8_t DA, const uint8_t number_of_occurences, uint8_t raw_binary_data[]);
-void SAE_J1939_Read_Binary_Data_Transfer_DM16(J1939 *j1939, uint8_t SA, uint8_t data[]);
+void SAE_J1939_Read_Binary_Data_Transfer_DM16(J1939 *j1939, uint8_t SA, uint8_t data[], uint16_t length);
 
 #ifdef __cplusplus
 }
@@ -32,17 +32,7 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Send_Commanded_Address(J1939 *j1939, uint8_t D
 	/* Send TP CM */
 	j1939->this_ecu_tp_cm.PGN_of_the_packeted_message = PGN_COMMANDED_ADDRESS;
 	j1939->this_ecu_tp_cm.control_byte = DA == 0xFF ? CONTROL_BYTE_TP_CM_BAM : CONTROL_BYTE_TP_CM_RTS; /* If broadcast, then use BAM control byte */
-	ENUM_J1939_STATUS_CODES status = SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, DA);
-	if(status != STATUS_SEND_OK){
-		return status;
-	}
-
-	/* Check if we are going to send it directly (BAM) */
-	if(j1939->this_ecu_tp_cm.control_byte == CONTROL_BYTE_TP_CM_BAM){
-		j1939->from_other_ecu_tp_cm.control_byte = j1939->this_ecu_tp_cm.control_byte;
-		return SAE_J1939_Send_Transport_Protocol_Data_Transfer(j1939, DA);
-	}
-	return status;
+	return SAE_J1939_Send_Transport_Protocol_Connection_Management(j1939, DA);
 
 }
 
@@ -50,7 +40,12 @@ ENUM_J1939_STATUS_CODES SAE_J1939_Send_Commanded_Address(J1939 *j1939, uint8_t D
  * Read the commanded address from another ECU. Will always be called from Transport Protocol Data Transfer due to 9 bytes of data
  * PGN: 0x00FED8 (65240)
  */
-void SAE_J1939_Read_Commanded_Address(J1939 *j1939, uint8_t data[]) {
+void SAE_J1939_Read_Commanded_Address(J1939 *j1939, uint8_t data[], uint16_t length) {
+	/* 8 bytes NAME and 1 byte address */
+	if (length < 9) {
+		return;
+	}
+
 	/* Send to all ECU that the current address is unused */
 	SAE_J1939_Send_Address_Delete(j1939, 0xFF, j1939->information_this_ECU.this_ECU_address);
 
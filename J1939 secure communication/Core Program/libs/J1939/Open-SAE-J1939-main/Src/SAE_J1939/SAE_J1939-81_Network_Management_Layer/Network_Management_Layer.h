@@ -36,7 +36,7 @@ void SAE_J1939_Read_Address_Not_Claimed(J1939 *j1939, uint8_t SA, uint8_t data[]
 
 /* Commanded address */
 ENUM_J1939_STATUS_CODES SAE_J1939_Send_Commanded_Address(J1939 *j1939, uint8_t DA, uint8_t new_ECU_address, uint32_t identity_number, uint16_t manufacturer_code, uint8_t function_instance, uint8_t ECU_instance, uint8_t function, uint8_t vehicle_system, uint8_t arbitrary_address_capable, uint8_t industry_group, uint8_t vehicle_system_instance);
-void SAE_J1939_Read_Commanded_Address(J1939 *j1939, uint8_t data[]);
+void SAE_J1939_Read_Commanded_Address(J1939 *j1939, uint8_t data[], uint16_t length);
 
 /* Delete address */
 ENUM_J1939_STATUS_CODES SAE_J1939_Send_Address_Delete(J1939 *j1939, uint8_t DA, uint8_t old_ECU_address);
@@ -15,6 +15,10 @@ typedef enum {
 	CONTROL_BYTE_TP_CM_EndOfMsgACK = 0x13U,
 	CONTROL_BYTE_TP_CM_CTS = 0x11U,
 	CONTROL_BYTE_TP_CM_RTS = 0x10U,
+	CONTROL_BYTE_ETP_CM_RTS = 0x14U,
+	CONTROL_BYTE_ETP_CM_CTS = 0x15U,
+	CONTROL_BYTE_ETP_CM_DPO = 0x16U,
+	CONTROL_BYTE_ETP_CM_EndOfMsgACK = 0x17U,
 	CONTROL_BYTE_ACKNOWLEDGEMENT_PGN_SUPPORTED = 0x0U,
 	CONTROL_BYTE_ACKNOWLEDGEMENT_PGN_NOT_SUPPORTED = 0x1U,
 	CONTROL_BYTE_ACKNOWLEDGEMENT_PGN_ACCESS_DENIED = 0x2U,
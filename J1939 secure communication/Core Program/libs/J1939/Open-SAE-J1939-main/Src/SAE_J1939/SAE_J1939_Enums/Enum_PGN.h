@@ -15,6 +15,8 @@ typedef enum {
 	PGN_ACKNOWLEDGEMENT = 0x00E800U,
 	PGN_TP_CM = 0x00EC00U,
 	PGN_TP_DT = 0x00EB00U,
+	PGN_ETP_CM = 0x00C800U,
+	PGN_ETP_DT = 0x00C700U,
 	PGN_ADDRESS_CLAIMED = 0x00EE00U,
 	PGN_PROPRIETARY_A = 0x00EF00U,
 	PGN_COMMANDED_ADDRESS = 0x00FED8U,